@@ -74,6 +74,8 @@ int romi_temperature_is_high(void);
 int romi_get_temperature(uint8_t cpu);
 
 uint64_t romi_get_free_space(void);
+// Uncached free bytes of the device mounted at path
+uint64_t romi_get_device_free_space(const char* path);
 const char* romi_get_config_folder(void);
 const char* romi_get_temp_folder(void);
 const char* romi_get_app_folder(void);
@@ -82,14 +84,30 @@ int romi_is_installed(const char* titleid);
 int romi_install(const char* titleid);
 
 uint32_t romi_time_msec();
+// Monotonic, for timing work much shorter than a millisecond
+uint64_t romi_time_usec(void);
 
 typedef void romi_thread_entry(void);
 typedef void romi_thread_entry_arg(void* arg);
 void romi_start_thread(const char* name, romi_thread_entry* start);
-void romi_start_thread_arg(const char* name, romi_thread_entry_arg* start, void* arg);
+// returns 0 if the thread could not be created
+int romi_start_thread_arg(const char* name, romi_thread_entry_arg* start, void* arg);
 void romi_thread_exit(void);
 void romi_sleep(uint32_t msec);
 
+typedef uint32_t romi_mutex;
+int romi_mutex_create(romi_mutex* mutex, const char* name);
+void romi_mutex_destroy(romi_mutex* mutex);
+void romi_mutex_lock(romi_mutex* mutex);
+void romi_mutex_unlock(romi_mutex* mutex);
+
+// Counting semaphore, for waiting on threads without polling
+typedef uint32_t romi_sema;
+int romi_sema_create(romi_sema* sema, const char* name, uint32_t count);
+void romi_sema_destroy(romi_sema* sema);
+void romi_sema_wait(romi_sema* sema);
+void romi_sema_post(romi_sema* sema);
+
 int romi_load(const char* name, void* data, uint32_t max);
 int romi_save(const char* name, const void* data, uint32_t size);
 
@@ -98,6 +116,10 @@ void romi_unlock_process(void);
 
 int romi_dialog_lock(void);
 int romi_dialog_unlock(void);
+// Condition on the dialog lock: wait must be called with the lock held and
+// returns with it held again, wake releases every waiting thread
+void romi_dialog_wait(void);
+void romi_dialog_wake(void);
 
 void romi_dialog_input_text(const char* title, const char* text);
 int romi_dialog_input_update(void);
@@ -107,11 +129,33 @@ int romi_check_free_space(uint64_t http_length);
 
 typedef struct romi_http romi_http;
 
+// Timings of the last request on a handle, each phase on its own rather than cumulative
+typedef struct {
+    uint32_t dns_msec;
+    uint32_t connect_msec;
+    uint32_t tls_msec;
+    uint32_t ttfb_msec;     // request sent until the first response byte
+    uint32_t total_msec;
+    uint32_t redirects;
+    uint64_t bytes;
+    int proxy;
+    char ip[48];
+} romi_http_metrics;
+
 int romi_validate_url(const char* url);
 romi_http* romi_http_get(const char* url, const char* content, uint64_t offset, int use_throughput);
 int romi_http_response_length(romi_http* http, int64_t* length);
-int romi_http_read(romi_http* http, void* write_func, void* write_data, void* xferinfo_func);
+int romi_http_read(romi_http* http, void* write_func, void* write_data, void* xferinfo_func, void* xferinfo_data);
 void romi_http_close(romi_http* http);
+void romi_http_get_metrics(romi_http* http, romi_http_metrics* metrics);
+// Aborts romi_http_read when the speed stays below min_speed bytes/sec for seconds, 0 disables
+void romi_http_set_stall_timeout(romi_http* http, uint32_t min_speed, uint32_t seconds);
+// 1 if the last romi_http_read failed because the server ignored the resume offset
+int romi_http_range_ignored(romi_http* http);
+// 1 if the last request failed on the proxy; it is bypassed from now on, so one more try can go direct
+int romi_http_proxy_dropped(romi_http* http);
+// Fetches at most max_bytes from the start of url to measure connect time and throughput
+int romi_http_probe(const char* url, uint32_t max_bytes, uint32_t timeout_msec, uint32_t* connect_msec, uint32_t* bytes_per_sec);
 
 int romi_mkdirs(const char* path);
 void romi_rm(const char* file);
@@ -119,6 +163,8 @@ int64_t romi_get_size(const char* path);
 
 // creates file (if it exists, truncates size to 0)
 void* romi_create(const char* path);
+// cuts a file back to size bytes
+int romi_truncate(const char* path, uint64_t size);
 // open existing file in read mode, fails if file does not exist
 void* romi_open(const char* path);
 // open file for writing, next write will append data to end of it
@@ -127,6 +173,8 @@ void* romi_append(const char* path);
 void romi_close(void* f);
 
 int romi_read(void* f, void* buffer, uint32_t size);
+// moves the read position of a file opened with romi_open
+int romi_seek(void* f, uint64_t offset);
 int romi_write(void* f, const void* buffer, uint32_t size);
 
 // UI stuff
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include "romi_download.h"
+
+#define ROMI_PRIORITY_LOW    0
+#define ROMI_PRIORITY_NORMAL 1
+#define ROMI_PRIORITY_HIGH   2
+#define ROMI_PRIORITY_COUNT  3
+
+void romi_bandwidth_init(void);
+
+// Global cap in bytes per second shared by all transfers, 0 = unlimited
+void romi_bandwidth_set_limit(uint32_t bytes_per_sec);
+uint32_t romi_bandwidth_get_limit(void);
+
+void romi_bandwidth_register(RomiTransfer* transfer);
+void romi_bandwidth_unregister(RomiTransfer* transfer);
+
+// Accounts for bytes just received and blocks the calling transfer while it is over its share
+void romi_bandwidth_throttle(RomiTransfer* transfer, uint32_t bytes);
+
+const char* romi_priority_name(uint8_t priority);
@@ -2,6 +2,9 @@
 
 #include "romi_db.h"
 
+#define ROMI_RETRY_ATTEMPTS_DEFAULT 5
+#define ROMI_STALL_TIMEOUT_DEFAULT  30
+
 void romi_load_config(Config* config);
 void romi_save_config(const Config* config);
 
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+// Standard zip CRC-32 (reflected 0xEDB88320). Slice-by-8 tables, so the
+// checksum can run over extraction buffers while they are still in cache.
+
+void romi_crc32_init(void);
+
+// Continue a running crc, start with 0
+uint32_t romi_crc32(uint32_t crc, const void* data, uint32_t size);
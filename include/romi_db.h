@@ -92,6 +92,8 @@ typedef struct {
     const char* name;
     const char* url;
     int64_t size;
+    uint32_t crc32;     // of the downloaded file, from the optional HASH column
+    int has_crc32;
 } DbItem;
 
 typedef struct Config {
@@ -107,6 +109,14 @@ typedef struct Config {
     char proxy_url[512];
     char proxy_user[128];
     char proxy_pass[128];
+    uint32_t max_speed;
+    uint32_t retry_attempts;
+    uint32_t stall_timeout;
+    uint32_t schedule;          // RomiSchedulePolicy
+    uint32_t host_limit;        // transfers per server, 0 = unlimited
+    uint32_t thermal_warm;      // °C to drop a download, 0 = off
+    uint32_t thermal_hot;       // °C to run a single download and pause extraction, 0 = off
+    uint32_t thermal_frame;     // average msec per frame to drop a download, 0 = off
 } Config;
 
 int romi_db_reload(char* error, uint32_t error_size);
@@ -118,10 +128,15 @@ void romi_db_configure(const char* search, const Config* config);
 uint32_t romi_db_count(void);
 uint32_t romi_db_total(void);
 DbItem* romi_db_get(uint32_t index);
+// Catalog item by its stable key, whatever the current filter; NULL once it's gone from the catalog
+DbItem* romi_db_find(RomiPlatform platform, const char* url);
+// URL on the best ranked mirror of the item's platform
 const char* romi_db_get_full_url(const DbItem* item, char* buf, size_t size);
+// URL on the given mirror; with mirror -1 or an absolute url column the url is used as is
+const char* romi_db_get_mirror_url(const DbItem* item, int mirror, char* buf, size_t size);
 
 RomiPlatform romi_parse_platform(const char* str);
 RomiRegion romi_parse_region(const char* str);
 const char* romi_platform_name(RomiPlatform p);
-const char* romi_platform_folder(RomiPlatform p);
+const char* romi_platform_folder(RomiPlatform p, char* buf, size_t size);
 uint32_t romi_platform_filter(RomiPlatform p);
@@ -34,3 +34,5 @@ void romi_devices_set_selected_by_path(const char* path);
 
 int romi_devices_check_available(int index);
 const char* romi_devices_get_base_path(void);
+// Current free bytes of the selected device, read from the file system on every call
+uint64_t romi_devices_get_free_space(void);
@@ -2,11 +2,83 @@
 
 #include <stdint.h>
 #include "romi_db.h"
+#include "romi_extract.h"
+#include "romi_writer.h"
+#include "romi_throughput.h"
+#include "romi_metrics.h"
+#include "romi_space.h"
 
-typedef void (*RomiDownloadProgress)(const char* status, uint64_t downloaded, uint64_t total);
+// Below this the HEAD request costs more than the transfer, the database size is trusted instead
+#define ROMI_DOWNLOAD_SMALL_ITEM (1024 * 1024)
+// Fresh downloads after a file fails its catalog or ZIP CRC check, for corruption on the wire
+#define ROMI_DOWNLOAD_VERIFY_RETRIES 1
 
-int romi_download_rom(const DbItem* item, RomiDownloadProgress progress);
+typedef struct RomiTransfer RomiTransfer;
 
-void romi_download_cancel(void);
+typedef void (*RomiDownloadProgress)(RomiTransfer* transfer, const char* status, uint64_t downloaded, uint64_t total);
+
+// Per-download state, owned by the caller and passed through every callback
+// so several downloads can run in parallel without sharing counters.
+struct RomiTransfer {
+    volatile int cancelled;
+    RomiDownloadProgress progress;
+    void* user;
+    void* file;
+    RomiZipStream* zip;
+    RomiWriter* writer;
+    uint64_t total;
+    uint64_t current;
+    uint32_t last_progress_update;
+    uint32_t last_diagnostic;
+    uint32_t last_data_time;
+    uint32_t last_tick;
+    RomiThroughput throughput;
+    RomiMetrics metrics;
+    uint64_t io_usec;   // summed in usec, one write is usually well under a millisecond
+    int failover;       // another mirror is available, give up on this one when it stalls
+    int stalled;
+    int range_ignored;  // the mirror sent the whole file for a resumed request
+    int sink_failed;    // disk or extraction error, retrying elsewhere won't help
+    int no_space;       // the device can't hold the file next to the other transfers
+    int corrupt;        // archive failed CRC verification, downloading again may help
+    int verify;         // the catalog has a crc for this file
+    uint32_t crc;       // running crc of every byte received so far
+    uint8_t priority;
+    // bytes of a temp file left by an earlier session to keep, set before romi_download_fetch
+    uint64_t resume_offset;
+    int keep_partial;   // cancelled for shutdown, leave the temp file for the next session
+
+    // set by romi_download_fetch, install_pending when the temp file still has to be extracted or moved
+    int install_pending;
+    int install_extract;
+    char temp_path[512];
+    char install_path[512];
+
+    // disk space held from the first byte until the file is installed or dropped
+    RomiSpaceReservation space;
+
+    // bandwidth scheduler bookkeeping, owned by romi_bandwidth.c
+    RomiTransfer* bw_next;
+    uint32_t bw_rate;
+    int64_t bw_tokens;
+    uint32_t bw_refill_time;
+    uint32_t bw_window_bytes;
+    uint32_t bw_measured;
+};
+
+void romi_transfer_init(RomiTransfer* transfer, RomiDownloadProgress progress, void* user);
+
+// Network stage: archives that can be extracted on the fly are installed
+// right away, anything else is left in the temp folder for romi_download_install
+int romi_download_fetch(const DbItem* item, RomiTransfer* transfer);
+// Disk stage: extracts or moves the temp file left by romi_download_fetch
+int romi_download_install(RomiTransfer* transfer);
+int romi_download_rom(const DbItem* item, RomiTransfer* transfer);
+
+void romi_download_cancel(RomiTransfer* transfer);
+
+// attempts: consecutive failed attempts without new data before giving up;
+// stall_seconds: how long a connection may stay below 1 KB/s before it is dropped
+void romi_download_set_retry_policy(uint32_t attempts, uint32_t stall_seconds);
 
 char* romi_http_download_buffer(const char* url, uint32_t* buf_size);
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include "romi_db.h"
+#include "romi_space.h"
 
 typedef enum {
     ExtractOK = 0,
@@ -12,14 +13,37 @@ typedef enum {
     ExtractErrorWrite,
     ExtractErrorDecompress,
     ExtractCancelled,
+    ExtractErrorSpace,
+    ExtractErrorStream,
+    ExtractErrorChecksum,
 } RomiExtractResult;
 
-typedef void (*RomiExtractProgress)(const char* filename, uint64_t extracted, uint64_t total);
+typedef void (*RomiExtractProgress)(void* arg, const char* filename, uint64_t extracted, uint64_t total);
 
-RomiExtractResult romi_extract_zip(const char* zip_path, const char* dest_folder, RomiExtractProgress progress);
+// Entries are located through the central directory (romi_zip.h) and the files
+// are spread over a couple of threads, largest first; progress may be called from
+// any of them, one call at a time.
+// cancelled is polled between buffers; extraction stops as soon as it becomes non-zero.
+// Every entry is checked against its CRC-32 as it is written; a mismatch removes
+// the file and fails with ExtractErrorChecksum, which means the archive is corrupt
+RomiExtractResult romi_extract_zip(const char* zip_path, const char* dest_folder, RomiExtractProgress progress, void* progress_arg, volatile int* cancelled);
+
+// Incremental extractor fed with the archive bytes in download order. Entries
+// that can't be decoded without seeking (stored data with a trailing data
+// descriptor, unknown methods of unknown size) fail with ExtractErrorStream so
+// the caller can fall back to downloading the archive to a temp file first.
+// Every entry reserves its inflated size as the SpaceDownload part of space
+// before it is created and fails with ExtractErrorSpace if that doesn't fit;
+// with a NULL space the free space is only checked.
+typedef struct RomiZipStream RomiZipStream;
+
+RomiZipStream* romi_zip_stream_open(const char* dest_folder, volatile int* cancelled, RomiSpaceReservation* space);
+// Length of the whole archive, bounds the room for entries whose size is only known at their end
+void romi_zip_stream_set_length(RomiZipStream* zs, uint64_t length);
+RomiExtractResult romi_zip_stream_write(RomiZipStream* zs, const uint8_t* data, uint32_t size);
+// Frees the stream; returns the first error seen, or ExtractErrorFormat if the archive was truncated
+RomiExtractResult romi_zip_stream_close(RomiZipStream* zs);
 
 const char* romi_extract_error_string(RomiExtractResult result);
 
 int romi_is_zip_file(const char* path);
-
-void romi_extract_cancel(void);
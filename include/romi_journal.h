@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include "romi_db.h"
+#include "romi_writer.h"
+
+// Append-only log of the download queue in queue.journal, so the queue and
+// the progress of partial downloads survive quitting to the XMB, a crash or
+// a power cut. Entries refer to catalog items by platform and url, which
+// stay stable across database reloads where DbItem pointers don't. Once it
+// grows ROMI_JOURNAL_MAX_SIZE past its last compaction the queue rewrites it
+// with only the entries still alive.
+
+#define ROMI_JOURNAL_MAX_SIZE       (64 * 1024)
+// as many as the queue holds, a full journal is a few hundred KB
+#define ROMI_JOURNAL_MAX_ENTRIES    4096
+// anything larger is taken for a corrupt file and ignored
+#define ROMI_JOURNAL_MAX_LOAD       (8 * 1024 * 1024)
+#define ROMI_JOURNAL_URL_LENGTH     1024
+// progress recorded every this many bytes, not on every callback
+#define ROMI_JOURNAL_OFFSET_STEP    (8 * 1024 * 1024)
+// data still in the write-behind ring or the stdio buffer when the power
+// went may never have reached the disk, resume this far before the journal
+#define ROMI_JOURNAL_REWIND         (2 * ROMI_WRITER_BLOCKS * ROMI_WRITER_BLOCK_SIZE)
+
+typedef struct {
+    uint32_t id;
+    RomiPlatform platform;
+    uint8_t priority;
+    uint8_t status;         // DownloadStatus of the entry
+    uint64_t offset;        // bytes received when last recorded
+    char url[ROMI_JOURNAL_URL_LENGTH];
+} RomiJournalEntry;
+
+void romi_journal_init(void);
+// Stops all further writes, the journal keeps the state from before shutdown
+void romi_journal_close(void);
+
+// Replays the journal into entries in queue order; returns the count
+uint32_t romi_journal_load(RomiJournalEntry* entries, uint32_t max);
+int romi_journal_needs_compaction(void);
+// Call while the queue is locked, right before copying it into entries.
+// Returns 0 if the journal is closed or another compaction is running
+int romi_journal_begin_compaction(void);
+// Replaces the journal with one record per live entry plus anything recorded
+// since romi_journal_begin_compaction. The file is written without the queue
+// lock, the caller releases it after taking the snapshot
+void romi_journal_compact(const RomiJournalEntry* entries, uint32_t count);
+
+void romi_journal_add(uint32_t id, const DbItem* item, uint8_t priority);
+void romi_journal_status(uint32_t id, uint8_t status);
+void romi_journal_priority(uint32_t id, uint8_t priority);
+void romi_journal_offset(uint32_t id, uint64_t offset);
+void romi_journal_remove(uint32_t id);
+// Two entries traded places in the queue order
+void romi_journal_swap(uint32_t id, uint32_t other);
@@ -11,6 +11,7 @@ typedef enum {
     MenuResultAccept,
     MenuResultCancel,
     MenuResultRefresh,
+    MenuResultQueueAll,
 } MenuResult;
 
 int romi_menu_is_open(void);
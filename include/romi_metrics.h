@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include "romi.h"
+#include "romi_db.h"
+
+// Network timings of one download, summed over all of its attempts, kept
+// as one CSV line per download in transfers.csv. Long connect or TLS times
+// point at the route or proxy, a slow first byte at the mirror, and io time
+// at the PS3's own storage.
+
+#define ROMI_METRICS_MAX_HISTORY (256 * 1024)
+
+typedef struct {
+    uint32_t time;          // unix time the download finished
+    int success;
+    uint64_t bytes;
+    uint32_t total_msec;
+    uint32_t dns_msec;
+    uint32_t connect_msec;
+    uint32_t tls_msec;
+    uint32_t ttfb_msec;
+    uint32_t redirects;
+    uint32_t retries;
+    uint32_t stall_msec;    // no data arriving at all
+    uint32_t io_msec;       // network thread blocked writing or extracting
+    int proxy;
+    char ip[48];
+} RomiMetrics;
+
+void romi_metrics_init(void);
+
+// Folds the timings of one attempt into the download's totals
+void romi_metrics_add(RomiMetrics* metrics, const romi_http_metrics* http);
+
+void romi_metrics_record(const DbItem* item, RomiMetrics* metrics, int success);
+
+// Most recent record for item, 0 if it has never been downloaded. Served
+// from memory, the history is only read by romi_metrics_init
+int romi_metrics_find(const DbItem* item, RomiMetrics* metrics);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include "romi_db.h"
+
+// Each platform in sources.txt may be listed several times, one mirror per
+// line. Mirrors are ranked by measured throughput and failures, and the
+// rankings persist in mirrors.txt so later sessions start on the best one.
+
+#define ROMI_MAX_MIRRORS        4
+#define ROMI_MIRROR_PROBE_BYTES (64 * 1024)
+
+void romi_mirror_init(void);
+void romi_mirror_reset(void);
+int romi_mirror_add(RomiPlatform platform, const char* base_url);
+
+uint32_t romi_mirror_count(RomiPlatform platform);
+const char* romi_mirror_base(RomiPlatform platform, uint32_t index);
+// Best known mirror without probing, -1 if the platform has none
+int romi_mirror_best(RomiPlatform platform);
+
+// Fills order with mirror indices, best first. Mirrors never measured are
+// probed first with a small ranged request for path; returns the count
+uint32_t romi_mirror_rank(RomiPlatform platform, const char* path, uint32_t* order);
+
+// Feeds the outcome of a real transfer back into the ranking
+void romi_mirror_report(RomiPlatform platform, uint32_t index, uint64_t bytes, uint32_t msec, int success);
+
+void romi_mirror_load(void);
+// Writes mirrors.txt if the rankings changed since the last save
+void romi_mirror_save(void);
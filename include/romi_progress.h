@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+// Progress of one queue entry, published by its download worker on every
+// tick without taking the dialog lock. Writers bump seq to odd, update the
+// fields and bump it back to even; readers copy the fields and retry if seq
+// was odd or moved in the meantime, so the UI always draws a consistent
+// set of counters and status text and never blocks the network thread.
+
+#define ROMI_PROGRESS_TEXT_LENGTH 128
+
+typedef struct {
+    volatile uint32_t seq;
+    uint64_t downloaded;
+    uint64_t total;
+    char status_text[ROMI_PROGRESS_TEXT_LENGTH];
+} RomiProgress;
+
+typedef struct {
+    uint64_t downloaded;
+    uint64_t total;
+    char status_text[ROMI_PROGRESS_TEXT_LENGTH];
+} RomiProgressSnapshot;
+
+void romi_progress_reset(RomiProgress* progress, const char* status);
+
+// Writer side, safe from any thread; a NULL or empty status keeps the current text
+void romi_progress_publish(RomiProgress* progress, uint64_t downloaded, uint64_t total, const char* status);
+void romi_progress_set_counters(RomiProgress* progress, uint64_t downloaded, uint64_t total);
+void romi_progress_set_status(RomiProgress* progress, const char* status);
+
+// Reader side, safe from any thread
+void romi_progress_read(const RomiProgress* progress, RomiProgressSnapshot* snapshot);
+uint64_t romi_progress_downloaded(const RomiProgress* progress);
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "romi_db.h"
-#include <sys/thread.h>
+#include "romi_download.h"
+#include "romi_journal.h"
+#include "romi_progress.h"
 #include <stdint.h>
 
 typedef enum {
@@ -16,19 +18,31 @@ typedef enum {
 typedef struct DownloadQueueEntry {
     DbItem* item;
     DownloadStatus status;
-    uint64_t downloaded;
-    uint64_t total;
-    uint32_t speed;
-    char status_text[128];
+    RomiProgress progress;      // counters and status text, published without the dialog lock
     char error_message[256];
-    sys_ppu_thread_t thread_id;
+    RomiTransfer transfer;
+    uint8_t priority;
+    uint8_t verify_retries;
+    uint32_t host;              // romi_schedule_host of the item on its best mirror
     uint32_t start_time;
-    struct DownloadQueueEntry* next;
+    uint32_t journal_id;
+    uint64_t journaled;         // offset last written to the journal
+    uint64_t resume_offset;     // restored from the journal, handed to the next transfer
+    struct DownloadQueueEntry* next_free;
 } DownloadQueueEntry;
 
+#define ROMI_QUEUE_MAX_ENTRIES ROMI_JOURNAL_MAX_ENTRIES
+// Entries are carved out of slabs of this many and recycled through a free
+// list, never handed back to the heap, so a pointer held by a worker or the
+// UI always points at an entry
+#define ROMI_QUEUE_SLAB_ENTRIES 64
+
 typedef struct {
-    DownloadQueueEntry* head;
-    DownloadQueueEntry* tail;
+    // queue order, order[i] is row i of the queue dialog
+    DownloadQueueEntry* order[ROMI_QUEUE_MAX_ENTRIES];
+    DownloadQueueEntry* slabs[ROMI_QUEUE_MAX_ENTRIES / ROMI_QUEUE_SLAB_ENTRIES];
+    uint32_t slab_count;
+    DownloadQueueEntry* free_list;
     uint32_t count;
     uint32_t active_count;
     uint32_t max_concurrent;
@@ -36,13 +50,41 @@ typedef struct {
 
 #define ROMI_QUEUE_MAX_CONCURRENT_DEFAULT 3
 #define ROMI_QUEUE_MAX_CONCURRENT_LIMIT 4
+// downloaded archives allowed to wait for the install stage before fetch workers block
+#define ROMI_QUEUE_INSTALL_BACKLOG 2
 
 void romi_queue_init(void);
 void romi_queue_shutdown(void);
+// Re-queues what the journal held at the last exit, once the database is loaded
+void romi_queue_restore(void);
 int romi_queue_add(DbItem* item);
+// Adds items under a single lock, skipping any the queue already holds; returns how many were added
+uint32_t romi_queue_add_batch(DbItem** items, uint32_t count);
+// Drops the items the queue already holds, keeping the order of the rest; returns the new count
+uint32_t romi_queue_filter_queued(DbItem** items, uint32_t count);
+// Bytes the pending and running downloads still have to write to the device
+uint64_t romi_queue_get_pending_bytes(void);
 int romi_queue_remove(DownloadQueueEntry* entry);
 int romi_queue_cancel(DownloadQueueEntry* entry);
 int romi_queue_retry(DownloadQueueEntry* entry);
+int romi_queue_bump_priority(DownloadQueueEntry* entry);
+// Swaps the entry with its neighbour delta (-1 or 1) rows away; returns the new index or -1
+int romi_queue_move(DownloadQueueEntry* entry, int delta);
+
+// The same for callers already holding the dialog lock, like the queue dialog;
+// the dialog mutex is not recursive
+int romi_queue_remove_locked(DownloadQueueEntry* entry);
+int romi_queue_cancel_locked(DownloadQueueEntry* entry);
+int romi_queue_retry_locked(DownloadQueueEntry* entry);
+int romi_queue_bump_priority_locked(DownloadQueueEntry* entry);
+int romi_queue_move_locked(DownloadQueueEntry* entry, int delta);
+// Entries shift when one is removed, hold the dialog lock while using the result
 DownloadQueueEntry* romi_queue_get_entry(uint32_t index);
 uint32_t romi_queue_get_count(void);
 uint32_t romi_queue_get_active_count(void);
+// Downloads allowed to run at once, max_concurrent less the thermal throttle
+uint32_t romi_queue_get_download_limit(void);
+// Lets idle workers look at the queue again, after the throttle eased
+void romi_queue_wake(void);
+// Combined smoothed speed of the running downloads and the bytes they still have to fetch
+void romi_queue_get_throughput(uint32_t* speed, uint32_t* deviation, uint64_t* remaining);
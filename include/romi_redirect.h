@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// Where a download URL ended up after following its redirects. archive.org
+// style mirrors answer every request with a 302 to a datanode; with the
+// final URL cached, retries, resumed attempts and the HEAD/GET pair of one
+// download go straight to it and skip the extra round trip and DNS lookup.
+
+#define ROMI_REDIRECT_ENTRIES   16
+// datanode URLs stay valid for hours, re-resolve well before that
+#define ROMI_REDIRECT_TTL_MSEC  (10 * 60 * 1000)
+
+void romi_redirect_init(void);
+
+// Copies the cached final URL of url into effective, 0 if none or expired
+int romi_redirect_lookup(const char* url, char* effective, uint32_t size);
+void romi_redirect_store(const char* url, const char* effective);
+// Drops url's entry, for when its cached target stopped answering
+void romi_redirect_forget(const char* url);
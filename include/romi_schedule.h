@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+// Picks which pending download a free worker starts next. Kept apart from
+// the queue and its threads so the policies can be run against a simulated
+// clock on the host (tools/bench/sched_sim.c).
+//
+// Every policy starts the highest priority first and never opens more than
+// the host limit of transfers to one server; they differ in how they order
+// entries of the same priority.
+
+typedef enum {
+    ScheduleFifo,       // queue order, as added or moved in the queue dialog
+    ScheduleShortest,   // smallest first, the most items finished per minute
+    ScheduleMix,        // keep one small and one large transfer running
+    ScheduleCount,
+} RomiSchedulePolicy;
+
+#define ROMI_SCHEDULE_HOST_LIMIT_DEFAULT 2
+
+typedef struct {
+    int64_t size;       // catalog size, 0 when unknown
+    uint32_t host;      // romi_schedule_host of the server
+    uint8_t priority;
+} RomiScheduleItem;
+
+void romi_schedule_configure(RomiSchedulePolicy policy, uint32_t host_limit);
+RomiSchedulePolicy romi_schedule_policy(void);
+
+RomiSchedulePolicy romi_schedule_parse(const char* name);
+const char* romi_schedule_name(RomiSchedulePolicy policy);
+
+// Hash of the host that serves url: its own for an absolute url, else the one
+// of the mirror base it is relative to (NULL if none). Transfers with the same
+// hash share the host limit
+uint32_t romi_schedule_host(const char* base, const char* url);
+
+// Index into pending, in queue order, of the entry to start next while the
+// active ones run, or -1 when every candidate is held back by its host limit
+int romi_schedule_pick(const RomiScheduleItem* pending, uint32_t pending_count,
+    const RomiScheduleItem* active, uint32_t active_count);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+// Ledger of the disk space promised to running transfers, per storage
+// device. A transfer reserves the most it can still write before it opens
+// its files and reports how far it got as bytes land; every check subtracts
+// the part not written yet from the free space the file system reports, so
+// parallel downloads can't all count on the same free bytes.
+
+// devices are told apart by the first folder of a path, /dev_hdd0, /dev_usb000, ...
+#define ROMI_SPACE_DEVICE_LENGTH    32
+#define ROMI_SPACE_MAX_DEVICES      18
+// left free on top of every reservation, the file system needs some room of its own
+#define ROMI_SPACE_MARGIN           (1024 * 1024)
+
+typedef enum {
+    SpaceDownload,      // the temp file, or the files inflated while streaming
+    SpaceInstall,       // the files extracted from the temp file afterwards
+    SpaceCount,
+} RomiSpacePart;
+
+typedef struct RomiSpaceReservation RomiSpaceReservation;
+
+// Owned by a transfer, zeroed by romi_transfer_init
+struct RomiSpaceReservation {
+    RomiSpaceReservation* next;
+    int linked;
+    struct {
+        int device;                 // ledger slot of the device
+        uint64_t bytes;             // most the part may write, 0 while unused
+        uint64_t base;              // position the part counts from
+        volatile uint64_t landed;   // written by the owning transfer only
+    } parts[SpaceCount];
+};
+
+void romi_space_init(void);
+
+// Free bytes of the device holding path, less what running transfers have yet to write there.
+// Served from a cache that reservations keep current, so it is cheap under the dialog lock
+uint64_t romi_space_available(const char* path);
+// Measures the device holding path again, for space freed or taken outside the ledger
+void romi_space_refresh(const char* path);
+// 1 if both paths are on the same device
+int romi_space_same_device(const char* path, const char* other);
+
+// Sets part to bytes written under path from position base on, replacing
+// what the part held before; returns 0 without reserving if they don't fit
+int romi_space_reserve(RomiSpaceReservation* reservation, RomiSpacePart part, const char* path, uint64_t base, uint64_t bytes);
+// The part reached position, what lies behind it is on the disk. No lock, called for every write
+void romi_space_landed(RomiSpaceReservation* reservation, RomiSpacePart part, uint64_t position);
+// Drops every part, on completion, failure or cancel
+void romi_space_release(RomiSpaceReservation* reservation);
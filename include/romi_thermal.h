@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Throttles the download queue when the console runs hot or the UI stops
+// keeping up. Sensors are read through a RomiThermalSource and the clock is
+// passed in, so the policy can be replayed against recorded or simulated
+// traces on the host (tools/bench/thermal_sim.c).
+//
+// The level rises on the first sample over a threshold and falls one step
+// at a time once readings stay ROMI_THERMAL_HYSTERESIS below it for
+// ROMI_THERMAL_COOLDOWN_MSEC, so a fan spinning up doesn't make it flap.
+
+#define ROMI_THERMAL_WARM_DEFAULT       70      // °C, one download fewer
+#define ROMI_THERMAL_HOT_DEFAULT        80      // °C, one download and no extraction
+#define ROMI_THERMAL_FRAME_DEFAULT      50      // msec a frame may take on average before downloads are cut
+#define ROMI_THERMAL_SAMPLE_MSEC        2000
+#define ROMI_THERMAL_COOLDOWN_MSEC      30000
+#define ROMI_THERMAL_HYSTERESIS         3
+
+typedef enum {
+    ThrottleNone,
+    ThrottleReduced,    // one download fewer than max_concurrent
+    ThrottleMinimal,    // a single download, extraction waits
+    ThrottleCount,
+} RomiThrottle;
+
+// Reads the CPU and RSX temperatures in °C; returns 0 when the sensors can't be read
+typedef int (*RomiThermalSource)(void* arg, uint32_t* cpu, uint32_t* rsx);
+
+// Any threshold at 0 turns that check off
+void romi_thermal_configure(uint32_t warm, uint32_t hot, uint32_t frame_msec);
+void romi_thermal_set_source(RomiThermalSource source, void* arg);
+
+// Feeds the time the last frame took and reads the sensors every
+// ROMI_THERMAL_SAMPLE_MSEC; returns 1 when the throttle level changed
+int romi_thermal_update(uint32_t now, uint32_t frame_msec);
+
+RomiThrottle romi_thermal_level(void);
+// Averaged frame time in msec, as the policy sees it
+uint32_t romi_thermal_frame_msec(void);
+
+// Downloads allowed to run at the current level out of max_concurrent
+uint32_t romi_thermal_download_limit(uint32_t max_concurrent);
+int romi_thermal_install_allowed(void);
+
+const char* romi_thermal_name(RomiThrottle level);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+// Per-transfer speed tracker. The transfer thread drops received bytes into
+// fixed time buckets; every closed bucket updates an EWMA of the speed and
+// its mean deviation. Readers only load single aligned words, so the UI can
+// poll it without taking a lock.
+
+#define ROMI_THROUGHPUT_BUCKETS     16
+#define ROMI_THROUGHPUT_BUCKET_MSEC 500
+// buckets averaged for the instantaneous speed
+#define ROMI_THROUGHPUT_INSTANT     4
+
+typedef struct {
+    // writer side, only touched by the transfer thread
+    uint32_t buckets[ROMI_THROUGHPUT_BUCKETS];
+    uint32_t slot;          // absolute number of the bucket being filled
+    uint32_t closed;        // buckets closed so far, 0 until the first estimate
+
+    // published values in bytes/sec
+    volatile uint32_t ewma;
+    volatile uint32_t deviation;
+    volatile uint32_t instant;
+} RomiThroughput;
+
+void romi_throughput_reset(RomiThroughput* tp);
+
+// Writer side: account received bytes, and advance the clock when no data arrives
+void romi_throughput_add(RomiThroughput* tp, uint32_t bytes);
+void romi_throughput_tick(RomiThroughput* tp);
+
+// Reader side, safe from any thread
+uint32_t romi_throughput_speed(const RomiThroughput* tp);
+uint32_t romi_throughput_instant(const RomiThroughput* tp);
+
+// Seconds left for remaining bytes at the smoothed speed, with a band from
+// the speed's deviation. Returns 0 while there is no estimate yet
+int romi_throughput_eta(const RomiThroughput* tp, uint64_t remaining, uint32_t* eta, uint32_t* eta_min, uint32_t* eta_max);
+
+// Same estimate for several transfers sharing the remaining bytes
+int romi_throughput_eta_for(uint32_t speed, uint32_t deviation, uint64_t remaining, uint32_t* eta, uint32_t* eta_min, uint32_t* eta_max);
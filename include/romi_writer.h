@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+// Write-behind buffer between the network callback and the disk. The curl
+// thread only copies into a ring of large blocks, a writer thread drains
+// full blocks into the sink so slow storage doesn't stall the socket.
+
+#define ROMI_WRITER_BLOCK_SIZE  (256 * 1024)
+#define ROMI_WRITER_BLOCKS      8
+#define ROMI_WRITER_ALIGN       128
+
+// Returns non-zero on success; after a failure the remaining data is dropped
+typedef int (*RomiWriterSink)(void* arg, const uint8_t* data, uint32_t size);
+
+typedef struct RomiWriter RomiWriter;
+
+typedef struct {
+    uint32_t producer_stalls;   // ring full, network waited for storage
+    uint32_t producer_stall_msec;
+    uint32_t consumer_idles;    // ring empty, storage waited for network
+    uint64_t bytes_written;
+} RomiWriterStats;
+
+// NULL if the ring or its thread can't be set up, the caller writes synchronously then
+RomiWriter* romi_writer_open(RomiWriterSink sink, void* sink_arg);
+
+// Producer side, only ever called from one thread. Returns 0 once the sink has failed
+int romi_writer_write(RomiWriter* writer, const void* data, uint32_t size);
+
+// Flushes the partial block, waits for the writer thread and frees the ring.
+// Returns 1 when every block reached the sink successfully
+int romi_writer_close(RomiWriter* writer, RomiWriterStats* stats);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include "romi_extract.h"
+
+// Random access to a ZIP archive on disk through its central directory.
+// Sizes and CRCs come from the directory, so entries written with a data
+// descriptor (flag bit 3, zeros in the local header) read like any other.
+// ZIP64 archives, with entries or offsets past 4 GB, are read the same way.
+
+#define ROMI_ZIP_NAME_LENGTH    256
+// larger directories are taken for a corrupt archive
+#define ROMI_ZIP_MAX_DIRECTORY  (16 * 1024 * 1024)
+#define ROMI_ZIP64_EXTRA_ID     0x0001
+
+typedef struct {
+    char name[ROMI_ZIP_NAME_LENGTH];
+    uint16_t flags;
+    uint16_t method;
+    uint32_t crc32;
+    uint64_t comp_size;
+    uint64_t uncomp_size;
+    uint64_t header_offset;     // of the local header, the data follows it
+} RomiZipEntry;
+
+typedef struct {
+    RomiZipEntry* entries;
+    uint32_t count;
+    uint64_t total;             // uncompressed bytes of all entries
+} RomiZipDirectory;
+
+// Reads the end of central directory record and every entry it lists
+RomiExtractResult romi_zip_read_directory(const char* path, RomiZipDirectory* dir);
+void romi_zip_free_directory(RomiZipDirectory* dir);
+
+// romi_extract_zip for an archive whose directory the caller has already read
+RomiExtractResult romi_zip_extract_directory(const char* zip_path, const RomiZipDirectory* dir, const char* dest_folder, RomiExtractProgress progress, void* progress_arg, volatile int* cancelled);
+
+// Seeks f, opened on the same archive, to the first byte of the entry's data
+RomiExtractResult romi_zip_seek_data(void* f, const RomiZipEntry* entry);
+
+// Finds record id in an extra field; returns its data and length, NULL if absent
+const uint8_t* romi_zip_find_extra(const uint8_t* extra, uint32_t size, uint16_t id, uint32_t* len);
+
+// Replaces the sizes and offset stored as 0xffffffff with the 64-bit values of
+// the zip64 extra field, which holds just those, in this order. Pass NULL for
+// header_offset with a local header. Returns 0 if the field is missing or short
+int romi_zip64_extra(const uint8_t* extra, uint32_t size, uint64_t* uncomp_size, uint64_t* comp_size, uint64_t* header_offset);
@@ -8,6 +8,10 @@
 #include "romi_style.h"
 #include "romi_queue.h"
 #include "romi_devices.h"
+#include "romi_bandwidth.h"
+#include "romi_crc32.h"
+#include "romi_schedule.h"
+#include "romi_thermal.h"
 
 #include <stddef.h>
 #include <mini18n.h>
@@ -39,6 +43,14 @@ static int bottom_y;
 static char search_text[256];
 static char error_state[256];
 
+// items of the current view waiting for the "Queue all results" confirmation
+static DbItem** queue_plan;
+static uint32_t queue_plan_count;
+static int queue_plan_confirmed;
+// the presence scan of the view runs on its own thread behind a progress dialog
+static int queue_scan_running;
+static int queue_scan_done;
+
 static void reposition(void);
 
 static const char* romi_get_ok_str(void)
@@ -85,6 +97,7 @@ static void romi_refresh_thread(void)
 
     if (romi_db_reload(error_state, sizeof(error_state)))
     {
+        romi_queue_restore();
         first_item = 0;
         selected_item = 0;
         state = StateUpdateDone;
@@ -123,7 +136,7 @@ static const char* friendly_size_str(uint64_t size)
 
 int romi_check_free_space(uint64_t size)
 {
-    uint64_t free = romi_get_free_space();
+    uint64_t free = romi_devices_get_free_space();
     if (size > free + 1024 * 1024)
     {
         char error[256];
@@ -190,19 +203,33 @@ static const char* region_str(RomiRegion r)
     }
 }
 
+static int thermal_sensors(void* arg, uint32_t* cpu, uint32_t* rsx)
+{
+    ROMI_UNUSED(arg);
+    *cpu = (uint32_t)romi_get_temperature(0);
+    *rsx = (uint32_t)romi_get_temperature(1);
+    return 1;
+}
+
 static void cb_dialog_exit(int res)
 {
     state = StateTerminate;
 }
 
+// runs with the dialog lock held, the main loop does the actual queueing
+static void cb_dialog_queue_all(int res)
+{
+    ROMI_UNUSED(res);
+    queue_plan_confirmed = 1;
+}
+
 static int check_rom_installed(DbItem* item)
 {
     if (!item || !item->url)
         return 0;
 
-    const char* folder = romi_platform_folder(item->platform);
-    if (!folder)
-        return 0;
+    char folder[512];
+    romi_platform_folder(item->platform, folder, sizeof(folder));
 
     const char* slash = romi_strrchr(item->url, '/');
     if (!slash)
@@ -234,6 +261,128 @@ static int check_rom_installed(DbItem* item)
     return romi_get_size(path) > 0;
 }
 
+static void romi_free_queue_plan(void)
+{
+    romi_free(queue_plan);
+    queue_plan = NULL;
+    queue_plan_count = 0;
+    queue_plan_confirmed = 0;
+}
+
+// Stats every item of the view not checked yet, a few thousand on a large
+// view, so it stays off the render thread. Stops early when the progress
+// dialog is cancelled
+static void romi_queue_scan_thread(void)
+{
+    uint32_t db_count = romi_db_count();
+
+    for (uint32_t i = 0; i < db_count && !romi_dialog_is_cancelled(); i++)
+    {
+        DbItem* item = romi_db_get(i);
+        if (item->presence == PresenceUnknown)
+            item->presence = check_rom_installed(item) ? PresenceInstalled : PresenceMissing;
+
+        if (i % 64 == 0)
+        {
+            char text[256];
+            romi_snprintf(text, sizeof(text), _("Checking installed ROMs (%u of %u)"), i, db_count);
+            romi_dialog_set_progress(text, (int)(i * 100ULL / db_count));
+        }
+    }
+
+    queue_scan_done = 1;
+    romi_thread_exit();
+}
+
+// Starts the presence scan for "Queue all results", romi_plan_queue_all
+// picks up from it once queue_scan_done is set
+static void romi_start_queue_all(void)
+{
+    romi_free_queue_plan();
+
+    uint32_t db_count = romi_db_count();
+    uint32_t room = ROMI_QUEUE_MAX_ENTRIES - romi_queue_get_count();
+    if (db_count == 0 || room == 0)
+    {
+        romi_dialog_message(_("Queue all results"), db_count ? _("Download queue is full") : _("No results to queue"));
+        return;
+    }
+
+    queue_plan = romi_malloc(db_count * sizeof(DbItem*));
+    if (!queue_plan)
+    {
+        romi_dialog_error(_("Out of memory"));
+        return;
+    }
+
+    queue_scan_running = 1;
+    queue_scan_done = 0;
+    romi_dialog_start_progress(_("Queue all results"), _("Checking installed ROMs"), 0);
+    romi_start_thread("queue_scan", &romi_queue_scan_thread);
+}
+
+// Picks the items of the current view that fit on the selected device next
+// to what the queue still has to download, in view order, and asks before
+// queueing them
+static void romi_plan_queue_all(void)
+{
+    uint32_t db_count = romi_db_count();
+    uint32_t room = ROMI_QUEUE_MAX_ENTRIES - romi_queue_get_count();
+
+    uint32_t installed = 0;
+    for (uint32_t i = 0; i < db_count; i++)
+    {
+        DbItem* item = romi_db_get(i);
+        if (item->presence == PresenceInstalled)
+            installed++;
+        else
+            queue_plan[queue_plan_count++] = item;
+    }
+
+    uint32_t candidates = queue_plan_count;
+    queue_plan_count = romi_queue_filter_queued(queue_plan, queue_plan_count);
+    uint32_t queued = candidates - queue_plan_count;
+
+    uint64_t free = romi_devices_get_free_space();
+    uint64_t pending = romi_queue_get_pending_bytes();
+    uint64_t budget = free > pending ? free - pending : 0;
+
+    // the largest archive also needs room for its extracted copy until the temp file goes
+    uint64_t bytes = 0, largest = 0;
+    uint32_t accepted = 0;
+    for (uint32_t i = 0; i < queue_plan_count && accepted < room; i++)
+    {
+        DbItem* item = queue_plan[i];
+        uint64_t size = item->size > 0 ? (uint64_t)item->size : 0;
+        uint64_t peak = size > largest ? size : largest;
+        if (bytes + size + peak > budget)
+            continue;
+
+        bytes += size;
+        largest = peak;
+        queue_plan[accepted++] = item;
+    }
+    uint32_t skipped = queue_plan_count - accepted;
+    queue_plan_count = accepted;
+
+    LOG("queue all: %u results, %u installed, %u queued, %u fit in %llu bytes", db_count, installed, queued, accepted, budget);
+
+    char text[512];
+    if (accepted == 0)
+    {
+        romi_snprintf(text, sizeof(text), _("Nothing to queue: %u installed, %u already queued, %u do not fit in %u %s free"),
+            installed, queued, skipped, friendly_size(budget), friendly_size_str(budget));
+        romi_dialog_message(_("Queue all results"), text);
+        romi_free_queue_plan();
+        return;
+    }
+
+    romi_snprintf(text, sizeof(text), _("Queue %u of %u results (%u %s)?\n%u installed, %u already queued, %u do not fit.\n%u %s available after queued downloads"),
+        accepted, db_count, friendly_size(bytes), friendly_size_str(bytes),
+        installed, queued, skipped, friendly_size(budget), friendly_size_str(budget));
+    romi_dialog_ok_cancel(_("Queue all results"), text, &cb_dialog_queue_all);
+}
+
 static void romi_do_main(romi_input* input)
 {
     int col_platform = ROMI_MAIN_HMARGIN;
@@ -415,7 +564,8 @@ static void romi_do_main(romi_input* input)
 
         DbItem* item = romi_db_get(selected_item);
 
-        if (!romi_check_free_space(item->size))
+        // whatever the queue still downloads takes from the same free space
+        if (!romi_check_free_space((item->size > 0 ? (uint64_t)item->size : 0) + romi_queue_get_pending_bytes()))
         {
             LOG("[%s] %s - no free space", platform_str(item->platform), item->name);
             romi_dialog_error(_("Not enough free space on HDD"));
@@ -574,8 +724,14 @@ int main(int argc, const char* argv[])
 {
     romi_start();
     romi_devices_init();
+    romi_crc32_init();
 
     romi_load_config(&config);
+    romi_bandwidth_set_limit(config.max_speed * 1024);
+    romi_download_set_retry_policy(config.retry_attempts, config.stall_timeout);
+    romi_schedule_configure((RomiSchedulePolicy)config.schedule, config.host_limit);
+    romi_thermal_configure(config.thermal_warm, config.thermal_hot, config.thermal_frame);
+    romi_thermal_set_source(thermal_sensors, NULL);
     LOG("Detected system language: %s", config.language);
     if (config.music)
         romi_start_music();
@@ -599,6 +755,10 @@ int main(int argc, const char* argv[])
     romi_input input = {0, 0, 0, 0};
     while (romi_update(&input) && (state != StateTerminate))
     {
+        // a lower throttle lets the idle workers pick up more downloads
+        if (romi_thermal_update(romi_time_msec(), (uint32_t)input.delta))
+            romi_queue_wake();
+
         romi_draw_background(background);
 
         if (state == StateUpdateDone)
@@ -638,7 +798,29 @@ int main(int argc, const char* argv[])
             romi_do_dialog(&input);
 
             if (romi_dialog_is_cancelled())
+            {
                 romi_dialog_close();
+                // the "Queue all results" confirmation was declined
+                if (!queue_scan_running)
+                    romi_free_queue_plan();
+            }
+        }
+
+        if (queue_scan_done)
+        {
+            queue_scan_running = 0;
+            queue_scan_done = 0;
+            if (romi_dialog_is_cancelled())
+                romi_free_queue_plan();
+            else
+                romi_plan_queue_all();
+        }
+
+        if (queue_plan_confirmed)
+        {
+            romi_queue_add_batch(queue_plan, queue_plan_count);
+            romi_free_queue_plan();
+            romi_dialog_open_download_queue();
         }
 
         if (romi_dialog_input_update())
@@ -708,6 +890,10 @@ int main(int argc, const char* argv[])
                     state = StateRefreshing;
                     romi_start_thread("refresh_thread", &romi_refresh_thread);
                 }
+                else if (mres == MenuResultQueueAll && state == StateMain)
+                {
+                    romi_start_queue_all();
+                }
             }
         }
 
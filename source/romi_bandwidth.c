@@ -0,0 +1,222 @@
+#include "romi_bandwidth.h"
+#include "romi.h"
+#include "romi_utils.h"
+
+#define BW_REBALANCE_MSEC   500
+#define BW_MAX_SLEEP_MSEC   100
+#define BW_MIN_RATE         (16 * 1024)
+#define BW_SMALL_ITEM       (1024 * 1024)
+#define BW_MEDIUM_ITEM      (64 * 1024 * 1024)
+
+static romi_mutex g_bw_lock;
+static RomiTransfer* g_bw_active = NULL;
+static uint32_t g_bw_limit = 0;
+static uint32_t g_bw_last_rebalance = 0;
+
+void romi_bandwidth_init(void)
+{
+    romi_mutex_create(&g_bw_lock, "bw");
+    g_bw_active = NULL;
+    g_bw_last_rebalance = romi_time_msec();
+}
+
+void romi_bandwidth_set_limit(uint32_t bytes_per_sec)
+{
+    romi_mutex_lock(&g_bw_lock);
+    g_bw_limit = bytes_per_sec;
+    LOG("bandwidth limit set to %u KB/s", bytes_per_sec / 1024);
+    romi_mutex_unlock(&g_bw_lock);
+}
+
+uint32_t romi_bandwidth_get_limit(void)
+{
+    return g_bw_limit;
+}
+
+// Small remaining downloads get a bigger slice so they finish quickly,
+// large ones then soak up whatever the others leave unused.
+static uint32_t transfer_weight(const RomiTransfer* t)
+{
+    uint64_t remaining = t->total > t->current ? t->total - t->current : 0;
+    uint32_t size_factor;
+
+    if (t->total == 0)
+        size_factor = 2;
+    else if (remaining < BW_SMALL_ITEM)
+        size_factor = 8;
+    else if (remaining < BW_MEDIUM_ITEM)
+        size_factor = 4;
+    else
+        size_factor = 1;
+
+    return size_factor << (2 * min32(t->priority, ROMI_PRIORITY_HIGH));
+}
+
+// Weighted max-min fair split of the available capacity. Transfers that
+// can't use their share (slow mirror, latency bound) keep what they use
+// plus some headroom, and the rest is redistributed to the others.
+static void rebalance(uint32_t now)
+{
+    uint32_t elapsed = now - g_bw_last_rebalance;
+    g_bw_last_rebalance = now;
+
+    uint32_t count = 0;
+    uint64_t aggregate = 0;
+
+    for (RomiTransfer* t = g_bw_active; t; t = t->bw_next)
+    {
+        if (elapsed > 0)
+            t->bw_measured = (uint32_t)((uint64_t)t->bw_window_bytes * 1000 / elapsed);
+        t->bw_window_bytes = 0;
+        aggregate += t->bw_measured;
+        count++;
+    }
+
+    uint64_t capacity = g_bw_limit;
+    if (capacity == 0)
+    {
+        // Without a cap there is nothing to share unless transfers compete;
+        // probe above the measured total so the link can still ramp up.
+        if (count < 2 || aggregate == 0)
+        {
+            for (RomiTransfer* t = g_bw_active; t; t = t->bw_next)
+                t->bw_rate = 0;
+            return;
+        }
+        capacity = aggregate + aggregate / 4;
+    }
+
+    for (RomiTransfer* t = g_bw_active; t; t = t->bw_next)
+        t->bw_rate = 0;
+
+    uint64_t remaining = capacity;
+    int changed = 1;
+
+    while (changed && remaining > 0)
+    {
+        changed = 0;
+
+        uint64_t weights = 0;
+        for (RomiTransfer* t = g_bw_active; t; t = t->bw_next)
+        {
+            if (t->bw_rate == 0)
+                weights += transfer_weight(t);
+        }
+        if (weights == 0)
+            break;
+
+        for (RomiTransfer* t = g_bw_active; t; t = t->bw_next)
+        {
+            if (t->bw_rate != 0)
+                continue;
+
+            uint64_t share = remaining * transfer_weight(t) / weights;
+            uint64_t demand = (uint64_t)t->bw_measured * 2 + BW_MIN_RATE;
+
+            if (t->bw_measured > 0 && demand < share)
+            {
+                t->bw_rate = (uint32_t)demand;
+                remaining -= demand;
+                changed = 1;
+            }
+        }
+    }
+
+    uint64_t weights = 0;
+    for (RomiTransfer* t = g_bw_active; t; t = t->bw_next)
+    {
+        if (t->bw_rate == 0)
+            weights += transfer_weight(t);
+    }
+
+    for (RomiTransfer* t = g_bw_active; t; t = t->bw_next)
+    {
+        if (t->bw_rate == 0 && weights > 0)
+            t->bw_rate = (uint32_t)max64(remaining * transfer_weight(t) / weights, BW_MIN_RATE);
+    }
+}
+
+void romi_bandwidth_register(RomiTransfer* transfer)
+{
+    romi_mutex_lock(&g_bw_lock);
+
+    transfer->bw_rate = 0;
+    transfer->bw_tokens = 0;
+    transfer->bw_window_bytes = 0;
+    transfer->bw_measured = 0;
+    transfer->bw_refill_time = romi_time_msec();
+    transfer->bw_next = g_bw_active;
+    g_bw_active = transfer;
+
+    romi_mutex_unlock(&g_bw_lock);
+}
+
+void romi_bandwidth_unregister(RomiTransfer* transfer)
+{
+    romi_mutex_lock(&g_bw_lock);
+
+    RomiTransfer** link = &g_bw_active;
+    while (*link)
+    {
+        if (*link == transfer)
+        {
+            *link = transfer->bw_next;
+            break;
+        }
+        link = &(*link)->bw_next;
+    }
+    transfer->bw_next = NULL;
+
+    romi_mutex_unlock(&g_bw_lock);
+}
+
+void romi_bandwidth_throttle(RomiTransfer* transfer, uint32_t bytes)
+{
+    uint32_t wait = 0;
+
+    romi_mutex_lock(&g_bw_lock);
+
+    uint32_t now = romi_time_msec();
+    transfer->bw_window_bytes += bytes;
+
+    if (now - g_bw_last_rebalance >= BW_REBALANCE_MSEC)
+        rebalance(now);
+
+    if (transfer->bw_rate == 0)
+    {
+        transfer->bw_tokens = 0;
+    }
+    else
+    {
+        int64_t burst = max32(transfer->bw_rate / 4, BW_MIN_RATE);
+
+        transfer->bw_tokens += (int64_t)transfer->bw_rate * (now - transfer->bw_refill_time) / 1000;
+        if (transfer->bw_tokens > burst)
+            transfer->bw_tokens = burst;
+
+        transfer->bw_tokens -= bytes;
+        if (transfer->bw_tokens < 0)
+            wait = (uint32_t)(-transfer->bw_tokens * 1000 / transfer->bw_rate);
+    }
+    transfer->bw_refill_time = now;
+
+    romi_mutex_unlock(&g_bw_lock);
+
+    // Blocking the curl write callback lets TCP flow control slow the sender
+    while (wait > 0 && !transfer->cancelled)
+    {
+        uint32_t slice = min32(wait, BW_MAX_SLEEP_MSEC);
+        romi_sleep(slice);
+        wait -= slice;
+    }
+}
+
+const char* romi_priority_name(uint8_t priority)
+{
+    switch (priority)
+    {
+        case ROMI_PRIORITY_LOW:    return "Low";
+        case ROMI_PRIORITY_HIGH:   return "High";
+        default:                   return "Normal";
+    }
+}
@@ -1,5 +1,7 @@
 #include "romi_config.h"
 #include "romi.h"
+#include "romi_schedule.h"
+#include "romi_thermal.h"
 
 static char* skipnonws(char* text, char* end)
 {
@@ -110,6 +112,14 @@ void romi_load_config(Config* config)
     config->proxy_url[0] = '\0';
     config->proxy_user[0] = '\0';
     config->proxy_pass[0] = '\0';
+    config->max_speed = 0;
+    config->retry_attempts = ROMI_RETRY_ATTEMPTS_DEFAULT;
+    config->stall_timeout = ROMI_STALL_TIMEOUT_DEFAULT;
+    config->schedule = ScheduleFifo;
+    config->host_limit = ROMI_SCHEDULE_HOST_LIMIT_DEFAULT;
+    config->thermal_warm = ROMI_THERMAL_WARM_DEFAULT;
+    config->thermal_hot = ROMI_THERMAL_HOT_DEFAULT;
+    config->thermal_frame = ROMI_THERMAL_FRAME_DEFAULT;
     romi_strncpy(config->language, sizeof(config->language), romi_get_user_language());
 
     char data[4096];
@@ -173,6 +183,22 @@ void romi_load_config(Config* config)
             romi_strncpy(config->proxy_user, sizeof(config->proxy_user), value);
         else if (romi_stricmp(key, "proxy_pass") == 0)
             romi_strncpy(config->proxy_pass, sizeof(config->proxy_pass), value);
+        else if (romi_stricmp(key, "max_speed") == 0)
+            config->max_speed = (uint32_t)romi_strtoll(value);
+        else if (romi_stricmp(key, "retry_attempts") == 0)
+            config->retry_attempts = (uint32_t)romi_strtoll(value);
+        else if (romi_stricmp(key, "stall_timeout") == 0)
+            config->stall_timeout = (uint32_t)romi_strtoll(value);
+        else if (romi_stricmp(key, "schedule") == 0)
+            config->schedule = romi_schedule_parse(value);
+        else if (romi_stricmp(key, "host_limit") == 0)
+            config->host_limit = (uint32_t)romi_strtoll(value);
+        else if (romi_stricmp(key, "thermal_warm") == 0)
+            config->thermal_warm = (uint32_t)romi_strtoll(value);
+        else if (romi_stricmp(key, "thermal_hot") == 0)
+            config->thermal_hot = (uint32_t)romi_strtoll(value);
+        else if (romi_stricmp(key, "thermal_frame") == 0)
+            config->thermal_frame = (uint32_t)romi_strtoll(value);
     }
 }
 
@@ -265,6 +291,30 @@ void romi_save_config(const Config* config)
             len += romi_snprintf(data + len, sizeof(data) - len, "proxy_pass %s\n", config->proxy_pass);
     }
 
+    if (config->max_speed)
+        len += romi_snprintf(data + len, sizeof(data) - len, "max_speed %u\n", config->max_speed);
+
+    if (config->retry_attempts != ROMI_RETRY_ATTEMPTS_DEFAULT)
+        len += romi_snprintf(data + len, sizeof(data) - len, "retry_attempts %u\n", config->retry_attempts);
+
+    if (config->stall_timeout != ROMI_STALL_TIMEOUT_DEFAULT)
+        len += romi_snprintf(data + len, sizeof(data) - len, "stall_timeout %u\n", config->stall_timeout);
+
+    if (config->schedule != ScheduleFifo)
+        len += romi_snprintf(data + len, sizeof(data) - len, "schedule %s\n", romi_schedule_name((RomiSchedulePolicy)config->schedule));
+
+    if (config->host_limit != ROMI_SCHEDULE_HOST_LIMIT_DEFAULT)
+        len += romi_snprintf(data + len, sizeof(data) - len, "host_limit %u\n", config->host_limit);
+
+    if (config->thermal_warm != ROMI_THERMAL_WARM_DEFAULT)
+        len += romi_snprintf(data + len, sizeof(data) - len, "thermal_warm %u\n", config->thermal_warm);
+
+    if (config->thermal_hot != ROMI_THERMAL_HOT_DEFAULT)
+        len += romi_snprintf(data + len, sizeof(data) - len, "thermal_hot %u\n", config->thermal_hot);
+
+    if (config->thermal_frame != ROMI_THERMAL_FRAME_DEFAULT)
+        len += romi_snprintf(data + len, sizeof(data) - len, "thermal_frame %u\n", config->thermal_frame);
+
     char path[256];
     romi_snprintf(path, sizeof(path), "%s/config.txt", romi_get_config_folder());
 
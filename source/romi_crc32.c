@@ -0,0 +1,57 @@
+#include "romi_crc32.h"
+
+#define CRC32_POLY 0xEDB88320
+
+static uint32_t g_crc32_table[8][256];
+
+void romi_crc32_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (CRC32_POLY & (0 - (crc & 1)));
+        g_crc32_table[0][i] = crc;
+    }
+
+    // table[n][i] is the crc of byte i followed by n zero bytes
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        for (int n = 1; n < 8; n++)
+        {
+            uint32_t prev = g_crc32_table[n - 1][i];
+            g_crc32_table[n][i] = (prev >> 8) ^ g_crc32_table[0][prev & 0xff];
+        }
+    }
+}
+
+uint32_t romi_crc32(uint32_t crc, const void* data, uint32_t size)
+{
+    const uint8_t* p = data;
+    crc = ~crc;
+
+    // the PPU has no crc instruction; words are assembled from bytes so the
+    // same code runs on the big-endian console and little-endian hosts
+    while (size >= 8)
+    {
+        uint32_t one = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t two = (uint32_t)p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+
+        crc = g_crc32_table[7][one & 0xff] ^
+              g_crc32_table[6][(one >> 8) & 0xff] ^
+              g_crc32_table[5][(one >> 16) & 0xff] ^
+              g_crc32_table[4][one >> 24] ^
+              g_crc32_table[3][two & 0xff] ^
+              g_crc32_table[2][(two >> 8) & 0xff] ^
+              g_crc32_table[1][(two >> 16) & 0xff] ^
+              g_crc32_table[0][two >> 24];
+
+        p += 8;
+        size -= 8;
+    }
+
+    while (size-- > 0)
+        crc = (crc >> 8) ^ g_crc32_table[0][(crc ^ *p++) & 0xff];
+
+    return ~crc;
+}
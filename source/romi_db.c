@@ -3,6 +3,7 @@
 #include "romi_utils.h"
 #include "romi.h"
 #include "romi_devices.h"
+#include "romi_mirror.h"
 
 #include <stddef.h>
 #include <stdlib.h>
@@ -11,7 +12,9 @@
 
 #define MAX_DB_SIZE (32*1024*1024)
 #define MAX_DB_ITEMS 0x20000
-#define TSV_COLUMNS 5
+#define TSV_COLUMNS 6
+// the HASH column is optional, older catalogs stop after SIZE
+#define TSV_MIN_COLUMNS 5
 
 static char* db_data = NULL;
 static uint32_t db_total;
@@ -50,9 +53,6 @@ static const char* platform_suffixes[] = {
     "ROMS/MAMEPLUS"
 };
 
-#define MAX_URL_LENGTH 512
-
-static char platform_base_urls[PlatformCount][MAX_URL_LENGTH];
 static int sources_loaded = 0;
 
 RomiPlatform romi_parse_platform(const char* str)
@@ -97,9 +97,8 @@ const char* romi_platform_name(RomiPlatform p)
     return platform_names[p];
 }
 
-const char* romi_platform_folder(RomiPlatform p)
+const char* romi_platform_folder(RomiPlatform p, char* buf, size_t size)
 {
-    static char path_buffer[512];
     const char* base = romi_devices_get_base_path();
     const char* suffix;
 
@@ -109,8 +108,8 @@ const char* romi_platform_folder(RomiPlatform p)
         suffix = platform_suffixes[p];
     }
 
-    romi_snprintf(path_buffer, sizeof(path_buffer), "%s%s", base, suffix);
-    return path_buffer;
+    romi_snprintf(buf, size, "%s%s", base, suffix);
+    return buf;
 }
 
 uint32_t romi_platform_filter(RomiPlatform p)
@@ -160,8 +159,7 @@ static void load_sources(void)
     if (sources_loaded)
         return;
 
-    for (int i = 0; i < PlatformCount; i++)
-        platform_base_urls[i][0] = '\0';
+    romi_mirror_reset();
 
     char data[8192];
     char path[256];
@@ -222,17 +220,45 @@ static void load_sources(void)
         *key_end = '\0';
         *value_end = '\0';
 
+        // a platform listed more than once gets one mirror per line
         RomiPlatform platform = romi_parse_platform(key_start);
         if (platform != PlatformUnknown && platform < PlatformCount)
         {
-            romi_strncpy(platform_base_urls[platform], MAX_URL_LENGTH, value_start);
+            if (!romi_mirror_add(platform, value_start))
+            {
+                LOG("too many mirrors for %s, ignoring [%s]", key_start, value_start);
+                continue;
+            }
             LOG("source %s = [%s] (len=%d)", key_start, value_start, (int)romi_strlen(value_start));
         }
     }
 
+    romi_mirror_load();
     sources_loaded = 1;
 }
 
+// HASH column: crc32 of the file as 8 hex digits, anything else is ignored
+static int parse_hash(const char* str, uint32_t* crc)
+{
+    uint32_t value = 0;
+    int digits = 0;
+
+    for (; *str; str++, digits++)
+    {
+        char c = *str;
+        if (c >= '0' && c <= '9') value = (value << 4) | (uint32_t)(c - '0');
+        else if (c >= 'a' && c <= 'f') value = (value << 4) | (uint32_t)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') value = (value << 4) | (uint32_t)(c - 'A' + 10);
+        else return 0;
+    }
+
+    if (digits != 8)
+        return 0;
+
+    *crc = value;
+    return 1;
+}
+
 static int load_tsv_database(const char* path)
 {
     int loaded = romi_load(path, db_data + db_size, MAX_DB_SIZE - db_size - 1);
@@ -253,6 +279,7 @@ static int load_tsv_database(const char* path)
     {
         const char* columns[TSV_COLUMNS] = {0};
         uint8_t col = 0;
+        int line_end = 0;
 
         while (ptr < end && col < TSV_COLUMNS)
         {
@@ -267,15 +294,23 @@ static int load_tsv_database(const char* path)
             } else {
                 *ptr++ = 0;
                 col++;
+                line_end = 1;
                 break;
             }
         }
 
-        if (col == TSV_COLUMNS && columns[3] && columns[3][0])
+        // columns added after HASH are skipped so newer catalogs still load
+        if (!line_end)
+        {
+            while (ptr < end && *ptr != '\n' && *ptr != '\r')
+                ptr++;
+        }
+
+        if (col >= TSV_MIN_COLUMNS && columns[3] && columns[3][0])
         {
             RomiPlatform platform = romi_parse_platform(columns[0]);
             int valid_url = romi_validate_url(columns[3]);
-            int has_base_url = (platform < PlatformCount && platform_base_urls[platform][0] != '\0');
+            int has_base_url = romi_mirror_count(platform) > 0;
 
             if (valid_url || has_base_url)
             {
@@ -284,6 +319,7 @@ static int load_tsv_database(const char* path)
                 db[db_count].name = columns[2];
                 db[db_count].url = columns[3];
                 db[db_count].size = romi_strtoll(columns[4]);
+                db[db_count].has_crc32 = columns[5] && parse_hash(columns[5], &db[db_count].crc32);
                 db[db_count].presence = PresenceUnknown;
                 db_item[db_count] = &db[db_count];
                 db_count++;
@@ -303,15 +339,13 @@ static int load_tsv_database(const char* path)
     return 1;
 }
 
-int romi_db_update(const char* update_url, char* error, uint32_t error_size)
+// One attempt at fetching the catalog into db_data. proxy_dropped is set when
+// it failed on a proxy that is bypassed from now on
+static int fetch_update(const char* update_url, char* error, uint32_t error_size, int* proxy_dropped)
 {
-    if (!db_data || !update_url || !update_url[0])
-        return 0;
-
     db_total = 0;
     db_size = 0;
-
-    LOG("downloading database from %s", update_url);
+    *proxy_dropped = 0;
 
     romi_http* http = romi_http_get(update_url, NULL, 0, 0);
     if (!http)
@@ -324,6 +358,7 @@ int romi_db_update(const char* update_url, char* error, uint32_t error_size)
     if (!romi_http_response_length(http, &length))
     {
         romi_snprintf(error, error_size, "%s\n%s", _("failed to download list from"), update_url);
+        *proxy_dropped = romi_http_proxy_dropped(http);
         romi_http_close(http);
         return 0;
     }
@@ -337,15 +372,37 @@ int romi_db_update(const char* update_url, char* error, uint32_t error_size)
 
     db_total = (uint32_t)length;
 
-    if (!romi_http_read(http, &write_update_data, NULL, NULL))
+    if (!romi_http_read(http, &write_update_data, NULL, NULL, NULL))
     {
         romi_snprintf(error, error_size, "%s", _("HTTP download error"));
         db_size = 0;
+        *proxy_dropped = romi_http_proxy_dropped(http);
         romi_http_close(http);
         return 0;
     }
 
     romi_http_close(http);
+    return 1;
+}
+
+int romi_db_update(const char* update_url, char* error, uint32_t error_size)
+{
+    if (!db_data || !update_url || !update_url[0])
+        return 0;
+
+    LOG("downloading database from %s", update_url);
+
+    // there is no retry loop here, so a dead proxy gets one direct attempt
+    int proxy_dropped;
+    if (!fetch_update(update_url, error, error_size, &proxy_dropped))
+    {
+        if (!proxy_dropped)
+            return 0;
+
+        LOG("retrying %s without the proxy", update_url);
+        if (!fetch_update(update_url, error, error_size, &proxy_dropped))
+            return 0;
+    }
 
     char db_path[256];
     romi_snprintf(db_path, sizeof(db_path), "%s/romi_db.tsv", romi_get_config_folder());
@@ -585,12 +642,30 @@ DbItem* romi_db_get(uint32_t index)
     return index < db_item_count ? db_item[index] : NULL;
 }
 
+DbItem* romi_db_find(RomiPlatform platform, const char* url)
+{
+    for (uint32_t i = 0; i < db_count; i++)
+    {
+        if (db[i].platform == platform && strcmp(db[i].url, url) == 0)
+            return &db[i];
+    }
+    return NULL;
+}
+
 const char* romi_db_get_full_url(const DbItem* item, char* buf, size_t size)
+{
+    if (!item)
+        return NULL;
+
+    return romi_db_get_mirror_url(item, romi_mirror_best(item->platform), buf, size);
+}
+
+const char* romi_db_get_mirror_url(const DbItem* item, int mirror, char* buf, size_t size)
 {
     if (!item || !buf || size == 0)
         return NULL;
 
-    const char* base = platform_base_urls[item->platform];
+    const char* base = mirror >= 0 ? romi_mirror_base(item->platform, mirror) : NULL;
     LOG("get_full_url: platform=%d base=[%s]", item->platform, base ? base : "NULL");
     if (!base || !base[0])
     {
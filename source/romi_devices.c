@@ -202,6 +202,24 @@ int romi_devices_check_available(int index)
     return 0;
 }
 
+uint64_t romi_devices_get_free_space(void)
+{
+    const RomiDevice* dev = romi_devices_get_selected();
+    if (!dev) {
+        return romi_get_free_space();
+    }
+
+    u32 block_size;
+    u64 free_blocks;
+    if (sysFsGetFreeSize(dev->path, &block_size, &free_blocks) != 0) {
+        LOG("failed to get free space of %s", dev->path);
+        return dev->free_space;
+    }
+
+    g_devices[g_selected_device].free_space = free_blocks * block_size;
+    return g_devices[g_selected_device].free_space;
+}
+
 const char* romi_devices_get_base_path(void)
 {
     const RomiDevice* dev = romi_devices_get_selected();
@@ -3,8 +3,11 @@
 #include "romi_utils.h"
 #include "romi.h"
 #include "romi_queue.h"
+#include "romi_bandwidth.h"
 #include "romi_devices.h"
 #include "romi_config.h"
+#include "romi_metrics.h"
+#include "romi_thermal.h"
 
 #include <sysutil/msg.h>
 #include <mini18n.h>
@@ -118,6 +121,10 @@ static const char* region_name(RomiRegion r)
 
 void romi_dialog_details(DbItem *item, const char* content_type)
 {
+    // outside the dialog lock, the queue workers wait on it
+    RomiMetrics metrics;
+    int has_metrics = romi_metrics_find(item, &metrics);
+
     romi_dialog_lock();
 
     char size_str[64];
@@ -158,6 +165,20 @@ void romi_dialog_details(DbItem *item, const char* content_type)
         dialog_extra[0] = 0;
     }
 
+    if (has_metrics)
+    {
+        uint32_t len = romi_strlen(dialog_extra);
+        romi_snprintf(dialog_extra + len, sizeof(dialog_extra) - len,
+            "\n\n%s: %s, %.1f MB %s %.1f s\n"
+            "DNS %u ms, %s %u ms, TLS %u ms, %s %u ms\n"
+            "%s %u, %s %.1f s, %s %.1f s, %s",
+            _("Last download"), metrics.success ? _("OK") : _("failed"),
+            metrics.bytes / (1024.0f * 1024.0f), _("in"), metrics.total_msec / 1000.0f,
+            metrics.dns_msec, _("connect"), metrics.connect_msec, metrics.tls_msec, _("first byte"), metrics.ttfb_msec,
+            _("retries"), metrics.retries, _("stalled"), metrics.stall_msec / 1000.0f,
+            _("disk"), metrics.io_msec / 1000.0f, metrics.proxy ? _("via proxy") : metrics.ip);
+    }
+
     db_item = item;
     romi_dialog_unlock();
 }
@@ -247,6 +268,41 @@ void romi_dialog_open_device_selection(void)
     romi_dialog_unlock();
 }
 
+static void format_speed(char* buf, uint32_t size, uint32_t speed)
+{
+    if (speed > 1024 * 1024)
+        romi_snprintf(buf, size, "%.1f MB/s", speed / (1024.0f * 1024.0f));
+    else if (speed > 1024)
+        romi_snprintf(buf, size, "%.1f KB/s", speed / 1024.0f);
+    else
+        romi_snprintf(buf, size, "%u B/s", speed);
+}
+
+static void format_duration(char* buf, uint32_t size, uint32_t seconds)
+{
+    if (seconds < 60)
+        romi_snprintf(buf, size, "%us", seconds);
+    else if (seconds < 3600)
+        romi_snprintf(buf, size, "%um %02us", seconds / 60, seconds % 60);
+    else
+        romi_snprintf(buf, size, "%uh %02um", seconds / 3600, (seconds / 60) % 60);
+}
+
+// A single figure once the estimate has settled, the range while the speed still swings
+static void format_eta(char* buf, uint32_t size, uint32_t eta, uint32_t eta_min, uint32_t eta_max)
+{
+    if (eta_max - eta_min <= eta / 4)
+    {
+        format_duration(buf, size, eta);
+        return;
+    }
+
+    char low[32], high[32];
+    format_duration(low, sizeof(low), eta_min);
+    format_duration(high, sizeof(high), eta_max);
+    romi_snprintf(buf, size, "%s - %s", low, high);
+}
+
 void romi_do_dialog(romi_input* input)
 {
     romi_dialog_lock();
@@ -294,6 +350,29 @@ void romi_do_dialog(romi_input* input)
                 dialog_delta = -1;
             }
 
+            // Triangle button: Cycle priority of pending or running download
+            if (input->pressed & ROMI_BUTTON_T)
+            {
+                DownloadQueueEntry* entry = romi_queue_get_entry(queue_selected_row);
+                if (entry)
+                    romi_queue_bump_priority_locked(entry);
+            }
+
+            // L1/R1: Move the selected entry up or down the queue
+            if (input->pressed & (ROMI_BUTTON_LT | ROMI_BUTTON_RT))
+            {
+                DownloadQueueEntry* entry = romi_queue_get_entry(queue_selected_row);
+                int moved = romi_queue_move_locked(entry, (input->pressed & ROMI_BUTTON_LT) ? -1 : 1);
+                if (moved >= 0)
+                {
+                    queue_selected_row = (uint32_t)moved;
+                    if (queue_selected_row < queue_scroll_offset)
+                        queue_scroll_offset = queue_selected_row;
+                    else if (queue_selected_row >= queue_scroll_offset + ROMI_QUEUE_MAX_VISIBLE_ROWS)
+                        queue_scroll_offset = queue_selected_row - ROMI_QUEUE_MAX_VISIBLE_ROWS + 1;
+                }
+            }
+
             // X button: Retry failed or remove completed
             if (input->pressed & romi_ok_button())
             {
@@ -302,11 +381,11 @@ void romi_do_dialog(romi_input* input)
                 {
                     if (entry->status == DownloadStatusFailed || entry->status == DownloadStatusCancelled)
                     {
-                        romi_queue_retry(entry);
+                        romi_queue_retry_locked(entry);
                     }
                     else if (entry->status == DownloadStatusCompleted)
                     {
-                        romi_queue_remove(entry);
+                        romi_queue_remove_locked(entry);
                         if (queue_selected_row >= romi_queue_get_count() && queue_selected_row > 0)
                             queue_selected_row--;
                         if (romi_queue_get_count() == 0)
@@ -321,13 +400,13 @@ void romi_do_dialog(romi_input* input)
                 DownloadQueueEntry* entry = romi_queue_get_entry(queue_selected_row);
                 if (entry)
                 {
-                    if (entry->status == DownloadStatusDownloading)
+                    if (entry->status == DownloadStatusDownloading || entry->status == DownloadStatusExtracting)
                     {
-                        romi_queue_cancel(entry);
+                        romi_queue_cancel_locked(entry);
                     }
                     else
                     {
-                        romi_queue_remove(entry);
+                        romi_queue_remove_locked(entry);
                         if (queue_selected_row >= romi_queue_get_count() && queue_selected_row > 0)
                             queue_selected_row--;
                         if (romi_queue_get_count() == 0)
@@ -442,6 +521,36 @@ void romi_do_dialog(romi_input* input)
     int w = VITA_WIDTH - 2 * ROMI_DIALOG_HMARGIN;
     int h = VITA_HEIGHT - 2 * ROMI_DIALOG_VMARGIN;
 
+    if (local_type == DialogDownloadQueue)
+    {
+        uint32_t speed, deviation, eta, eta_min, eta_max;
+        uint64_t remaining;
+        romi_queue_get_throughput(&speed, &deviation, &remaining);
+
+        if (romi_throughput_eta_for(speed, deviation, remaining, &eta, &eta_min, &eta_max))
+        {
+            char speed_text[32], eta_text[64];
+            format_speed(speed_text, sizeof(speed_text), speed);
+            format_eta(eta_text, sizeof(eta_text), eta, eta_min, eta_max);
+
+            char title[256];
+            romi_snprintf(title, sizeof(title), "%s (%s, %s %s)", local_title, speed_text, _("ETA"), eta_text);
+            romi_strncpy(local_title, sizeof(local_title), title);
+        }
+
+        RomiThrottle throttle = romi_thermal_level();
+        if (throttle != ThrottleNone)
+        {
+            char title[256];
+            uint32_t limit = romi_queue_get_download_limit();
+            if (throttle == ThrottleMinimal)
+                romi_snprintf(title, sizeof(title), "%s - %s", local_title, _("Throttled: 1 download, extraction paused"));
+            else
+                romi_snprintf(title, sizeof(title), "%s - %s %u %s", local_title, _("Throttled:"), limit, limit == 1 ? _("download") : _("downloads"));
+            romi_strncpy(local_title, sizeof(local_title), title);
+        }
+    }
+
     if (local_title[0])
     {
         uint32_t color;
@@ -534,6 +643,9 @@ void romi_do_dialog(romi_input* input)
     }
     else if (local_type == DialogDownloadQueue)
     {
+        // removing an entry shifts the queue order, read it under the lock
+        romi_dialog_lock();
+
         int y_offset = ROMI_DIALOG_VMARGIN + ROMI_DIALOG_PADDING + font_height * 2;
         uint32_t queue_count = romi_queue_get_count();
         uint32_t visible_rows = min32(queue_count, ROMI_QUEUE_MAX_VISIBLE_ROWS);
@@ -557,26 +669,48 @@ void romi_do_dialog(romi_input* input)
                 romi_draw_fill_rect_z(row_x, row_y, ROMI_DIALOG_TEXT_Z + 10, row_width, ROMI_QUEUE_ROW_HEIGHT - 2, ROMI_COLOR_SELECTED_BACKGROUND);
             }
 
+            // one consistent copy of what the worker last published
+            RomiProgressSnapshot progress;
+            romi_progress_read(&entry->progress, &progress);
+
             // Build status text first to calculate its width
             char status_text[64];
-            if (entry->status == DownloadStatusDownloading && entry->speed > 0)
+            // speed and time left while fetching, stage name once the download is waiting for or in the install stage
+            uint32_t speed = romi_throughput_speed(&entry->transfer.throughput);
+            if (entry->status == DownloadStatusDownloading && speed > 0 && !entry->transfer.install_pending)
             {
-                if (entry->speed > 1024 * 1024)
-                    romi_snprintf(status_text, sizeof(status_text), "%.1f MB/s", entry->speed / (1024.0f * 1024.0f));
-                else if (entry->speed > 1024)
-                    romi_snprintf(status_text, sizeof(status_text), "%.1f KB/s", entry->speed / 1024.0f);
+                char speed_text[32];
+                format_speed(speed_text, sizeof(speed_text), speed);
+
+                uint32_t eta, eta_min, eta_max;
+                if (progress.total > progress.downloaded &&
+                    romi_throughput_eta(&entry->transfer.throughput, progress.total - progress.downloaded, &eta, &eta_min, &eta_max))
+                {
+                    char eta_text[48];
+                    format_eta(eta_text, sizeof(eta_text), eta, eta_min, eta_max);
+                    romi_snprintf(status_text, sizeof(status_text), "%s  %s", speed_text, eta_text);
+                }
                 else
-                    romi_snprintf(status_text, sizeof(status_text), "%u B/s", entry->speed);
+                {
+                    romi_strncpy(status_text, sizeof(status_text), speed_text);
+                }
             }
             else
             {
-                romi_strncpy(status_text, sizeof(status_text), entry->status_text);
+                romi_strncpy(status_text, sizeof(status_text), progress.status_text);
             }
             int status_text_width = romi_text_width(status_text);
 
             // Draw filename - truncate to avoid overlap with status text
             char filename_buf[128];
+            char name_buf[160];
             const char* filename = entry->item ? entry->item->name : "NO ITEM";
+            if (entry->priority != ROMI_PRIORITY_NORMAL &&
+                (entry->status == DownloadStatusPending || entry->status == DownloadStatusDownloading))
+            {
+                romi_snprintf(name_buf, sizeof(name_buf), "[%s] %s", _(romi_priority_name(entry->priority)), filename);
+                filename = name_buf;
+            }
             int filename_max_width = row_width - status_text_width - 20;  // 20px gap between name and status
             romi_truncate_text(filename_buf, sizeof(filename_buf), filename, filename_max_width);
             romi_draw_text_z(row_x + 5, row_y + 3, ROMI_DIALOG_TEXT_Z, ROMI_COLOR_TEXT_DIALOG, filename_buf);
@@ -585,11 +719,11 @@ void romi_do_dialog(romi_input* input)
             romi_draw_text_z(row_x + row_width - status_text_width - 5, row_y + 3, ROMI_DIALOG_TEXT_Z, ROMI_COLOR_TEXT_DIALOG, status_text);
 
             // Draw progress bar for active downloads (below the title text)
-            if ((entry->status == DownloadStatusDownloading || entry->status == DownloadStatusExtracting) && entry->total > 0)
+            if ((entry->status == DownloadStatusDownloading || entry->status == DownloadStatusExtracting) && progress.total > 0)
             {
                 int progress_y = row_y + 22;
                 int progress_width = row_width - 80;
-                float progress_ratio = (float)entry->downloaded / (float)entry->total;
+                float progress_ratio = (float)progress.downloaded / (float)progress.total;
                 if (progress_ratio > 1.0f) progress_ratio = 1.0f;  // Clamp to 100% max
                 int percent = (int)(progress_ratio * 100);
 
@@ -637,13 +771,21 @@ void romi_do_dialog(romi_input* input)
                         cancel_button_str, _("remove"),
                         ROMI_UTF8_SQUARE, _("hide"));
                 }
-                else if (selected->status == DownloadStatusDownloading)
+                else if (selected->status == DownloadStatusExtracting)
                 {
                     // O=cancel, Square=hide
                     romi_snprintf(text, sizeof(text), "%s %s  %s %s",
                         cancel_button_str, _("cancel"),
                         ROMI_UTF8_SQUARE, _("hide"));
                 }
+                else if (selected->status == DownloadStatusDownloading)
+                {
+                    // O=cancel, Triangle=priority, Square=hide
+                    romi_snprintf(text, sizeof(text), "%s %s  %s %s  %s %s",
+                        cancel_button_str, _("cancel"),
+                        ROMI_UTF8_T, _("priority"),
+                        ROMI_UTF8_SQUARE, _("hide"));
+                }
                 else if (selected->status == DownloadStatusCompleted)
                 {
                     // X=remove, Square=hide
@@ -653,9 +795,11 @@ void romi_do_dialog(romi_input* input)
                 }
                 else
                 {
-                    // Default: O=remove, Square=hide
-                    romi_snprintf(text, sizeof(text), "%s %s  %s %s",
+                    // Default: O=remove, Triangle=priority, L1/R1=move, Square=hide
+                    romi_snprintf(text, sizeof(text), "%s %s  %s %s  L1/R1 %s  %s %s",
                         cancel_button_str, _("remove"),
+                        ROMI_UTF8_T, _("priority"),
+                        _("move"),
                         ROMI_UTF8_SQUARE, _("hide"));
                 }
             }
@@ -668,6 +812,8 @@ void romi_do_dialog(romi_input* input)
 
             romi_draw_text_z((VITA_WIDTH - romi_text_width(text)) / 2, ROMI_DIALOG_VMARGIN + h - 2 * font_height, ROMI_DIALOG_TEXT_Z, ROMI_COLOR_TEXT_DIALOG, text);
         }
+
+        romi_dialog_unlock();
     }
     else if (local_type == DialogDeviceSelection)
     {
@@ -2,6 +2,11 @@
 #include "romi_db.h"
 #include "romi_storage.h"
 #include "romi_extract.h"
+#include "romi_zip.h"
+#include "romi_bandwidth.h"
+#include "romi_mirror.h"
+#include "romi_config.h"
+#include "romi_crc32.h"
 #include "romi.h"
 #include "romi_utils.h"
 
@@ -9,31 +14,78 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int cancelled = 0;
-static RomiDownloadProgress current_progress = NULL;
-static uint64_t download_total = 0;
-static uint64_t download_current = 0;
-static uint32_t download_start_time = 0;
-static uint32_t last_progress_update = 0;
+// gaps in the data longer than this count as stall time in the transfer metrics
+#define STALL_ACCOUNT_MSEC 1000
+#define MIRROR_STALL_MSEC 20000
+#define RETRY_BACKOFF_MIN_MSEC  1000
+#define RETRY_BACKOFF_MAX_MSEC  30000
+#define STALL_MIN_SPEED         1024
+
+static uint32_t g_retry_attempts = ROMI_RETRY_ATTEMPTS_DEFAULT;
+static uint32_t g_stall_seconds = ROMI_STALL_TIMEOUT_DEFAULT;
+
+void romi_download_set_retry_policy(uint32_t attempts, uint32_t stall_seconds)
+{
+    g_retry_attempts = attempts;
+    g_stall_seconds = stall_seconds;
+}
+
+void romi_transfer_init(RomiTransfer* transfer, RomiDownloadProgress progress, void* user)
+{
+    memset(transfer, 0, sizeof(*transfer));
+    transfer->progress = progress;
+    transfer->user = user;
+    romi_throughput_reset(&transfer->throughput);
+}
 
 static size_t write_file_callback(void* buffer, size_t size, size_t nmemb, void* stream)
 {
-    void* fp = stream;
+    RomiTransfer* transfer = stream;
     size_t realsize = size * nmemb;
 
-    // Reset timer on first actual data received (handles proxy retry delays)
-    if (download_current == 0 && realsize > 0)
-        download_start_time = romi_time_msec();
+    // with the write-behind ring this is only the time spent waiting for a free block
+    uint64_t io_start = romi_time_usec();
 
-    if (romi_write(fp, buffer, realsize))
+    int written;
+    if (transfer->writer)
+        written = romi_writer_write(transfer->writer, buffer, realsize);
+    else if (transfer->zip)
+        written = romi_zip_stream_write(transfer->zip, buffer, realsize) == ExtractOK;
+    else
+        written = romi_write(transfer->file, buffer, realsize);
+
+    transfer->io_usec += romi_time_usec() - io_start;
+
+    if (written)
     {
-        download_current += realsize;
+        // bytes arrive in file order, resumed attempts included, so the
+        // running crc is complete when the last byte is written
+        if (transfer->verify)
+            transfer->crc = romi_crc32(transfer->crc, buffer, realsize);
+        transfer->current += realsize;
+        // the zip stream counts the inflated bytes it writes itself
+        if (!transfer->zip)
+            romi_space_landed(&transfer->space, SpaceDownload, transfer->current);
+        transfer->last_data_time = romi_time_msec();
+        romi_throughput_add(&transfer->throughput, realsize);
+        romi_bandwidth_throttle(transfer, realsize);
         return realsize;
     }
 
+    transfer->sink_failed = 1;
     return 0;
 }
 
+static int file_sink(void* arg, const uint8_t* data, uint32_t size)
+{
+    return romi_write(arg, data, size);
+}
+
+static int zip_sink(void* arg, const uint8_t* data, uint32_t size)
+{
+    return romi_zip_stream_write(arg, data, size) == ExtractOK;
+}
+
 static int hex_to_int(char c)
 {
     if (c >= '0' && c <= '9') return c - '0';
@@ -65,39 +117,50 @@ static void url_decode(const char* src, char* dst, uint32_t dst_size)
 
 static int progress_callback(void* p, int64_t dltotal, int64_t dlnow, int64_t ultotal, int64_t ulnow)
 {
-    ROMI_UNUSED(p);
+    RomiTransfer* transfer = p;
     ROMI_UNUSED(dltotal);
     ROMI_UNUSED(dlnow);
     ROMI_UNUSED(ultotal);
     ROMI_UNUSED(ulnow);
 
-    if (cancelled)
+    if (transfer->cancelled)
         return 1;
 
-    if (current_progress && download_total > 0)
+    // curl calls this about once a second even while no data arrives, which keeps the speed decaying during a stall
+    romi_throughput_tick(&transfer->throughput);
+
+    uint32_t now = romi_time_msec();
+    if (now - transfer->last_data_time >= STALL_ACCOUNT_MSEC)
+        transfer->metrics.stall_msec += now - transfer->last_tick;
+    transfer->last_tick = now;
+
+    if (transfer->failover && now - transfer->last_data_time > MIRROR_STALL_MSEC)
     {
-        uint32_t now = romi_time_msec();
+        LOG("no data for %u ms, switching mirror", MIRROR_STALL_MSEC);
+        transfer->stalled = 1;
+        return 1;
+    }
 
-        if (now - last_progress_update < 250)
+    if (transfer->progress && transfer->total > 0)
+    {
+        if (now - transfer->last_progress_update < 250)
             return 0;
 
-        last_progress_update = now;
-        uint32_t elapsed = now - download_start_time;
+        transfer->last_progress_update = now;
 
-        uint64_t current = download_current;
+        uint64_t current = transfer->current;
+        uint32_t speed = romi_throughput_speed(&transfer->throughput);
 
         char status[64];
-        if (elapsed > 0 && current > 0)
+        if (speed > 0)
         {
-            uint32_t speed = (uint32_t)((current * 1000) / elapsed);
-
             // Periodic diagnostic logging (every 10 seconds)
-            static uint32_t last_diagnostic = 0;
-            if (now - last_diagnostic >= 10000)
+            if (now - transfer->last_diagnostic >= 10000)
             {
-                LOG("Speed check: downloaded %llu bytes in %u ms = %u KB/s",
-                    current, elapsed, speed / 1024);
-                last_diagnostic = now;
+                LOG("Speed check: downloaded %llu bytes, average %u KB/s, last %u ms %u KB/s",
+                    current, speed / 1024, ROMI_THROUGHPUT_INSTANT * ROMI_THROUGHPUT_BUCKET_MSEC,
+                    romi_throughput_instant(&transfer->throughput) / 1024);
+                transfer->last_diagnostic = now;
             }
 
             if (speed > 1024 * 1024)
@@ -112,35 +175,362 @@ static int progress_callback(void* p, int64_t dltotal, int64_t dlnow, int64_t ul
             romi_snprintf(status, sizeof(status), "Downloading...");
         }
 
-        current_progress(status, current, download_total);
+        transfer->progress(transfer, status, current, transfer->total);
     }
 
     return 0;
 }
 
+static void extract_progress(void* arg, const char* filename, uint64_t extracted, uint64_t total)
+{
+    RomiTransfer* transfer = arg;
+    ROMI_UNUSED(filename);
+
+    romi_space_landed(&transfer->space, SpaceInstall, extracted);
+
+    if (transfer->progress)
+        transfer->progress(transfer, "Extracting...", extracted, total);
+}
+
 static const char* get_filename_from_url(const char* url)
 {
     const char* slash = romi_strrchr(url, '/');
     return slash ? (slash + 1) : url;
 }
 
-int romi_download_rom(const DbItem* item, RomiDownloadProgress progress)
+// Reserves what the rest of the file needs: the temp file plus the extracted
+// copy of an archive kept in temp, guessed at twice the archive until the
+// install stage reads its directory. A streamed archive reserves every entry
+// from its local header instead, it only needs the length as a fallback
+static int reserve_space(RomiTransfer* transfer, uint64_t offset, uint64_t length)
 {
-    if (!item || !item->url)
+    if (transfer->zip)
+    {
+        romi_zip_stream_set_length(transfer->zip, offset + length);
+        return 1;
+    }
+
+    if (!romi_space_reserve(&transfer->space, SpaceDownload, transfer->temp_path, offset, length))
+        return 0;
+
+    if (!transfer->install_extract)
+        return 1;
+
+    // the archive is extracted from the start however much of it was resumed
+    return romi_space_reserve(&transfer->space, SpaceInstall, transfer->install_path, 0, 2 * (offset + length));
+}
+
+// Runs a single GET from offset on, feeding the body to the temp file or the zip stream set on the transfer
+static int fetch_url(RomiTransfer* transfer, const char* url, uint64_t offset, uint64_t size_hint)
+{
+    transfer->current = offset;
+    transfer->total = 0;
+    transfer->last_progress_update = 0;
+    transfer->stalled = 0;
+    transfer->sink_failed = 0;
+
+    if (transfer->progress)
+        transfer->progress(transfer, "Connecting...", offset, 0);
+
+    romi_http* http = romi_http_get(url, NULL, offset, 1);
+    if (!http)
+    {
+        LOG("failed to connect to %s", url);
+        return 0;
+    }
+    romi_http_set_stall_timeout(http, STALL_MIN_SPEED, g_stall_seconds);
+
+    // Small items go straight to the GET; free space was checked when they were queued
+    int64_t content_length = 0;
+    int skip_head = (offset == 0 && size_hint > 0 && size_hint < ROMI_DOWNLOAD_SMALL_ITEM);
+    if (skip_head)
+    {
+        LOG("skipping HEAD for small item (%llu bytes)", size_hint);
+    }
+    else if (!romi_http_response_length(http, &content_length))
+    {
+        LOG("failed to get content length");
+        romi_http_close(http);
+        return 0;
+    }
+
+    transfer->total = skip_head ? size_hint : content_length > 0 ? offset + (uint64_t)content_length : 0;
+
+    // every attempt replaces the reservation with what is left from its offset
+    uint64_t length = skip_head ? size_hint : content_length > 0 ? (uint64_t)content_length : 0;
+    if (length > 0 && !reserve_space(transfer, offset, length))
+    {
+        LOG("not enough disk space for %llu bytes", length);
+        transfer->sink_failed = 1;
+        transfer->no_space = 1;
+        romi_http_close(http);
         return 0;
+    }
+
+    // If the ring can't be allocated the callback writes synchronously as before
+    if (transfer->zip)
+        transfer->writer = romi_writer_open(zip_sink, transfer->zip);
+    else
+        transfer->writer = romi_writer_open(file_sink, transfer->file);
+
+    transfer->last_data_time = romi_time_msec();
+    transfer->last_tick = transfer->last_data_time;
+    romi_bandwidth_register(transfer);
+    int success = romi_http_read(http, &write_file_callback, transfer, &progress_callback, transfer);
+    romi_bandwidth_unregister(transfer);
+
+    transfer->range_ignored = offset > 0 && romi_http_range_ignored(http);
+
+    romi_http_metrics http_metrics;
+    romi_http_get_metrics(http, &http_metrics);
+    romi_metrics_add(&transfer->metrics, &http_metrics);
+
+    if (transfer->writer)
+    {
+        if (!romi_writer_close(transfer->writer, NULL))
+        {
+            transfer->sink_failed = 1;
+            success = 0;
+        }
+        transfer->writer = NULL;
+    }
+
+    romi_http_close(http);
+
+    return success && !transfer->cancelled;
+}
+
+// Sleeps for the backoff in short slices so a cancel isn't held up; returns 0 if cancelled
+static int retry_wait(RomiTransfer* transfer, uint32_t msec)
+{
+    if (transfer->progress)
+    {
+        char status[64];
+        romi_snprintf(status, sizeof(status), "Retrying in %u s...", (msec + 999) / 1000);
+        transfer->progress(transfer, status, transfer->current, transfer->total);
+    }
+
+    while (msec > 0 && !transfer->cancelled)
+    {
+        uint32_t slice = min32(msec, 100);
+        romi_sleep(slice);
+        msec -= slice;
+    }
+
+    return !transfer->cancelled;
+}
 
-    cancelled = 0;
-    current_progress = progress;
-    download_current = 0;
-    download_total = 0;
-    last_progress_update = 0;
+// Throws away what a mirror that ignores Range requests can't continue: the
+// temp file or the files streamed so far, their crc and their reservation.
+// The new file is opened before the old one is let go, so a failure leaves
+// the transfer as it was for the caller to clean up.
+static int restart_transfer(RomiTransfer* transfer)
+{
+    if (transfer->zip)
+    {
+        RomiZipStream* zip = romi_zip_stream_open(transfer->install_path, &transfer->cancelled, &transfer->space);
+        if (!zip)
+            return 0;
+        romi_zip_stream_close(transfer->zip);
+        transfer->zip = zip;
+    }
+    else
+    {
+        void* file = romi_create(transfer->temp_path);
+        if (!file)
+            return 0;
+        romi_close(transfer->file);
+        transfer->file = file;
+    }
+
+    romi_space_release(&transfer->space);
+    transfer->crc = 0;
+    transfer->current = 0;
+    return 1;
+}
+
+// Tries the item's mirrors best first. A mirror that fails or stalls hands
+// over to the next one, which resumes with a Range request at the byte the
+// previous attempt reached, or starts over if that mirror ignores the Range
+// header. Attempts that make no progress back off
+// exponentially with jitter until g_retry_attempts of them fail in a row.
+// When the catalog has a crc for the file, a completed download that doesn't
+// match it fails with transfer->corrupt set.
+static int fetch_with_retries(RomiTransfer* transfer, const DbItem* item)
+{
+    // absolute URLs in the database bypass sources.txt
+    uint32_t order[ROMI_MAX_MIRRORS];
+    uint32_t mirrors = romi_validate_url(item->url) ? 0 : romi_mirror_rank(item->platform, item->url, order);
+    uint64_t offset = transfer->resume_offset;
+    uint32_t failures = 0;
+    uint32_t backoff = RETRY_BACKOFF_MIN_MSEC;
+
+    transfer->verify = item->has_crc32;
+    // a resumed temp file was already folded into the crc by open_resumed
+    if (offset == 0)
+        transfer->crc = 0;
+    transfer->corrupt = 0;
+    romi_throughput_reset(&transfer->throughput);
+
+    for (uint32_t attempt = 0; ; attempt++)
+    {
+        int mirror = mirrors ? (int)order[attempt % mirrors] : -1;
+
+        char url[1024];
+        if (!romi_db_get_mirror_url(item, mirror, url, sizeof(url)))
+            return 0;
+
+        transfer->failover = (mirrors > 1);
+        transfer->metrics.retries = attempt;
+
+        uint32_t start = romi_time_msec();
+        int success = fetch_url(transfer, url, offset, item->size);
+
+        // a cancel or a local disk error says nothing about the mirror
+        if (mirror >= 0 && (success || !(transfer->cancelled || transfer->sink_failed)))
+            romi_mirror_report(item->platform, mirror, transfer->current - offset, romi_time_msec() - start, success);
+
+        if (success)
+        {
+            if (transfer->verify && transfer->crc != item->crc32)
+            {
+                LOG("%s failed verification: catalog crc %08x, downloaded %08x", item->name, item->crc32, transfer->crc);
+                transfer->corrupt = 1;
+                return 0;
+            }
+            return 1;
+        }
+        if (transfer->cancelled || transfer->sink_failed)
+            return 0;
+
+        // counts as a failed attempt, so a mirror that also keeps dropping the connection can't loop forever
+        if (transfer->range_ignored)
+        {
+            LOG("%s ignores Range requests, downloading %s from the start", url, item->name);
+            if (!restart_transfer(transfer))
+                return 0;
+        }
+
+        if (transfer->current > offset)
+        {
+            failures = 0;
+            backoff = RETRY_BACKOFF_MIN_MSEC;
+        }
+        else if (++failures >= g_retry_attempts)
+        {
+            LOG("giving up on %s after %u failed attempts", item->name, failures);
+            return 0;
+        }
+
+        offset = transfer->current;
+
+        // equal jitter: half fixed, half random, so parallel workers don't retry in lockstep
+        uint32_t wait = backoff / 2 + romi_time_msec() % (backoff / 2 + 1);
+        backoff = min32(backoff * 2, RETRY_BACKOFF_MAX_MSEC);
+
+        LOG("%s failed at %llu bytes%s, retrying in %u ms", url, offset, transfer->stalled ? " (stalled)" : "", wait);
+
+        if (!retry_wait(transfer, wait))
+            return 0;
+    }
+}
+
+static int fetch_item(RomiTransfer* transfer, const DbItem* item)
+{
+    memset(&transfer->metrics, 0, sizeof(transfer->metrics));
+    transfer->io_usec = 0;
+
+    int success = fetch_with_retries(transfer, item);
+    transfer->metrics.io_msec = (uint32_t)(transfer->io_usec / 1000);
+
+    if (!transfer->cancelled)
+    {
+        RomiMetrics* m = &transfer->metrics;
+        romi_metrics_record(item, m, success);
+        LOG("transfer %s: %llu bytes in %u ms, dns %u connect %u tls %u ttfb %u ms, %u retries, stalled %u ms, io %u ms",
+            success ? "ok" : "failed", m->bytes, m->total_msec, m->dns_msec, m->connect_msec,
+            m->tls_msec, m->ttfb_msec, m->retries, m->stall_msec, m->io_msec);
+    }
+
+    return success;
+}
+
+// Keeps the first resume_offset bytes of a temp file left by an earlier
+// session, reading them back for the crc when the catalog has one.
+// Returns the file opened for appending, NULL to start over
+static void* open_resumed(RomiTransfer* transfer, const DbItem* item)
+{
+    if (romi_get_size(transfer->temp_path) < (int64_t)transfer->resume_offset)
+        return NULL;
+
+    // the journal lags behind the file, what was written after its last record goes
+    if (!romi_truncate(transfer->temp_path, transfer->resume_offset))
+        return NULL;
+
+    if (item->has_crc32)
+    {
+        void* f = romi_open(transfer->temp_path);
+        uint8_t* buffer = malloc(ROMI_WRITER_BLOCK_SIZE);
+        uint64_t remaining = transfer->resume_offset;
+        uint32_t crc = 0;
+
+        while (f && buffer && remaining > 0)
+        {
+            int read = romi_read(f, buffer, (uint32_t)min64(remaining, ROMI_WRITER_BLOCK_SIZE));
+            if (read <= 0)
+                break;
+            crc = romi_crc32(crc, buffer, read);
+            remaining -= read;
+        }
+
+        free(buffer);
+        if (f)
+            romi_close(f);
+        if (remaining > 0)
+            return NULL;
+
+        transfer->crc = crc;
+    }
+
+    LOG("resuming %s at %llu bytes", transfer->temp_path, transfer->resume_offset);
+    return romi_append(transfer->temp_path);
+}
+
+// Inflates the archive straight into dest_folder as it arrives, so it never
+// touches the temp folder and only needs room for the extracted files.
+static RomiExtractResult download_extracting(RomiTransfer* transfer, const DbItem* item, const char* dest_folder)
+{
+    romi_mkdirs(dest_folder);
+
+    transfer->zip = romi_zip_stream_open(dest_folder, &transfer->cancelled, &transfer->space);
+    if (!transfer->zip)
+        return ExtractErrorMemory;
+
+    int success = fetch_item(transfer, item);
+
+    RomiExtractResult result = romi_zip_stream_close(transfer->zip);
+    transfer->zip = NULL;
+
+    if (transfer->cancelled)
+        return ExtractCancelled;
+    if (result == ExtractOK && !success)
+        result = transfer->corrupt ? ExtractErrorChecksum : ExtractErrorRead;
+
+    return result;
+}
+
+static int download_fetch(const DbItem* item, RomiTransfer* transfer)
+{
+    transfer->install_pending = 0;
+    transfer->no_space = 0;
 
     char url_buf[1024];
     const char* full_url = romi_db_get_full_url(item, url_buf, sizeof(url_buf));
     if (!full_url)
         return 0;
 
-    const char* platform_folder = romi_platform_folder(item->platform);
+    char platform_folder[512];
+    romi_platform_folder(item->platform, platform_folder, sizeof(platform_folder));
     const char* temp_folder = romi_get_temp_folder();
     const char* raw_filename = get_filename_from_url(full_url);
 
@@ -157,105 +547,188 @@ int romi_download_rom(const DbItem* item, RomiDownloadProgress progress)
     else
         romi_snprintf(dest_folder, sizeof(dest_folder), "%s", platform_folder);
 
-    char temp_path[512];
-    romi_snprintf(temp_path, sizeof(temp_path), "%s/%s", temp_folder, filename);
+    int extract = romi_is_zip_file(filename) && item->platform != PlatformMAME;
 
-    LOG("downloading %s to %s", full_url, temp_path);
+    romi_snprintf(transfer->temp_path, sizeof(transfer->temp_path), "%s/%s", temp_folder, filename);
 
-    if (progress)
-        progress("Connecting...", 0, 0);
+    // known up front so the space reservation can tell which devices the file lands on
+    transfer->install_extract = extract;
+    if (extract)
+        romi_strncpy(transfer->install_path, sizeof(transfer->install_path), dest_folder);
+    else
+        romi_snprintf(transfer->install_path, sizeof(transfer->install_path), "%s/%s", dest_folder, filename);
 
-    romi_http* http = romi_http_get(full_url, NULL, 0, 1);
-    if (!http)
-    {
-        LOG("failed to connect to %s", full_url);
-        return 0;
-    }
+    // an archive already partly in the temp folder carries on there instead of streaming from scratch
+    if (transfer->resume_offset && romi_get_size(transfer->temp_path) < (int64_t)transfer->resume_offset)
+        transfer->resume_offset = 0;
 
-    int64_t content_length;
-    if (!romi_http_response_length(http, &content_length))
+    if (extract && !transfer->resume_offset)
     {
-        LOG("failed to get content length");
-        romi_http_close(http);
-        return 0;
-    }
+        LOG("downloading and extracting %s to %s", full_url, dest_folder);
 
-    download_total = content_length > 0 ? (uint64_t)content_length : 0;
+        RomiExtractResult extract_result = download_extracting(transfer, item, dest_folder);
+        for (int retry = 0; extract_result == ExtractErrorChecksum && retry < ROMI_DOWNLOAD_VERIFY_RETRIES; retry++)
+        {
+            LOG("%s is corrupt, downloading it again", filename);
+            if (transfer->progress)
+                transfer->progress(transfer, "Checksum mismatch, retrying...", 0, 0);
+            extract_result = download_extracting(transfer, item, dest_folder);
+        }
 
-    if (content_length > 0 && !romi_check_free_space(content_length * 2))
-    {
-        LOG("not enough disk space for %lld bytes", content_length);
-        romi_http_close(http);
-        return 0;
+        if (extract_result == ExtractOK)
+        {
+            if (transfer->progress)
+                transfer->progress(transfer, "Complete!", transfer->total, transfer->total);
+            return 1;
+        }
+
+        if (extract_result != ExtractErrorStream)
+        {
+            LOG("extraction failed: %s", romi_extract_error_string(extract_result));
+            transfer->corrupt = (extract_result == ExtractErrorChecksum);
+            transfer->no_space = (extract_result == ExtractErrorSpace);
+            return 0;
+        }
+
+        LOG("%s needs seeking to extract, downloading to temp folder instead", filename);
     }
 
+    LOG("downloading %s to %s", full_url, transfer->temp_path);
+
     romi_mkdirs(temp_folder);
-    void* fp = romi_create(temp_path);
-    if (!fp)
+
+    int success;
+    for (int retry = 0; ; retry++)
     {
-        LOG("failed to create temp file %s", temp_path);
-        romi_http_close(http);
-        return 0;
-    }
+        transfer->file = transfer->resume_offset ? open_resumed(transfer, item) : NULL;
+        if (!transfer->file)
+        {
+            transfer->resume_offset = 0;
+            transfer->file = romi_create(transfer->temp_path);
+        }
+        if (!transfer->file)
+        {
+            LOG("failed to create temp file %s", transfer->temp_path);
+            return 0;
+        }
 
-    download_start_time = romi_time_msec();
-    int success = romi_http_read(http, &write_file_callback, fp, &progress_callback);
+        success = fetch_item(transfer, item);
 
-    romi_close(fp);
-    romi_http_close(http);
+        romi_close(transfer->file);
+        transfer->file = NULL;
+
+        if (success || !transfer->corrupt || retry == ROMI_DOWNLOAD_VERIFY_RETRIES)
+            break;
 
-    if (!success || cancelled)
+        // the catalog only has a crc of the whole file, there is no telling which range went bad
+        LOG("%s is corrupt, downloading it again", filename);
+        transfer->resume_offset = 0;
+        if (transfer->progress)
+            transfer->progress(transfer, "Checksum mismatch, retrying...", 0, 0);
+    }
+
+    if (!success)
     {
         LOG("download failed or cancelled");
-        romi_rm(temp_path);
+        if (!(transfer->cancelled && transfer->keep_partial))
+            romi_rm(transfer->temp_path);
         return 0;
     }
 
-    LOG("download complete: %s (%lld bytes)", temp_path, romi_get_size(temp_path));
+    LOG("download complete: %s (%lld bytes)", transfer->temp_path, romi_get_size(transfer->temp_path));
 
     romi_mkdirs(dest_folder);
 
+    transfer->install_pending = 1;
+    return 1;
+}
+
+int romi_download_fetch(const DbItem* item, RomiTransfer* transfer)
+{
+    if (!item || !item->url || !transfer)
+        return 0;
+
+    int success = download_fetch(item, transfer);
+
+    // a temp file waiting for the install stage keeps its space until then
+    if (!transfer->install_pending)
+        romi_space_release(&transfer->space);
+
+    return success;
+}
+
+int romi_download_install(RomiTransfer* transfer)
+{
+    if (!transfer->install_pending)
+        return 1;
+
+    transfer->install_pending = 0;
+
+    if (transfer->cancelled)
+    {
+        if (!transfer->keep_partial)
+            romi_rm(transfer->temp_path);
+        romi_space_release(&transfer->space);
+        return 0;
+    }
+
     int result = 1;
 
-    if (romi_is_zip_file(temp_path) && item->platform != PlatformMAME)
+    if (transfer->install_extract)
     {
-        if (progress)
-            progress("Extracting...", 0, 0);
+        if (transfer->progress)
+            transfer->progress(transfer, "Extracting...", 0, 0);
 
-        RomiExtractResult extract_result = romi_extract_zip(temp_path, dest_folder, NULL);
+        RomiZipDirectory dir;
+        RomiExtractResult extract_result = romi_zip_read_directory(transfer->temp_path, &dir);
+        if (extract_result == ExtractOK)
+        {
+            // the directory has the inflated size, in place of the guess made while downloading
+            if (romi_space_reserve(&transfer->space, SpaceInstall, transfer->install_path, 0, dir.total))
+                extract_result = romi_zip_extract_directory(transfer->temp_path, &dir, transfer->install_path, extract_progress, transfer, &transfer->cancelled);
+            else
+                extract_result = ExtractErrorSpace;
+            romi_zip_free_directory(&dir);
+        }
 
         if (extract_result != ExtractOK)
         {
             LOG("extraction failed: %s", romi_extract_error_string(extract_result));
+            transfer->corrupt = (extract_result == ExtractErrorChecksum);
+            transfer->no_space = (extract_result == ExtractErrorSpace);
             result = 0;
         }
 
-        romi_rm(temp_path);
+        // stopped for shutdown, the archive is extracted again next session
+        if (!(transfer->cancelled && transfer->keep_partial))
+            romi_rm(transfer->temp_path);
     }
     else
     {
-        char dest_path[512];
-        romi_snprintf(dest_path, sizeof(dest_path), "%s/%s", dest_folder, filename);
-
-        LOG("moving %s -> %s", temp_path, dest_path);
+        LOG("moving %s -> %s", transfer->temp_path, transfer->install_path);
 
-        if (rename(temp_path, dest_path) != 0)
+        if (rename(transfer->temp_path, transfer->install_path) != 0)
         {
             LOG("failed to move file to destination");
-            romi_rm(temp_path);
+            romi_rm(transfer->temp_path);
             result = 0;
         }
     }
 
-    if (progress && result)
-        progress("Complete!", download_total, download_total);
+    romi_space_release(&transfer->space);
+
+    if (transfer->progress && result)
+        transfer->progress(transfer, "Complete!", transfer->total, transfer->total);
 
-    current_progress = NULL;
     return result;
 }
 
-void romi_download_cancel(void)
+int romi_download_rom(const DbItem* item, RomiTransfer* transfer)
+{
+    return romi_download_fetch(item, transfer) && romi_download_install(transfer);
+}
+
+void romi_download_cancel(RomiTransfer* transfer)
 {
-    cancelled = 1;
-    romi_extract_cancel();
+    transfer->cancelled = 1;
 }
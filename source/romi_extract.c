@@ -1,6 +1,10 @@
 #include "romi_extract.h"
 #include "romi.h"
 #include "romi_utils.h"
+#include "romi_crc32.h"
+#include "romi_zip.h"
+#include "romi_space.h"
+#include "romi_thermal.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -9,11 +13,17 @@
 #define ZIP_LOCAL_HEADER_SIG    0x04034b50
 #define ZIP_CENTRAL_DIR_SIG     0x02014b50
 #define ZIP_END_CENTRAL_DIR_SIG 0x06054b50
+#define ZIP_DATA_DESCRIPTOR_SIG 0x08074b50
+
+#define ZIP_FLAG_ENCRYPTED      0x0001
+#define ZIP_FLAG_DATA_DESCRIPTOR 0x0008
 
 #define ZIP_METHOD_STORED   0
 #define ZIP_METHOD_DEFLATE  8
 
 #define EXTRACT_BUFFER_SIZE (256 * 1024)
+// the zip64 field comes first in practice, records past this are not looked at
+#define STREAM_EXTRA_SIZE   512
 
 typedef struct {
     uint32_t signature;
@@ -29,8 +39,6 @@ typedef struct {
     uint16_t extra_len;
 } __attribute__((packed)) ZipLocalHeader;
 
-static int cancelled = 0;
-
 static int create_parent_dirs(const char* filepath)
 {
     char path[256];
@@ -48,233 +56,773 @@ static int create_parent_dirs(const char* filepath)
     return 1;
 }
 
-static RomiExtractResult extract_stored(void* zf, void* outf, uint32_t size, uint8_t* buffer)
+// one per PPU hardware thread, each with its own file handle, buffers and inflate
+// state; a single one while the thermal throttle is up
+#define EXTRACT_WORKERS     2
+
+typedef struct {
+    const char* zip_path;
+    const char* dest_folder;
+    const RomiZipEntry** files;     // largest first, so the big ones don't end up last on one worker
+    uint32_t count;
+    volatile uint32_t next;
+    romi_sema finished;             // posted by every spawned worker on its way out
+
+    RomiExtractProgress progress;
+    void* progress_arg;
+    volatile int* cancelled;
+
+    // first error stops every worker
+    volatile int failed;
+    RomiExtractResult result;
+
+    romi_mutex lock;
+    uint64_t extracted;
+    uint64_t total;
+} ZipJob;
+
+typedef struct {
+    void* zf;
+    uint8_t* in_buffer;
+    uint8_t* out_buffer;
+    z_stream strm;
+    int strm_active;
+} ZipWorker;
+
+static int job_stopped(ZipJob* job)
+{
+    return *job->cancelled || job->failed;
+}
+
+static void job_fail(ZipJob* job, RomiExtractResult result)
+{
+    romi_mutex_lock(&job->lock);
+    if (job->result == ExtractOK)
+        job->result = result;
+    job->failed = 1;
+    romi_mutex_unlock(&job->lock);
+}
+
+static void job_advance(ZipJob* job, const char* filename, uint32_t bytes)
+{
+    romi_mutex_lock(&job->lock);
+    job->extracted += bytes;
+    if (job->progress)
+        job->progress(job->progress_arg, filename, job->extracted, job->total);
+    romi_mutex_unlock(&job->lock);
+}
+
+static RomiExtractResult extract_stored(ZipJob* job, ZipWorker* worker, const RomiZipEntry* entry, void* outf, uint32_t* crc)
 {
-    uint32_t remaining = size;
+    uint64_t remaining = entry->comp_size;
 
     while (remaining > 0)
     {
-        if (cancelled) return ExtractCancelled;
+        if (job_stopped(job)) return ExtractCancelled;
 
-        uint32_t chunk = remaining > EXTRACT_BUFFER_SIZE ? EXTRACT_BUFFER_SIZE : remaining;
+        uint32_t chunk = (uint32_t)min64(remaining, EXTRACT_BUFFER_SIZE);
 
-        if (!romi_read(zf, buffer, chunk))
+        if (romi_read(worker->zf, worker->in_buffer, chunk) != (int)chunk)
             return ExtractErrorRead;
 
-        if (!romi_write(outf, buffer, chunk))
+        if (!romi_write(outf, worker->in_buffer, chunk))
             return ExtractErrorWrite;
 
+        *crc = romi_crc32(*crc, worker->in_buffer, chunk);
         remaining -= chunk;
+        job_advance(job, entry->name, chunk);
     }
 
     return ExtractOK;
 }
 
-static RomiExtractResult extract_deflate(void* zf, void* outf, uint32_t comp_size, uint32_t uncomp_size, uint8_t* in_buf, uint8_t* out_buf)
+static RomiExtractResult extract_deflate(ZipJob* job, ZipWorker* worker, const RomiZipEntry* entry, void* outf, uint32_t* crc)
 {
-    z_stream strm;
-    memset(&strm, 0, sizeof(strm));
-
-    if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+    z_stream* strm = &worker->strm;
+    if (inflateReset(strm) != Z_OK)
         return ExtractErrorDecompress;
 
-    uint32_t remaining_in = comp_size;
-    RomiExtractResult result = ExtractOK;
+    uint64_t remaining_in = entry->comp_size;
 
-    while (remaining_in > 0 || strm.avail_in > 0)
+    for (;;)
     {
-        if (cancelled)
-        {
-            result = ExtractCancelled;
-            break;
-        }
+        if (job_stopped(job)) return ExtractCancelled;
 
-        if (strm.avail_in == 0 && remaining_in > 0)
+        if (strm->avail_in == 0)
         {
-            uint32_t chunk = remaining_in > EXTRACT_BUFFER_SIZE ? EXTRACT_BUFFER_SIZE : remaining_in;
+            // compressed data ran out before the deflate stream ended
+            if (remaining_in == 0)
+                return ExtractErrorDecompress;
 
-            if (!romi_read(zf, in_buf, chunk))
-            {
-                result = ExtractErrorRead;
-                break;
-            }
+            uint32_t chunk = (uint32_t)min64(remaining_in, EXTRACT_BUFFER_SIZE);
+            if (romi_read(worker->zf, worker->in_buffer, chunk) != (int)chunk)
+                return ExtractErrorRead;
 
-            strm.avail_in = chunk;
-            strm.next_in = in_buf;
+            strm->avail_in = chunk;
+            strm->next_in = worker->in_buffer;
             remaining_in -= chunk;
         }
 
-        strm.avail_out = EXTRACT_BUFFER_SIZE;
-        strm.next_out = out_buf;
+        strm->avail_out = EXTRACT_BUFFER_SIZE;
+        strm->next_out = worker->out_buffer;
 
-        int ret = inflate(&strm, Z_NO_FLUSH);
+        int ret = inflate(strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_NEED_DICT)
+            return ExtractErrorDecompress;
 
-        if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+        uint32_t have = EXTRACT_BUFFER_SIZE - strm->avail_out;
+        if (have > 0)
         {
-            result = ExtractErrorDecompress;
-            break;
+            if (!romi_write(outf, worker->out_buffer, have))
+                return ExtractErrorWrite;
+            *crc = romi_crc32(*crc, worker->out_buffer, have);
+            job_advance(job, entry->name, have);
         }
 
-        uint32_t have = EXTRACT_BUFFER_SIZE - strm.avail_out;
-        if (have > 0)
+        if (ret == Z_STREAM_END)
+            return ExtractOK;
+    }
+}
+
+static RomiExtractResult extract_entry(ZipJob* job, ZipWorker* worker, const RomiZipEntry* entry)
+{
+    RomiExtractResult result = romi_zip_seek_data(worker->zf, entry);
+    if (result != ExtractOK)
+        return result;
+
+    char dest_path[512];
+    romi_snprintf(dest_path, sizeof(dest_path), "%s/%s", job->dest_folder, entry->name);
+    create_parent_dirs(dest_path);
+
+    void* outf = romi_create(dest_path);
+    if (!outf)
+        return ExtractErrorWrite;
+
+    uint32_t crc = 0;
+    if (entry->method == ZIP_METHOD_STORED)
+        result = extract_stored(job, worker, entry, outf, &crc);
+    else
+        result = extract_deflate(job, worker, entry, outf, &crc);
+
+    romi_close(outf);
+
+    // sizes and crc come from the central directory, data descriptors need no special case
+    if (result == ExtractOK && crc != entry->crc32)
+    {
+        LOG("crc mismatch for %s: expected %08x, got %08x", entry->name, entry->crc32, crc);
+        result = ExtractErrorChecksum;
+    }
+
+    // a partial file would pass for an installed ROM
+    if (result != ExtractOK)
+        romi_rm(dest_path);
+
+    return result;
+}
+
+static void extract_worker(ZipJob* job)
+{
+    ZipWorker worker;
+    memset(&worker, 0, sizeof(worker));
+
+    worker.zf = romi_open(job->zip_path);
+    worker.in_buffer = malloc(EXTRACT_BUFFER_SIZE);
+    worker.out_buffer = malloc(EXTRACT_BUFFER_SIZE);
+    worker.strm_active = inflateInit2(&worker.strm, -MAX_WBITS) == Z_OK;
+
+    if (!worker.zf)
+    {
+        job_fail(job, ExtractErrorOpen);
+    }
+    else if (!worker.in_buffer || !worker.out_buffer || !worker.strm_active)
+    {
+        job_fail(job, ExtractErrorMemory);
+    }
+    else
+    {
+        while (!job_stopped(job))
         {
-            if (!romi_write(outf, out_buf, have))
+            uint32_t index = __sync_fetch_and_add(&job->next, 1);
+            if (index >= job->count)
+                break;
+
+            RomiExtractResult result = extract_entry(job, &worker, job->files[index]);
+            if (result != ExtractOK)
             {
-                result = ExtractErrorWrite;
+                job_fail(job, result);
                 break;
             }
         }
+    }
 
-        if (ret == Z_STREAM_END)
-            break;
+    if (worker.strm_active) inflateEnd(&worker.strm);
+    free(worker.in_buffer);
+    free(worker.out_buffer);
+    if (worker.zf) romi_close(worker.zf);
+}
+
+static void extract_thread(void* arg)
+{
+    ZipJob* job = arg;
+    extract_worker(job);
+    romi_sema_post(&job->finished);
+    romi_thread_exit();
+}
+
+static int compare_entry_size(const void* a, const void* b)
+{
+    const RomiZipEntry* ea = *(const RomiZipEntry* const*)a;
+    const RomiZipEntry* eb = *(const RomiZipEntry* const*)b;
+    if (ea->uncomp_size != eb->uncomp_size)
+        return ea->uncomp_size > eb->uncomp_size ? -1 : 1;
+    return 0;
+}
+
+// Directories are created up front; files are spread over the workers
+static RomiExtractResult plan_entries(const RomiZipDirectory* dir, const char* dest_folder, ZipJob* job)
+{
+    for (uint32_t i = 0; i < dir->count; i++)
+    {
+        const RomiZipEntry* entry = &dir->entries[i];
+        size_t len = strlen(entry->name);
+
+        if (len > 0 && entry->name[len - 1] == '/')
+        {
+            char dest_path[512];
+            romi_snprintf(dest_path, sizeof(dest_path), "%s/%s", dest_folder, entry->name);
+            romi_mkdirs(dest_path);
+            continue;
+        }
+
+        if (entry->flags & ZIP_FLAG_ENCRYPTED)
+        {
+            LOG("encrypted zip entries are not supported");
+            return ExtractErrorFormat;
+        }
+
+        if (entry->method != ZIP_METHOD_STORED && entry->method != ZIP_METHOD_DEFLATE)
+        {
+            LOG("unsupported compression method %d for %s", entry->method, entry->name);
+            continue;
+        }
+
+        job->files[job->count++] = entry;
+        job->total += entry->uncomp_size;
+    }
+
+    qsort(job->files, job->count, sizeof(job->files[0]), compare_entry_size);
+    return ExtractOK;
+}
+
+RomiExtractResult romi_zip_extract_directory(const char* zip_path, const RomiZipDirectory* dir, const char* dest_folder, RomiExtractProgress progress, void* progress_arg, volatile int* cancelled)
+{
+    RomiExtractResult result;
+
+    ZipJob job;
+    memset(&job, 0, sizeof(job));
+    job.zip_path = zip_path;
+    job.dest_folder = dest_folder;
+    job.progress = progress;
+    job.progress_arg = progress_arg;
+    job.cancelled = cancelled;
+
+    job.files = malloc((dir->count ? dir->count : 1) * sizeof(job.files[0]));
+    if (!job.files)
+        return ExtractErrorMemory;
+
+    result = plan_entries(dir, dest_folder, &job);
+    if (result != ExtractOK)
+    {
+        free(job.files);
+        return result;
+    }
+
+    romi_mutex_create(&job.lock, "extract");
+
+    // the calling thread is the first worker, a failed spawn only costs parallelism
+    uint32_t workers = min32(romi_thermal_level() == ThrottleNone ? EXTRACT_WORKERS : 1, job.count);
+    int joinable = workers > 1 && romi_sema_create(&job.finished, "extract", 0);
+    if (!joinable)
+        workers = 1;
+
+    uint32_t spawned = 0;
+    for (uint32_t i = 1; i < workers; i++)
+    {
+        if (romi_start_thread_arg("extract", extract_thread, &job))
+            spawned++;
     }
 
-    inflateEnd(&strm);
+    LOG("extracting %u files of %s on %u threads", job.count, zip_path, spawned + 1);
+
+    extract_worker(&job);
+    for (uint32_t i = 0; i < spawned; i++)
+        romi_sema_wait(&job.finished);
+    __sync_synchronize();
+
+    result = job.result;
+    if (result == ExtractOK && *cancelled)
+        result = ExtractCancelled;
+
+    if (progress && result == ExtractOK)
+        progress(progress_arg, NULL, job.extracted, job.extracted);
+
+    if (joinable)
+        romi_sema_destroy(&job.finished);
+    romi_mutex_destroy(&job.lock);
+    free(job.files);
+
     return result;
 }
 
-RomiExtractResult romi_extract_zip(const char* zip_path, const char* dest_folder, RomiExtractProgress progress)
+RomiExtractResult romi_extract_zip(const char* zip_path, const char* dest_folder, RomiExtractProgress progress, void* progress_arg, volatile int* cancelled)
 {
-    void* zf = romi_open(zip_path);
-    if (!zf)
-        return ExtractErrorOpen;
+    RomiZipDirectory dir;
+    RomiExtractResult result = romi_zip_read_directory(zip_path, &dir);
+    if (result != ExtractOK)
+        return result;
+
+    result = romi_zip_extract_directory(zip_path, &dir, dest_folder, progress, progress_arg, cancelled);
+    romi_zip_free_directory(&dir);
+    return result;
+}
+
+typedef enum {
+    StreamHeader,
+    StreamName,
+    StreamData,
+    StreamDescriptor,
+    StreamDone,
+} ZipStreamState;
+
+typedef enum {
+    EntryStored,
+    EntryDeflate,
+    EntrySkip,
+} ZipEntryMode;
+
+struct RomiZipStream {
+    ZipStreamState state;
+    RomiExtractResult result;
+    volatile int* cancelled;
+    char dest_folder[256];
+
+    // the entry being written holds the SpaceDownload part, or is only checked without a reservation
+    RomiSpaceReservation* space;
+    uint64_t length;            // of the archive, 0 while unknown
+    uint64_t position;          // archive bytes consumed so far
+    uint64_t written;           // by the current entry
+
+    // local header or data descriptor being collected
+    uint8_t header[sizeof(ZipLocalHeader)];
+    uint32_t header_len;
+
+    char filename[256];
+    uint32_t name_len;
+    uint32_t name_total;
+    uint32_t extra_len;
+    uint32_t name_pos;
+    uint8_t extra[STREAM_EXTRA_SIZE];
+
+    uint16_t flags;
+    ZipEntryMode mode;
+    int sized;
+    int zip64;
+    uint64_t data_remaining;
+    uint64_t uncomp_size;
+    uint32_t crc;
+    uint32_t expected_crc;
+    char dest_path[512];
+    void* outf;
 
-    uint8_t* in_buffer = malloc(EXTRACT_BUFFER_SIZE);
-    uint8_t* out_buffer = malloc(EXTRACT_BUFFER_SIZE);
+    z_stream strm;
+    int strm_active;
+    uint8_t* out_buffer;
+
+    uint32_t entries;
+};
+
+RomiZipStream* romi_zip_stream_open(const char* dest_folder, volatile int* cancelled, RomiSpaceReservation* space)
+{
+    RomiZipStream* zs = malloc(sizeof(RomiZipStream));
+    if (!zs)
+        return NULL;
 
-    if (!in_buffer || !out_buffer)
+    memset(zs, 0, sizeof(*zs));
+    zs->out_buffer = malloc(EXTRACT_BUFFER_SIZE);
+    if (!zs->out_buffer)
     {
-        if (in_buffer) free(in_buffer);
-        if (out_buffer) free(out_buffer);
-        romi_close(zf);
-        return ExtractErrorMemory;
+        free(zs);
+        return NULL;
+    }
+
+    zs->state = StreamHeader;
+    zs->result = ExtractOK;
+    zs->cancelled = cancelled;
+    zs->space = space;
+    romi_strncpy(zs->dest_folder, sizeof(zs->dest_folder), dest_folder);
+
+    return zs;
+}
+
+void romi_zip_stream_set_length(RomiZipStream* zs, uint64_t length)
+{
+    zs->length = length;
+}
+
+// The local header gives the inflated size; an entry followed by a data
+// descriptor doesn't have one, it may take up to twice the rest of the archive
+static int stream_reserve(RomiZipStream* zs)
+{
+    uint64_t bytes = zs->uncomp_size;
+    if (!zs->sized)
+        bytes = zs->length > zs->position ? 2 * (zs->length - zs->position) : 0;
+
+    zs->written = 0;
+    if (zs->space)
+        return romi_space_reserve(zs->space, SpaceDownload, zs->dest_path, 0, bytes);
+
+    return romi_space_available(zs->dest_path) >= bytes;
+}
+
+// Without an open file the data is only checked, see directories in stream_begin_entry
+static RomiExtractResult stream_output(RomiZipStream* zs, const uint8_t* data, uint32_t size)
+{
+    if (zs->outf && !romi_write(zs->outf, data, size))
+        return ExtractErrorWrite;
+
+    zs->crc = romi_crc32(zs->crc, data, size);
+    zs->written += size;
+    if (zs->space)
+        romi_space_landed(zs->space, SpaceDownload, zs->written);
+    return ExtractOK;
+}
+
+static void stream_close_entry(RomiZipStream* zs)
+{
+    if (zs->outf)
+    {
+        romi_close(zs->outf);
+        zs->outf = NULL;
+    }
+
+    if (zs->strm_active)
+    {
+        inflateEnd(&zs->strm);
+        zs->strm_active = 0;
     }
+}
+
+static RomiExtractResult stream_verify(RomiZipStream* zs)
+{
+    if (zs->mode == EntrySkip || zs->crc == zs->expected_crc)
+        return ExtractOK;
 
-    cancelled = 0;
+    LOG("crc mismatch for %s: expected %08x, got %08x", zs->filename, zs->expected_crc, zs->crc);
+    romi_rm(zs->dest_path);
+    return ExtractErrorChecksum;
+}
 
-    int64_t total_size = romi_get_size(zip_path);
-    uint64_t extracted = 0;
-    RomiExtractResult result = ExtractOK;
-    ZipLocalHeader header;
+static RomiExtractResult stream_end_entry(RomiZipStream* zs)
+{
+    stream_close_entry(zs);
+    zs->entries++;
+    zs->header_len = 0;
 
-    while (romi_read(zf, &header, sizeof(header)))
+    if (zs->flags & ZIP_FLAG_DATA_DESCRIPTOR)
     {
-        if (cancelled)
-        {
-            result = ExtractCancelled;
-            break;
-        }
+        zs->state = StreamDescriptor;
+        return ExtractOK;
+    }
 
-        uint32_t sig = get32le((uint8_t*)&header.signature);
+    zs->state = StreamHeader;
+    return stream_verify(zs);
+}
 
-        if (sig == ZIP_CENTRAL_DIR_SIG || sig == ZIP_END_CENTRAL_DIR_SIG)
-            break;
+static RomiExtractResult stream_begin_entry(RomiZipStream* zs)
+{
+    uint16_t compression = get16le((uint8_t*)&((ZipLocalHeader*)zs->header)->compression);
+    uint64_t comp_size = get32le((uint8_t*)&((ZipLocalHeader*)zs->header)->compressed_size);
+    zs->uncomp_size = get32le((uint8_t*)&((ZipLocalHeader*)zs->header)->uncompressed_size);
+
+    // a zip64 field in the local header also widens the sizes of the data descriptor
+    uint32_t extra_size = min32(zs->extra_len, sizeof(zs->extra));
+    uint32_t zip64_len;
+    zs->zip64 = romi_zip_find_extra(zs->extra, extra_size, ROMI_ZIP64_EXTRA_ID, &zip64_len) != NULL;
+    if (!romi_zip64_extra(zs->extra, extra_size, &zs->uncomp_size, &comp_size, NULL))
+    {
+        LOG("zip64 extra field missing for %s", zs->filename);
+        return ExtractErrorFormat;
+    }
 
-        if (sig != ZIP_LOCAL_HEADER_SIG)
+    zs->sized = !(zs->flags & ZIP_FLAG_DATA_DESCRIPTOR);
+    zs->data_remaining = comp_size;
+    zs->expected_crc = get32le((uint8_t*)&((ZipLocalHeader*)zs->header)->crc32);
+    zs->crc = 0;
+
+    romi_snprintf(zs->dest_path, sizeof(zs->dest_path), "%s/%s", zs->dest_folder, zs->filename);
+
+    int is_directory = (zs->name_len > 0 && zs->filename[zs->name_len - 1] == '/');
+    if (is_directory)
+    {
+        romi_mkdirs(zs->dest_path);
+        if (zs->sized)
         {
-            result = ExtractErrorFormat;
-            break;
+            zs->mode = EntrySkip;
+        }
+        else if (compression == ZIP_METHOD_DEFLATE)
+        {
+            // zip writers in Java and .NET give folders an empty deflate stream and a
+            // data descriptor, inflating it to nowhere is the only way to find its end
+            memset(&zs->strm, 0, sizeof(zs->strm));
+            if (inflateInit2(&zs->strm, -MAX_WBITS) != Z_OK)
+                return ExtractErrorDecompress;
+            zs->strm_active = 1;
+            zs->mode = EntryDeflate;
         }
+        else
+        {
+            return ExtractErrorStream;
+        }
+    }
+    else if (compression == ZIP_METHOD_STORED)
+    {
+        // without the size up front there is no way to tell where the data ends
+        if (!zs->sized)
+            return ExtractErrorStream;
+        zs->mode = EntryStored;
+    }
+    else if (compression == ZIP_METHOD_DEFLATE)
+    {
+        memset(&zs->strm, 0, sizeof(zs->strm));
+        if (inflateInit2(&zs->strm, -MAX_WBITS) != Z_OK)
+            return ExtractErrorDecompress;
+        zs->strm_active = 1;
+        zs->mode = EntryDeflate;
+    }
+    else
+    {
+        LOG("unsupported compression method %d for %s", compression, zs->filename);
+        if (!zs->sized)
+            return ExtractErrorStream;
+        zs->mode = EntrySkip;
+    }
 
-        uint16_t compression = get16le((uint8_t*)&header.compression);
-        uint32_t comp_size = get32le((uint8_t*)&header.compressed_size);
-        uint32_t uncomp_size = get32le((uint8_t*)&header.uncompressed_size);
-        uint16_t filename_len = get16le((uint8_t*)&header.filename_len);
-        uint16_t extra_len = get16le((uint8_t*)&header.extra_len);
+    if (zs->mode != EntrySkip && !is_directory)
+    {
+        if (!stream_reserve(zs))
+        {
+            LOG("no room for %s", zs->filename);
+            return ExtractErrorSpace;
+        }
+
+        create_parent_dirs(zs->dest_path);
+        zs->outf = romi_create(zs->dest_path);
+        if (!zs->outf)
+            return ExtractErrorWrite;
+    }
 
-        char filename[256];
-        if (filename_len >= sizeof(filename))
-            filename_len = sizeof(filename) - 1;
+    zs->state = StreamData;
 
-        if (!romi_read(zf, filename, filename_len))
+    if (zs->sized && zs->data_remaining == 0 && zs->mode != EntryDeflate)
+        return stream_end_entry(zs);
+
+    return ExtractOK;
+}
+
+static RomiExtractResult stream_header(RomiZipStream* zs, const uint8_t* data, uint32_t size, uint32_t* used)
+{
+    uint32_t chunk = min32(size, sizeof(ZipLocalHeader) - zs->header_len);
+    memcpy(zs->header + zs->header_len, data, chunk);
+    zs->header_len += chunk;
+    *used = chunk;
+
+    if (zs->header_len >= 4)
+    {
+        uint32_t sig = get32le(zs->header);
+
+        // everything after the last entry is the central directory, nothing left to extract
+        if (sig == ZIP_CENTRAL_DIR_SIG || sig == ZIP_END_CENTRAL_DIR_SIG)
         {
-            result = ExtractErrorRead;
-            break;
+            zs->state = StreamDone;
+            return ExtractOK;
         }
-        filename[filename_len] = 0;
 
-        if (extra_len > 0)
+        if (sig != ZIP_LOCAL_HEADER_SIG)
+            return ExtractErrorFormat;
+    }
+
+    if (zs->header_len < sizeof(ZipLocalHeader))
+        return ExtractOK;
+
+    ZipLocalHeader* header = (ZipLocalHeader*)zs->header;
+    zs->flags = get16le((uint8_t*)&header->flags);
+    zs->name_total = get16le((uint8_t*)&header->filename_len);
+    zs->extra_len = get16le((uint8_t*)&header->extra_len);
+    zs->name_len = min32(zs->name_total, sizeof(zs->filename) - 1);
+    zs->name_pos = 0;
+
+    if (zs->flags & ZIP_FLAG_ENCRYPTED)
+    {
+        LOG("encrypted zip entries are not supported");
+        return ExtractErrorFormat;
+    }
+
+    zs->state = StreamName;
+    return ExtractOK;
+}
+
+static RomiExtractResult stream_name(RomiZipStream* zs, const uint8_t* data, uint32_t size, uint32_t* used)
+{
+    // the name, cut to fit, then the extra field
+    uint32_t total = zs->name_total + zs->extra_len;
+    uint32_t chunk = min32(size, total - zs->name_pos);
+    uint32_t end = zs->name_pos + chunk;
+
+    if (zs->name_pos < zs->name_len)
+    {
+        uint32_t name_chunk = min32(chunk, zs->name_len - zs->name_pos);
+        memcpy(zs->filename + zs->name_pos, data, name_chunk);
+    }
+
+    uint32_t extra_from = max32(zs->name_pos, zs->name_total);
+    uint32_t extra_to = min32(end, zs->name_total + sizeof(zs->extra));
+    if (extra_from < extra_to)
+        memcpy(zs->extra + extra_from - zs->name_total, data + extra_from - zs->name_pos, extra_to - extra_from);
+
+    zs->name_pos = end;
+    *used = chunk;
+
+    if (zs->name_pos < total)
+        return ExtractOK;
+
+    zs->filename[zs->name_len] = 0;
+    return stream_begin_entry(zs);
+}
+
+static RomiExtractResult stream_data(RomiZipStream* zs, const uint8_t* data, uint32_t size, uint32_t* used)
+{
+    uint32_t feed = zs->sized ? (uint32_t)min64(size, zs->data_remaining) : size;
+
+    if (zs->mode != EntryDeflate)
+    {
+        if (zs->mode == EntryStored)
         {
-            uint8_t skip[256];
-            uint16_t remaining = extra_len;
-            while (remaining > 0)
-            {
-                uint16_t chunk = remaining > sizeof(skip) ? sizeof(skip) : remaining;
-                if (!romi_read(zf, skip, chunk))
-                {
-                    result = ExtractErrorRead;
-                    break;
-                }
-                remaining -= chunk;
-            }
+            RomiExtractResult result = stream_output(zs, data, feed);
             if (result != ExtractOK)
-                break;
+                return result;
         }
 
-        int is_directory = (filename_len > 0 && filename[filename_len - 1] == '/');
+        *used = feed;
+        zs->data_remaining -= feed;
+        return zs->data_remaining == 0 ? stream_end_entry(zs) : ExtractOK;
+    }
+
+    zs->strm.next_in = (Bytef*)data;
+    zs->strm.avail_in = feed;
 
-        char dest_path[512];
-        romi_snprintf(dest_path, sizeof(dest_path), "%s/%s", dest_folder, filename);
+    int ret;
+    do
+    {
+        zs->strm.next_out = zs->out_buffer;
+        zs->strm.avail_out = EXTRACT_BUFFER_SIZE;
 
-        if (progress)
-            progress(filename, extracted, total_size);
+        ret = inflate(&zs->strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_NEED_DICT)
+            return ExtractErrorDecompress;
 
-        if (is_directory)
+        uint32_t have = EXTRACT_BUFFER_SIZE - zs->strm.avail_out;
+        if (have > 0)
         {
-            romi_mkdirs(dest_path);
+            RomiExtractResult result = stream_output(zs, zs->out_buffer, have);
+            if (result != ExtractOK)
+                return result;
         }
-        else if (comp_size > 0)
-        {
-            create_parent_dirs(dest_path);
+    } while (ret != Z_STREAM_END && (zs->strm.avail_in > 0 || zs->strm.avail_out == 0));
 
-            void* outf = romi_create(dest_path);
-            if (!outf)
-            {
-                result = ExtractErrorWrite;
-                break;
-            }
+    *used = feed - zs->strm.avail_in;
+    if (zs->sized)
+        zs->data_remaining -= *used;
 
-            if (compression == ZIP_METHOD_STORED)
-            {
-                result = extract_stored(zf, outf, comp_size, in_buffer);
-            }
-            else if (compression == ZIP_METHOD_DEFLATE)
-            {
-                result = extract_deflate(zf, outf, comp_size, uncomp_size, in_buffer, out_buffer);
-            }
-            else
-            {
-                LOG("unsupported compression method %d for %s", compression, filename);
-
-                uint32_t remaining = comp_size;
-                while (remaining > 0)
-                {
-                    uint32_t chunk = remaining > EXTRACT_BUFFER_SIZE ? EXTRACT_BUFFER_SIZE : remaining;
-                    if (!romi_read(zf, in_buffer, chunk))
-                    {
-                        result = ExtractErrorRead;
-                        break;
-                    }
-                    remaining -= chunk;
-                }
-            }
+    if (ret == Z_STREAM_END)
+    {
+        // deflate knows where it ends, anything left over belongs to the next record
+        if (zs->sized && zs->data_remaining != 0)
+            return ExtractErrorFormat;
+        return stream_end_entry(zs);
+    }
+
+    if (zs->sized && zs->data_remaining == 0)
+        return ExtractErrorDecompress;
 
-            romi_close(outf);
+    return ExtractOK;
+}
 
-            if (result != ExtractOK)
-                break;
+static RomiExtractResult stream_descriptor(RomiZipStream* zs, const uint8_t* data, uint32_t size, uint32_t* used)
+{
+    // crc32 + sizes, 8 bytes each for zip64 entries, optionally preceded by a signature
+    uint32_t descriptor_len = zs->zip64 ? 20 : 12;
+    uint32_t needed = descriptor_len;
+    if (zs->header_len >= 4 && get32le(zs->header) == ZIP_DATA_DESCRIPTOR_SIG)
+        needed += 4;
+
+    uint32_t want = zs->header_len < 4 ? 4 : needed;
+    uint32_t chunk = min32(size, want - zs->header_len);
+    memcpy(zs->header + zs->header_len, data, chunk);
+    zs->header_len += chunk;
+    *used = chunk;
+
+    if (zs->header_len < needed)
+        return ExtractOK;
+
+    zs->expected_crc = get32le(zs->header + needed - descriptor_len);
+    zs->header_len = 0;
+    zs->state = StreamHeader;
+    return stream_verify(zs);
+}
 
-            extracted += uncomp_size;
+RomiExtractResult romi_zip_stream_write(RomiZipStream* zs, const uint8_t* data, uint32_t size)
+{
+    while (size > 0 && zs->result == ExtractOK)
+    {
+        if (*zs->cancelled)
+        {
+            zs->result = ExtractCancelled;
+            break;
+        }
+
+        uint32_t used = 0;
+        switch (zs->state)
+        {
+            case StreamHeader:     zs->result = stream_header(zs, data, size, &used); break;
+            case StreamName:       zs->result = stream_name(zs, data, size, &used); break;
+            case StreamData:       zs->result = stream_data(zs, data, size, &used); break;
+            case StreamDescriptor: zs->result = stream_descriptor(zs, data, size, &used); break;
+            case StreamDone:       used = size; break;
         }
+
+        data += used;
+        size -= used;
+        zs->position += used;
     }
 
-    if (progress && result == ExtractOK)
-        progress(NULL, extracted, extracted);
+    return zs->result;
+}
+
+RomiExtractResult romi_zip_stream_close(RomiZipStream* zs)
+{
+    RomiExtractResult result = zs->result;
+    if (result == ExtractOK && zs->state != StreamDone)
+        result = ExtractErrorFormat;
+
+    int partial = zs->outf != NULL;
+    stream_close_entry(zs);
+    if (partial)
+        romi_rm(zs->dest_path);
 
-    free(in_buffer);
-    free(out_buffer);
-    romi_close(zf);
+    LOG("streamed %u zip entries to %s: %s", zs->entries, zs->dest_folder, romi_extract_error_string(result));
 
+    free(zs->out_buffer);
+    free(zs);
     return result;
 }
 
@@ -290,6 +838,9 @@ const char* romi_extract_error_string(RomiExtractResult result)
         case ExtractErrorWrite:       return "Write error";
         case ExtractErrorDecompress:  return "Decompression error";
         case ExtractCancelled:        return "Cancelled";
+        case ExtractErrorSpace:       return "Not enough free space";
+        case ExtractErrorStream:      return "Cannot extract while downloading";
+        case ExtractErrorChecksum:    return "Checksum mismatch";
         default:                      return "Unknown error";
     }
 }
@@ -303,8 +854,3 @@ int romi_is_zip_file(const char* path)
 
     return (romi_stricmp(ext, ".zip") == 0);
 }
-
-void romi_extract_cancel(void)
-{
-    cancelled = 1;
-}
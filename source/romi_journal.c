@@ -0,0 +1,348 @@
+#include "romi_journal.h"
+#include "romi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static romi_mutex g_journal_lock;
+static uint32_t g_journal_size;
+static uint32_t g_journal_compacted;    // size right after the last compaction
+static int g_journal_open;
+
+// Records appended while a compaction writes its snapshot, added to the new
+// journal when it replaces the old one. Overflowing abandons the compaction
+#define JOURNAL_BACKLOG_SIZE (16 * 1024)
+static int g_journal_compacting;
+static char g_journal_backlog[JOURNAL_BACKLOG_SIZE];
+static uint32_t g_journal_backlog_len;
+static int g_journal_backlog_lost;
+
+static void journal_path(char* path, uint32_t size, const char* suffix)
+{
+    romi_snprintf(path, size, "%s/queue%s.journal", romi_get_config_folder(), suffix);
+}
+
+void romi_journal_init(void)
+{
+    romi_mutex_create(&g_journal_lock, "journal");
+
+    char path[256];
+    journal_path(path, sizeof(path), "");
+    int64_t size = romi_get_size(path);
+    g_journal_size = size > 0 ? (uint32_t)size : 0;
+    g_journal_compacted = 0;
+    g_journal_open = 1;
+}
+
+void romi_journal_close(void)
+{
+    romi_mutex_lock(&g_journal_lock);
+    g_journal_open = 0;
+    romi_mutex_unlock(&g_journal_lock);
+}
+
+static void journal_append(const char* line, int len)
+{
+    if (len <= 0)
+        return;
+
+    char path[256];
+    journal_path(path, sizeof(path), "");
+
+    romi_mutex_lock(&g_journal_lock);
+    if (g_journal_open)
+    {
+        void* f = romi_append(path);
+        if (f)
+        {
+            if (romi_write(f, line, len))
+                g_journal_size += len;
+            romi_close(f);
+        }
+
+        if (g_journal_compacting)
+        {
+            if (g_journal_backlog_len + len <= sizeof(g_journal_backlog))
+            {
+                memcpy(g_journal_backlog + g_journal_backlog_len, line, len);
+                g_journal_backlog_len += len;
+            }
+            else
+            {
+                g_journal_backlog_lost = 1;
+            }
+        }
+    }
+    romi_mutex_unlock(&g_journal_lock);
+}
+
+// One record per line:
+//   A id priority platform url     enqueued, the url goes last as it may hold spaces
+//   S id status                    DownloadStatus changed
+//   P id priority
+//   O id offset                    bytes received so far
+//   R id                           removed from the queue
+//   M id other                     swapped places with other in the queue
+void romi_journal_add(uint32_t id, const DbItem* item, uint8_t priority)
+{
+    char line[ROMI_JOURNAL_URL_LENGTH + 64];
+    int len = romi_snprintf(line, sizeof(line), "A %u %u %s %s\n",
+        id, priority, romi_platform_name(item->platform), item->url);
+    if (len >= (int)sizeof(line))
+    {
+        LOG("url of %s too long for the queue journal", item->name);
+        return;
+    }
+    journal_append(line, len);
+}
+
+void romi_journal_status(uint32_t id, uint8_t status)
+{
+    char line[32];
+    journal_append(line, romi_snprintf(line, sizeof(line), "S %u %u\n", id, status));
+}
+
+void romi_journal_priority(uint32_t id, uint8_t priority)
+{
+    char line[32];
+    journal_append(line, romi_snprintf(line, sizeof(line), "P %u %u\n", id, priority));
+}
+
+void romi_journal_offset(uint32_t id, uint64_t offset)
+{
+    char line[48];
+    journal_append(line, romi_snprintf(line, sizeof(line), "O %u %llu\n", id, offset));
+}
+
+void romi_journal_remove(uint32_t id)
+{
+    char line[32];
+    journal_append(line, romi_snprintf(line, sizeof(line), "R %u\n", id));
+}
+
+void romi_journal_swap(uint32_t id, uint32_t other)
+{
+    char line[48];
+    journal_append(line, romi_snprintf(line, sizeof(line), "M %u %u\n", id, other));
+}
+
+static RomiJournalEntry* journal_find(RomiJournalEntry* entries, uint32_t count, uint32_t id)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (entries[i].id == id)
+            return &entries[i];
+    }
+    return NULL;
+}
+
+static void journal_replay(char* line, RomiJournalEntry* entries, uint32_t* count, uint32_t max)
+{
+    unsigned int id, value;
+    unsigned long long offset;
+    char platform[16];
+    int used = 0;
+
+    if (sscanf(line, "A %u %u %15s %n", &id, &value, platform, &used) == 3 && used > 0)
+    {
+        const char* url = line + used;
+        if (!url[0])
+            return;
+
+        RomiJournalEntry* entry = journal_find(entries, *count, id);
+        if (!entry && *count < max)
+            entry = &entries[(*count)++];
+        if (!entry)
+            return;
+
+        memset(entry, 0, sizeof(*entry));
+        entry->id = id;
+        entry->priority = (uint8_t)value;
+        entry->platform = romi_parse_platform(platform);
+        romi_strncpy(entry->url, sizeof(entry->url), url);
+        return;
+    }
+
+    if (sscanf(line, "R %u", &id) == 1)
+    {
+        RomiJournalEntry* entry = journal_find(entries, *count, id);
+        if (entry)
+        {
+            uint32_t index = (uint32_t)(entry - entries);
+            memmove(entry, entry + 1, (*count - index - 1) * sizeof(*entry));
+            (*count)--;
+        }
+        return;
+    }
+
+    if (sscanf(line, "M %u %u", &id, &value) == 2)
+    {
+        RomiJournalEntry* entry = journal_find(entries, *count, id);
+        RomiJournalEntry* other = journal_find(entries, *count, value);
+        if (entry && other)
+        {
+            RomiJournalEntry temp = *entry;
+            *entry = *other;
+            *other = temp;
+        }
+        return;
+    }
+
+    RomiJournalEntry* entry = NULL;
+    if (sscanf(line, "%*c %u", &id) == 1)
+        entry = journal_find(entries, *count, id);
+    if (!entry)
+        return;
+
+    if (sscanf(line, "S %u %u", &id, &value) == 2)
+        entry->status = (uint8_t)value;
+    else if (sscanf(line, "P %u %u", &id, &value) == 2)
+        entry->priority = (uint8_t)value;
+    else if (sscanf(line, "O %u %llu", &id, &offset) == 2)
+        entry->offset = offset;
+}
+
+uint32_t romi_journal_load(RomiJournalEntry* entries, uint32_t max)
+{
+    char path[256];
+    journal_path(path, sizeof(path), "");
+
+    // power lost between the two steps of a compaction, the new journal is complete
+    int64_t size = romi_get_size(path);
+    if (size <= 0)
+    {
+        journal_path(path, sizeof(path), ".new");
+        size = romi_get_size(path);
+    }
+    if (size <= 0)
+        return 0;
+
+    if (size > ROMI_JOURNAL_MAX_LOAD)
+    {
+        LOG("queue journal %s is %lld bytes, ignoring it", path, size);
+        return 0;
+    }
+
+    char* data = malloc((uint32_t)size + 1);
+    if (!data)
+        return 0;
+
+    romi_mutex_lock(&g_journal_lock);
+    int loaded = romi_load(path, data, (uint32_t)size);
+    romi_mutex_unlock(&g_journal_lock);
+
+    uint32_t count = 0;
+    if (loaded > 0)
+    {
+        data[loaded] = 0;
+
+        char* line = data;
+        while (line && *line)
+        {
+            // a last line without its newline was cut short by a power cut
+            char* next = strchr(line, '\n');
+            if (!next)
+                break;
+            *next++ = 0;
+
+            journal_replay(line, entries, &count, max);
+            line = next;
+        }
+    }
+
+    free(data);
+
+    LOG("restored %u queue entries from %s", count, path);
+    return count;
+}
+
+int romi_journal_needs_compaction(void)
+{
+    return g_journal_open && g_journal_size > g_journal_compacted + ROMI_JOURNAL_MAX_SIZE;
+}
+
+int romi_journal_begin_compaction(void)
+{
+    romi_mutex_lock(&g_journal_lock);
+
+    int started = g_journal_open && !g_journal_compacting;
+    if (started)
+    {
+        g_journal_compacting = 1;
+        g_journal_backlog_len = 0;
+        g_journal_backlog_lost = 0;
+    }
+
+    romi_mutex_unlock(&g_journal_lock);
+    return started;
+}
+
+void romi_journal_compact(const RomiJournalEntry* entries, uint32_t count)
+{
+    char path[256], temp[256];
+    journal_path(path, sizeof(path), "");
+    journal_path(temp, sizeof(temp), ".new");
+
+    // the snapshot is written without the lock, appends carry on meanwhile
+    uint32_t size = 0;
+    int ok = 0;
+    void* f = romi_create(temp);
+    if (f)
+    {
+        ok = 1;
+        for (uint32_t i = 0; i < count && ok; i++)
+        {
+            const RomiJournalEntry* entry = &entries[i];
+
+            char line[ROMI_JOURNAL_URL_LENGTH + 128];
+            int len = romi_snprintf(line, sizeof(line), "A %u %u %s %s\nS %u %u\nO %u %llu\n",
+                entry->id, entry->priority, romi_platform_name(entry->platform), entry->url,
+                entry->id, entry->status, entry->id, entry->offset);
+            if (len <= 0 || len >= (int)sizeof(line))
+                continue;
+
+            ok = romi_write(f, line, len);
+            size += len;
+        }
+        romi_close(f);
+    }
+
+    romi_mutex_lock(&g_journal_lock);
+
+    ok = ok && g_journal_open && !g_journal_backlog_lost;
+
+    // then whatever was appended to the old journal since the snapshot
+    if (ok && g_journal_backlog_len > 0)
+    {
+        f = romi_append(temp);
+        ok = f && romi_write(f, g_journal_backlog, g_journal_backlog_len);
+        if (f)
+            romi_close(f);
+        size += g_journal_backlog_len;
+    }
+
+    // the old journal stays in place until the new one is complete
+    if (ok)
+    {
+        romi_rm(path);
+        ok = rename(temp, path) == 0;
+    }
+
+    if (ok)
+    {
+        g_journal_size = size;
+        LOG("compacted queue journal to %u entries (%u bytes)", count, size);
+    }
+    else
+    {
+        romi_rm(temp);
+        LOG("failed to compact queue journal");
+    }
+
+    // a failed attempt waits for another ROMI_JOURNAL_MAX_SIZE of records
+    g_journal_compacted = g_journal_size;
+    g_journal_compacting = 0;
+
+    romi_mutex_unlock(&g_journal_lock);
+}
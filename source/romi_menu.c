@@ -29,6 +29,7 @@ typedef enum {
     MenuSort,
     MenuFilter,
     MenuRefresh,
+    MenuQueueAll,
     MenuMusic,
     MenuPlatform,
     MenuStorage
@@ -69,6 +70,7 @@ static MenuEntry menu_entries[] =
     { MenuStorage, "Device", 0 },
 
     { MenuRefresh, "Refresh...", 0 },
+    { MenuQueueAll, "Queue all results...", 0 },
 };
 
 static const struct {
@@ -171,6 +173,7 @@ void romi_menu_start(int search_clear, const Config* config)
     menu_entries[18].text = _("Storage:");
     menu_entries[19].text = _("Device");
     menu_entries[20].text = _("Refresh...");
+    menu_entries[21].text = _("Queue all results...");
 
     if (romi_menu_width)
         return;
@@ -290,6 +293,12 @@ int romi_do_menu(romi_input* input)
             menu_delta = -1;
             return 1;
         }
+        else if (type == MenuQueueAll)
+        {
+            menu_result = MenuResultQueueAll;
+            menu_delta = -1;
+            return 1;
+        }
         else if (type == MenuSort)
         {
             DbSort value = (DbSort)menu_entries[menu_selected].value;
@@ -352,7 +361,7 @@ int romi_do_menu(romi_input* input)
         int x = VITA_WIDTH - (romi_menu_width + ROMI_MAIN_HMARGIN) + ROMI_MENU_LEFT_PADDING;
 
         char text[64];
-        if (type == MenuSearch || type == MenuSearchClear || type == MenuDownloads || type == MenuText || type == MenuRefresh)
+        if (type == MenuSearch || type == MenuSearchClear || type == MenuDownloads || type == MenuText || type == MenuRefresh || type == MenuQueueAll)
         {
             if (type == MenuDownloads)
             {
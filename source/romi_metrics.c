@@ -0,0 +1,226 @@
+#include "romi_metrics.h"
+#include "romi_utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// last record of the most recent items, so the details dialog never reads
+// the history; when it is full the oldest slot is reused
+#define METRICS_RECENT 256
+
+typedef struct {
+    uint32_t key;       // of platform and url, names repeat across platforms
+    RomiMetrics metrics;
+} RecentMetrics;
+
+static romi_mutex g_metrics_lock;
+static RecentMetrics g_recent[METRICS_RECENT];
+static uint32_t g_recent_count;
+static uint32_t g_recent_next;
+
+void romi_metrics_add(RomiMetrics* metrics, const romi_http_metrics* http)
+{
+    metrics->bytes += http->bytes;
+    metrics->total_msec += http->total_msec;
+    metrics->dns_msec += http->dns_msec;
+    metrics->connect_msec += http->connect_msec;
+    metrics->tls_msec += http->tls_msec;
+    metrics->ttfb_msec += http->ttfb_msec;
+    metrics->redirects += http->redirects;
+    metrics->proxy = http->proxy;
+    if (http->ip[0])
+        romi_strncpy(metrics->ip, sizeof(metrics->ip), http->ip);
+}
+
+static void history_path(char* path, uint32_t size, const char* suffix)
+{
+    romi_snprintf(path, size, "%s/transfers%s.csv", romi_get_config_folder(), suffix);
+}
+
+// The url as written to the history, commas escaped so it stays one column
+static void escape_url(const char* url, char* out, uint32_t size)
+{
+    uint32_t len = 0;
+    for (; *url && len + 4 < size; url++)
+    {
+        if (*url == ',')
+        {
+            romi_memcpy(out + len, "%2C", 3);
+            len += 3;
+        }
+        else
+        {
+            out[len++] = *url;
+        }
+    }
+    out[len] = 0;
+}
+
+// FNV-1a of the platform and the escaped url
+static uint32_t metrics_key(RomiPlatform platform, const char* url)
+{
+    uint32_t hash = (2166136261u ^ (uint8_t)platform) * 16777619u;
+    for (; *url; url++)
+        hash = (hash ^ (uint8_t)*url) * 16777619u;
+    return hash;
+}
+
+// Called with g_metrics_lock held
+static void remember(uint32_t key, const RomiMetrics* metrics)
+{
+    for (uint32_t i = 0; i < g_recent_count; i++)
+    {
+        if (g_recent[i].key == key)
+        {
+            g_recent[i].metrics = *metrics;
+            return;
+        }
+    }
+
+    RecentMetrics* slot = &g_recent[g_recent_next];
+    slot->key = key;
+    slot->metrics = *metrics;
+
+    g_recent_next = (g_recent_next + 1) % METRICS_RECENT;
+    if (g_recent_count < METRICS_RECENT)
+        g_recent_count++;
+}
+
+// transfers.csv: time,success,bytes,total,dns,connect,tls,ttfb,redirects,retries,stall,io,proxy,ip,platform,url,name
+// times in msec; the name goes last since it may contain commas, the url has them escaped
+void romi_metrics_record(const DbItem* item, RomiMetrics* metrics, int success)
+{
+    metrics->time = (uint32_t)time(NULL);
+    metrics->success = success;
+
+    char url[1024];
+    escape_url(item->url, url, sizeof(url));
+
+    char line[2048];
+    int len = romi_snprintf(line, sizeof(line), "%u,%d,%llu,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%s,%s,%s,%s\n",
+        metrics->time, metrics->success, metrics->bytes, metrics->total_msec,
+        metrics->dns_msec, metrics->connect_msec, metrics->tls_msec, metrics->ttfb_msec,
+        metrics->redirects, metrics->retries, metrics->stall_msec, metrics->io_msec,
+        metrics->proxy, metrics->ip[0] ? metrics->ip : "-", romi_platform_name(item->platform), url, item->name);
+    if (len <= 0 || len >= (int)sizeof(line))
+        return;
+
+    char path[256];
+    history_path(path, sizeof(path), "");
+
+    romi_mutex_lock(&g_metrics_lock);
+
+    remember(metrics_key(item->platform, url), metrics);
+
+    // keep the history bounded, the previous file is kept until the next rotation
+    if (romi_get_size(path) > ROMI_METRICS_MAX_HISTORY)
+    {
+        char old[256];
+        history_path(old, sizeof(old), ".old");
+        romi_rm(old);
+        rename(path, old);
+    }
+
+    void* f = romi_append(path);
+    if (f)
+    {
+        romi_write(f, line, len);
+        romi_close(f);
+    }
+
+    romi_mutex_unlock(&g_metrics_lock);
+}
+
+// Lines written before the platform and url columns can't be matched to an item and are skipped
+static int parse_line(const char* line, RomiMetrics* metrics, uint32_t* key)
+{
+    unsigned long long bytes;
+    char platform[16];
+    char url[1024];
+    int used = 0;
+
+    memset(metrics, 0, sizeof(*metrics));
+    if (sscanf(line, "%u,%d,%llu,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%47[^,],%15[^,],%1023[^,],%n",
+        &metrics->time, &metrics->success, &bytes, &metrics->total_msec,
+        &metrics->dns_msec, &metrics->connect_msec, &metrics->tls_msec, &metrics->ttfb_msec,
+        &metrics->redirects, &metrics->retries, &metrics->stall_msec, &metrics->io_msec,
+        &metrics->proxy, metrics->ip, platform, url, &used) != 16 || used == 0)
+        return 0;
+
+    // an old line whose name had commas in it doesn't round-trip
+    RomiPlatform p = romi_parse_platform(platform);
+    if (strcmp(romi_platform_name(p), platform) != 0)
+        return 0;
+
+    metrics->bytes = bytes;
+    *key = metrics_key(p, url);
+    return 1;
+}
+
+static void load_history(const char* suffix)
+{
+    char path[256];
+    history_path(path, sizeof(path), suffix);
+
+    char* data = malloc(ROMI_METRICS_MAX_HISTORY + 4096);
+    if (!data)
+        return;
+
+    int loaded = romi_load(path, data, ROMI_METRICS_MAX_HISTORY + 4095);
+    if (loaded > 0)
+    {
+        data[loaded] = 0;
+
+        char* line = data;
+        while (line && *line)
+        {
+            char* next = strchr(line, '\n');
+            if (next)
+                *next++ = 0;
+
+            RomiMetrics parsed;
+            uint32_t key;
+            if (parse_line(line, &parsed, &key))
+                remember(key, &parsed);
+
+            line = next;
+        }
+    }
+
+    free(data);
+}
+
+void romi_metrics_init(void)
+{
+    romi_mutex_create(&g_metrics_lock, "metrics");
+
+    g_recent_count = 0;
+    g_recent_next = 0;
+    // older lines first, the newest record of an item wins
+    load_history(".old");
+    load_history("");
+}
+
+int romi_metrics_find(const DbItem* item, RomiMetrics* metrics)
+{
+    char url[1024];
+    escape_url(item->url, url, sizeof(url));
+    uint32_t key = metrics_key(item->platform, url);
+    int found = 0;
+
+    romi_mutex_lock(&g_metrics_lock);
+    for (uint32_t i = 0; i < g_recent_count; i++)
+    {
+        if (g_recent[i].key == key)
+        {
+            *metrics = g_recent[i].metrics;
+            found = 1;
+            break;
+        }
+    }
+    romi_mutex_unlock(&g_metrics_lock);
+
+    return found;
+}
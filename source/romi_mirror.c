@@ -0,0 +1,262 @@
+#include "romi_mirror.h"
+#include "romi.h"
+#include "romi_utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIRROR_URL_LENGTH   512
+#define MIRROR_PROBE_MSEC   5000
+
+typedef struct {
+    char base[MIRROR_URL_LENGTH];
+    uint32_t speed;         // smoothed bytes/sec, 0 = never measured
+    uint32_t connect_ms;
+    uint32_t failures;
+} RomiMirror;
+
+static RomiMirror g_mirrors[PlatformCount][ROMI_MAX_MIRRORS];
+static uint32_t g_mirror_count[PlatformCount];
+static romi_mutex g_mirror_lock;
+// rankings changed since mirrors.txt was written
+static int g_mirror_dirty;
+// one writer of mirrors.txt at a time, taken without g_mirror_lock held
+static romi_mutex g_mirror_file_lock;
+
+void romi_mirror_init(void)
+{
+    romi_mutex_create(&g_mirror_lock, "mirror");
+    romi_mutex_create(&g_mirror_file_lock, "mirror_file");
+    romi_mirror_reset();
+}
+
+void romi_mirror_reset(void)
+{
+    memset(g_mirrors, 0, sizeof(g_mirrors));
+    memset(g_mirror_count, 0, sizeof(g_mirror_count));
+}
+
+int romi_mirror_add(RomiPlatform platform, const char* base_url)
+{
+    if (platform >= PlatformCount || g_mirror_count[platform] >= ROMI_MAX_MIRRORS)
+        return 0;
+
+    RomiMirror* mirror = &g_mirrors[platform][g_mirror_count[platform]++];
+    romi_strncpy(mirror->base, sizeof(mirror->base), base_url);
+    return 1;
+}
+
+uint32_t romi_mirror_count(RomiPlatform platform)
+{
+    return platform < PlatformCount ? g_mirror_count[platform] : 0;
+}
+
+const char* romi_mirror_base(RomiPlatform platform, uint32_t index)
+{
+    if (index >= romi_mirror_count(platform))
+        return NULL;
+    return g_mirrors[platform][index].base;
+}
+
+// Measured throughput, discounted for every recent failure
+static uint64_t mirror_score(const RomiMirror* mirror)
+{
+    return ((uint64_t)mirror->speed + 1) * 1000 / (1000 + mirror->connect_ms) / (1 + 2 * mirror->failures);
+}
+
+static void sort_mirrors(RomiPlatform platform, uint32_t* order, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+        order[i] = i;
+
+    // at most ROMI_MAX_MIRRORS entries, insertion sort is plenty
+    for (uint32_t i = 1; i < count; i++)
+    {
+        uint32_t index = order[i];
+        uint64_t score = mirror_score(&g_mirrors[platform][index]);
+        uint32_t j = i;
+        while (j > 0 && mirror_score(&g_mirrors[platform][order[j - 1]]) < score)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = index;
+    }
+}
+
+int romi_mirror_best(RomiPlatform platform)
+{
+    uint32_t count = romi_mirror_count(platform);
+    if (count == 0)
+        return -1;
+
+    uint32_t order[ROMI_MAX_MIRRORS];
+    romi_mutex_lock(&g_mirror_lock);
+    sort_mirrors(platform, order, count);
+    romi_mutex_unlock(&g_mirror_lock);
+
+    return (int)order[0];
+}
+
+uint32_t romi_mirror_rank(RomiPlatform platform, const char* path, uint32_t* order)
+{
+    uint32_t count = romi_mirror_count(platform);
+
+    if (count > 1)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            RomiMirror* mirror = &g_mirrors[platform][i];
+            if (mirror->speed != 0 || mirror->failures != 0)
+                continue;
+
+            char url[1024];
+            romi_snprintf(url, sizeof(url), "%s%s", mirror->base, path);
+
+            uint32_t connect_ms = 0, speed = 0;
+            int ok = romi_http_probe(url, ROMI_MIRROR_PROBE_BYTES, MIRROR_PROBE_MSEC, &connect_ms, &speed);
+            LOG("probed mirror %s: %s, connect %u ms, %u KB/s", mirror->base, ok ? "ok" : "failed", connect_ms, speed / 1024);
+
+            romi_mutex_lock(&g_mirror_lock);
+            if (ok)
+            {
+                mirror->connect_ms = connect_ms;
+                mirror->speed = max32(speed, 1);
+            }
+            else
+            {
+                mirror->failures++;
+            }
+            g_mirror_dirty = 1;
+            romi_mutex_unlock(&g_mirror_lock);
+        }
+    }
+
+    romi_mutex_lock(&g_mirror_lock);
+    sort_mirrors(platform, order, count);
+    romi_mutex_unlock(&g_mirror_lock);
+
+    return count;
+}
+
+void romi_mirror_report(RomiPlatform platform, uint32_t index, uint64_t bytes, uint32_t msec, int success)
+{
+    if (index >= romi_mirror_count(platform))
+        return;
+
+    uint32_t count = romi_mirror_count(platform);
+    uint32_t before[ROMI_MAX_MIRRORS], after[ROMI_MAX_MIRRORS];
+
+    romi_mutex_lock(&g_mirror_lock);
+    sort_mirrors(platform, before, count);
+
+    RomiMirror* mirror = &g_mirrors[platform][index];
+    if (success)
+    {
+        mirror->failures = 0;
+    }
+    else
+    {
+        mirror->failures++;
+    }
+
+    // short transfers say more about latency than bandwidth, keep them out of the average
+    if (bytes >= ROMI_MIRROR_PROBE_BYTES && msec > 0)
+    {
+        uint32_t speed = (uint32_t)min64(bytes * 1000 / msec, UINT32_MAX);
+        mirror->speed = mirror->speed ? (mirror->speed * 3 + speed) / 4 : speed;
+    }
+
+    g_mirror_dirty = 1;
+    sort_mirrors(platform, after, count);
+    int reordered = memcmp(before, after, count * sizeof(before[0])) != 0;
+
+    romi_mutex_unlock(&g_mirror_lock);
+
+    // speeds drift with every transfer, the file is only rewritten when the
+    // order changes; the rest is written by romi_mirror_save at shutdown
+    if (reordered)
+        romi_mirror_save();
+}
+
+// mirrors.txt: one "url speed connect_ms failures" line per known mirror
+void romi_mirror_load(void)
+{
+    char path[256];
+    romi_snprintf(path, sizeof(path), "%s/mirrors.txt", romi_get_config_folder());
+
+    char data[8192];
+    int loaded = romi_load(path, data, sizeof(data) - 1);
+    if (loaded <= 0)
+        return;
+    data[loaded] = 0;
+
+    char* line = data;
+    while (line && *line)
+    {
+        char* next = strchr(line, '\n');
+        if (next)
+            *next++ = 0;
+
+        char url[MIRROR_URL_LENGTH];
+        unsigned int speed, connect_ms, failures;
+        if (sscanf(line, "%511s %u %u %u", url, &speed, &connect_ms, &failures) == 4)
+        {
+            for (int p = 0; p < PlatformCount; p++)
+            {
+                for (uint32_t i = 0; i < g_mirror_count[p]; i++)
+                {
+                    RomiMirror* mirror = &g_mirrors[p][i];
+                    if (strcmp(mirror->base, url) == 0)
+                    {
+                        mirror->speed = speed;
+                        mirror->connect_ms = connect_ms;
+                        mirror->failures = failures;
+                    }
+                }
+            }
+        }
+
+        line = next;
+    }
+
+    LOG("loaded mirror rankings from %s", path);
+}
+
+void romi_mirror_save(void)
+{
+    char data[8192];
+    int len = 0;
+
+    romi_mutex_lock(&g_mirror_lock);
+    if (!g_mirror_dirty)
+    {
+        romi_mutex_unlock(&g_mirror_lock);
+        return;
+    }
+    g_mirror_dirty = 0;
+
+    for (int p = 0; p < PlatformCount; p++)
+    {
+        for (uint32_t i = 0; i < g_mirror_count[p]; i++)
+        {
+            const RomiMirror* mirror = &g_mirrors[p][i];
+            if (mirror->speed == 0 && mirror->failures == 0)
+                continue;
+            if (len + MIRROR_URL_LENGTH + 40 > (int)sizeof(data))
+                break;
+
+            len += romi_snprintf(data + len, sizeof(data) - len, "%s %u %u %u\n",
+                mirror->base, mirror->speed, mirror->connect_ms, mirror->failures);
+        }
+    }
+    romi_mutex_unlock(&g_mirror_lock);
+
+    char path[256];
+    romi_snprintf(path, sizeof(path), "%s/mirrors.txt", romi_get_config_folder());
+
+    romi_mutex_lock(&g_mirror_file_lock);
+    romi_save(path, data, len);
+    romi_mutex_unlock(&g_mirror_file_lock);
+}
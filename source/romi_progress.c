@@ -0,0 +1,105 @@
+#include "romi_progress.h"
+#include "romi.h"
+
+#include <string.h>
+
+// tries before a waiting thread gives up its time slice, the other side may
+// have been preempted in the middle of an update
+#define PROGRESS_SPINS 64
+
+static void progress_begin(RomiProgress* progress)
+{
+    // a control path (cancel, retry) may race the worker, only one writer at a time
+    for (uint32_t spins = 0;; spins++)
+    {
+        uint32_t seq = progress->seq;
+        if (!(seq & 1) && __sync_bool_compare_and_swap(&progress->seq, seq, seq + 1))
+            return;
+
+        if (spins >= PROGRESS_SPINS)
+        {
+            romi_sleep(0);
+            spins = 0;
+        }
+    }
+}
+
+static void progress_end(RomiProgress* progress)
+{
+    __sync_synchronize();
+    progress->seq++;
+}
+
+static void progress_copy_status(RomiProgress* progress, const char* status)
+{
+    if (status && status[0])
+    {
+        romi_strncpy(progress->status_text, sizeof(progress->status_text), status);
+    }
+}
+
+void romi_progress_reset(RomiProgress* progress, const char* status)
+{
+    progress_begin(progress);
+    progress->downloaded = 0;
+    progress->total = 0;
+    progress->status_text[0] = 0;
+    progress_copy_status(progress, status);
+    progress_end(progress);
+}
+
+void romi_progress_publish(RomiProgress* progress, uint64_t downloaded, uint64_t total, const char* status)
+{
+    progress_begin(progress);
+    progress->downloaded = downloaded;
+    progress->total = total;
+    progress_copy_status(progress, status);
+    progress_end(progress);
+}
+
+void romi_progress_set_counters(RomiProgress* progress, uint64_t downloaded, uint64_t total)
+{
+    progress_begin(progress);
+    progress->downloaded = downloaded;
+    progress->total = total;
+    progress_end(progress);
+}
+
+void romi_progress_set_status(RomiProgress* progress, const char* status)
+{
+    progress_begin(progress);
+    progress_copy_status(progress, status);
+    progress_end(progress);
+}
+
+void romi_progress_read(const RomiProgress* progress, RomiProgressSnapshot* snapshot)
+{
+    for (uint32_t spins = 0;; spins++)
+    {
+        uint32_t seq = progress->seq;
+        if (!(seq & 1))
+        {
+            __sync_synchronize();
+            snapshot->downloaded = progress->downloaded;
+            snapshot->total = progress->total;
+            memcpy(snapshot->status_text, progress->status_text, sizeof(snapshot->status_text));
+            __sync_synchronize();
+
+            if (progress->seq == seq)
+                return;
+        }
+
+        if (spins >= PROGRESS_SPINS)
+        {
+            romi_sleep(0);
+            spins = 0;
+        }
+    }
+}
+
+uint64_t romi_progress_downloaded(const RomiProgress* progress)
+{
+    RomiProgressSnapshot snapshot;
+    romi_progress_read(progress, &snapshot);
+    return snapshot.downloaded;
+}
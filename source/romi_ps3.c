@@ -1,10 +1,14 @@
 #include "romi.h"
 #include "romi_style.h"
 #include "romi_queue.h"
+#include "romi_redirect.h"
 
 #include <sys/stat.h>
 #include <sys/thread.h>
 #include <sys/mutex.h>
+#include <sys/cond.h>
+#include <sys/sem.h>
+#include <sys/systime.h>
 #include <sys/memory.h>
 #include <sys/process.h>
 #include <sysutil/osk.h>
@@ -76,6 +80,12 @@ struct romi_http
     int used;
     uint64_t size;
     uint64_t offset;
+    uint32_t low_speed_limit;
+    uint32_t low_speed_time;
+    int range_ignored;  // the last request resumed at an offset the server didn't honour
+    int proxy_dropped;  // the last request failed on the proxy, which is now bypassed
+    int redirected;     // the handle goes straight to a cached redirect target
+    char url[1024];     // as requested, the key of the redirect cache
     CURL *curl;
 };
 
@@ -97,6 +107,8 @@ extern Config config;
 int proxy_failed = 0;
 
 static sys_mutex_t g_dialog_lock;
+static sys_cond_t g_dialog_cond;
+static romi_mutex g_http_lock;
 static uint32_t cpu_temp_c[2];
 
 static int g_ok_button;
@@ -118,7 +130,12 @@ static uint16_t g_ime_title[SCE_IME_DIALOG_MAX_TITLE_LENGTH];
 static uint16_t g_ime_text[SCE_IME_DIALOG_MAX_TEXT_LENGTH];
 static uint16_t g_ime_input[SCE_IME_DIALOG_MAX_TEXT_LENGTH + 1];
 
-static romi_http g_http[4];
+static romi_http g_http[ROMI_QUEUE_MAX_CONCURRENT_LIMIT + 1];
+
+// Connection cache, DNS and TLS sessions shared by every easy handle, so
+// back to back requests to the same mirror reuse an already warm connection
+static CURLSH* g_curl_share = NULL;
+static romi_mutex g_curl_share_lock[CURL_LOCK_DATA_LAST];
 static t_tex_buttons tex_buttons;
 
 static MREADER *mem_reader;
@@ -333,6 +350,20 @@ int romi_dialog_unlock(void)
     return (res == 0);
 }
 
+void romi_dialog_wait(void)
+{
+    int res = sysCondWait(g_dialog_cond, 0);
+    if (res != 0)
+    {
+        LOG("dialog wait failed error=0x%08x", res);
+    }
+}
+
+void romi_dialog_wake(void)
+{
+    sysCondBroadcast(g_dialog_cond);
+}
+
 static int convert_to_utf16(const char* utf8, uint16_t* utf16, uint32_t available)
 {
     int count = 0;
@@ -676,6 +707,40 @@ static void sys_callback(uint64_t status, uint64_t param, void* userdata)
     }
 }
 
+static void romi_curl_share_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr)
+{
+    romi_mutex_lock(&g_curl_share_lock[data]);
+}
+
+static void romi_curl_share_unlock(CURL* handle, curl_lock_data data, void* userptr)
+{
+    romi_mutex_unlock(&g_curl_share_lock[data]);
+}
+
+static void romi_curl_share_init(void)
+{
+    g_curl_share = curl_share_init();
+    if (!g_curl_share)
+    {
+        LOG("curl_share_init failed, connections won't be reused across requests");
+        return;
+    }
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        romi_mutex_create(&g_curl_share_lock[i], "curlshare");
+
+    curl_share_setopt(g_curl_share, CURLSHOPT_LOCKFUNC, romi_curl_share_lock);
+    curl_share_setopt(g_curl_share, CURLSHOPT_UNLOCKFUNC, romi_curl_share_unlock);
+    curl_share_setopt(g_curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(g_curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    // connection sharing needs libcurl 7.57+, DNS and TLS session reuse still help without it
+    if (curl_share_setopt(g_curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT) != CURLSHE_OK)
+    {
+        LOG("CURL: connection cache sharing not supported");
+    }
+}
+
 void romi_start(void)
 {
     romi_start_debug_log();
@@ -685,6 +750,8 @@ void romi_start(void)
     LOG("initializing Network");
     sysModuleLoad(SYSMODULE_NET);
     curl_global_init(CURL_GLOBAL_ALL);
+    romi_curl_share_init();
+    romi_redirect_init();
 
     sys_mutex_attr_t mutex_attr;
     mutex_attr.attr_protocol = SYS_MUTEX_PROTOCOL_FIFO;
@@ -698,6 +765,18 @@ void romi_start(void)
         LOG("mutex create error (%x)", ret);
     }
 
+    sys_cond_attr_t cond_attr;
+    memset(&cond_attr, 0, sizeof(cond_attr));
+    cond_attr.attr_pshared = SYS_COND_ATTR_PSHARED;
+    strcpy(cond_attr.name, "dialog");
+
+    ret = sysCondCreate(&g_dialog_cond, g_dialog_lock, &cond_attr);
+    if (ret != 0) {
+        LOG("cond create error (%x)", ret);
+    }
+
+    romi_mutex_create(&g_http_lock, "http");
+
     romi_queue_init();
 
     sysUtilGetSystemParamInt(SYSUTIL_SYSTEMPARAM_ID_ENTER_BUTTON_ASSIGN, &ret);
@@ -801,6 +880,12 @@ void romi_end(void)
 
     romi_queue_shutdown();
 
+    if (g_curl_share)
+    {
+        curl_share_cleanup(g_curl_share);
+        for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+            romi_mutex_destroy(&g_curl_share_lock[i]);
+    }
     curl_global_cleanup();
     romi_stop_debug_log();
 
@@ -811,7 +896,9 @@ void romi_end(void)
 
 	ya2d_deinit();
 
+    sysCondDestroy(g_dialog_cond);
     sysMutexDestroy(g_dialog_lock);
+    romi_mutex_destroy(&g_http_lock);
 
 #ifdef ROMI_ENABLE_LOGGING
     sysProcessExitSpawn2("/dev_hdd0/game/PSL145310/RELOAD.SELF", NULL, NULL, NULL, 0, 1001, SYS_PROCESS_SPAWN_STACK_SIZE_1M);
@@ -853,6 +940,20 @@ uint64_t romi_get_free_space(void)
     return (freeSize);
 }
 
+uint64_t romi_get_device_free_space(const char* path)
+{
+    u32 blockSize;
+    u64 freeBlocks;
+
+    if (sysFsGetFreeSize(path, &blockSize, &freeBlocks) != 0)
+    {
+        LOG("failed to get free space of %s", path);
+        return 0;
+    }
+
+    return freeBlocks * blockSize;
+}
+
 const char* romi_get_config_folder(void)
 {
     return ROMI_APP_FOLDER;
@@ -902,6 +1003,11 @@ uint32_t romi_time_msec()
     return ya2d_millis();
 }
 
+uint64_t romi_time_usec(void)
+{
+    return sysGetSystemTime();
+}
+
 void romi_thread_exit()
 {
 	sysThreadExit(0);
@@ -921,7 +1027,7 @@ void romi_start_thread(const char* name, romi_thread_entry* start)
     }
 }
 
-void romi_start_thread_arg(const char* name, romi_thread_entry_arg* start, void* arg)
+int romi_start_thread_arg(const char* name, romi_thread_entry_arg* start, void* arg)
 {
 	s32 ret;
 	sys_ppu_thread_t id;
@@ -932,7 +1038,9 @@ void romi_start_thread_arg(const char* name, romi_thread_entry_arg* start, void*
     if (ret != 0)
     {
         LOG("failed to start %s thread", name);
+        return 0;
     }
+    return 1;
 }
 
 void romi_sleep(uint32_t msec)
@@ -940,6 +1048,70 @@ void romi_sleep(uint32_t msec)
     usleep(msec * 1000);
 }
 
+int romi_mutex_create(romi_mutex* mutex, const char* name)
+{
+    sys_mutex_attr_t mutex_attr;
+    memset(&mutex_attr, 0, sizeof(mutex_attr));
+    mutex_attr.attr_protocol = SYS_MUTEX_PROTOCOL_FIFO;
+    mutex_attr.attr_recursive = SYS_MUTEX_ATTR_NOT_RECURSIVE;
+    mutex_attr.attr_pshared = SYS_MUTEX_ATTR_NOT_PSHARED;
+    mutex_attr.attr_adaptive = SYS_MUTEX_ATTR_ADAPTIVE;
+    strncpy(mutex_attr.name, name, sizeof(mutex_attr.name) - 1);
+
+    int ret = sysMutexCreate((sys_mutex_t*)mutex, &mutex_attr);
+    if (ret != 0)
+    {
+        LOG("mutex %s create error (%x)", name, ret);
+    }
+    return (ret == 0);
+}
+
+void romi_mutex_destroy(romi_mutex* mutex)
+{
+    sysMutexDestroy(*mutex);
+}
+
+void romi_mutex_lock(romi_mutex* mutex)
+{
+    sysMutexLock(*mutex, 0);
+}
+
+void romi_mutex_unlock(romi_mutex* mutex)
+{
+    sysMutexUnlock(*mutex);
+}
+
+int romi_sema_create(romi_sema* sema, const char* name, uint32_t count)
+{
+    sys_sem_attr_t sem_attr;
+    memset(&sem_attr, 0, sizeof(sem_attr));
+    sem_attr.attr_protocol = SYS_SEM_ATTR_PROTOCOL;
+    sem_attr.attr_pshared = SYS_SEM_ATTR_PSHARED;
+    strncpy(sem_attr.name, name, sizeof(sem_attr.name) - 1);
+
+    int ret = sysSemCreate((sys_sem_t*)sema, &sem_attr, (s32)count, 0x7fffffff);
+    if (ret != 0)
+    {
+        LOG("semaphore %s create error (%x)", name, ret);
+    }
+    return (ret == 0);
+}
+
+void romi_sema_destroy(romi_sema* sema)
+{
+    sysSemDestroy(*sema);
+}
+
+void romi_sema_wait(romi_sema* sema)
+{
+    sysSemWait(*sema, 0);
+}
+
+void romi_sema_post(romi_sema* sema)
+{
+    sysSemPost(*sema, 1);
+}
+
 int romi_load(const char* name, void* data, uint32_t max)
 {
     FILE* fd = fopen(name, "rb");
@@ -1385,6 +1557,9 @@ void romi_curl_init(CURL *curl)
     // Mimic wget headers for HTTP download compatibility
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "Wget/1.24");
 
+    if (g_curl_share)
+        curl_easy_setopt(curl, CURLOPT_SHARE, g_curl_share);
+
     // Match wget's minimal headers
     if (!headers)
     {
@@ -1513,15 +1688,27 @@ romi_http* romi_http_get(const char* url, const char* content, uint64_t offset,
         return NULL;
     }
 
+    // Queue workers call this concurrently, so slot claiming must be atomic
     romi_http* http = NULL;
-    for (size_t i = 0; i < 4; i++)
+    romi_mutex_lock(&g_http_lock);
+    for (size_t i = 0; i < ROMI_COUNTOF(g_http); i++)
     {
         if (g_http[i].used == 0)
         {
             http = &g_http[i];
+            http->used = 1;
             break;
         }
     }
+    romi_mutex_unlock(&g_http_lock);
+
+    if (http)
+    {
+        http->low_speed_limit = 0;
+        http->low_speed_time = 0;
+        http->range_ignored = 0;
+        http->proxy_dropped = 0;
+    }
 
     if (!http)
     {
@@ -1533,9 +1720,19 @@ romi_http* romi_http_get(const char* url, const char* content, uint64_t offset,
     if (!http->curl)
     {
         LOG("curl init error");
+        http->used = 0;
         return NULL;
     }
-    curl_easy_setopt(http->curl, CURLOPT_URL, url);
+    romi_strncpy(http->url, sizeof(http->url), url);
+
+    char effective[1024];
+    http->redirected = romi_redirect_lookup(url, effective, sizeof(effective));
+    if (http->redirected)
+    {
+        LOG("using cached redirect %s", effective);
+    }
+
+    curl_easy_setopt(http->curl, CURLOPT_URL, http->redirected ? effective : url);
 
     // NOTE: No Referer header - plain curl doesn't send it
 
@@ -1548,10 +1745,57 @@ romi_http* romi_http_get(const char* url, const char* content, uint64_t offset,
         curl_easy_setopt(http->curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t) offset);
     }
 
-    http->used = 1;
     return(http);
 }
 
+// Remembers where a request's redirects led, or drops a cached target that failed
+static void romi_http_update_redirect(romi_http* http, CURLcode res)
+{
+    if (res != CURLE_OK)
+    {
+        // a cancel or a full disk says nothing about the target
+        if (http->redirected && res != CURLE_ABORTED_BY_CALLBACK && res != CURLE_WRITE_ERROR)
+        {
+            LOG("cached redirect for %s failed, resolving it again next time", http->url);
+            romi_redirect_forget(http->url);
+        }
+        return;
+    }
+
+    long redirects = 0;
+    char* effective = NULL;
+    curl_easy_getinfo(http->curl, CURLINFO_REDIRECT_COUNT, &redirects);
+    curl_easy_getinfo(http->curl, CURLINFO_EFFECTIVE_URL, &effective);
+    if (redirects <= 0 || !effective)
+        return;
+
+    char target[1024];
+    romi_strncpy(target, sizeof(target), effective);
+    romi_redirect_store(http->url, target);
+
+    // the GET that follows a HEAD on this handle can skip the chain as well
+    curl_easy_setopt(http->curl, CURLOPT_URL, target);
+    http->redirected = 1;
+}
+
+// A proxy that can't be reached is dropped for the rest of the session. The
+// request still fails: the caller opens a new handle with romi_http_get, which
+// connects directly and keeps the resume offset and the cached redirect.
+// Returns 1 if res was the proxy failing, which says nothing about the target.
+static int romi_http_check_proxy(romi_http* http, CURLcode res)
+{
+    http->proxy_dropped = 0;
+    if ((res == CURLE_COULDNT_RESOLVE_PROXY || res == CURLE_COULDNT_CONNECT) &&
+        config.proxy_url[0] && !proxy_failed)
+    {
+        LOG("CURL: Proxy connection failed (%s), falling back to direct", curl_easy_strerror(res));
+        proxy_failed = 1;
+        http->proxy_dropped = 1;
+        return 1;
+    }
+    return 0;
+}
+
 int romi_http_response_length(romi_http* http, int64_t* length)
 {
     CURLcode res;
@@ -1563,44 +1807,13 @@ int romi_http_response_length(romi_http* http, int64_t* length)
     // Perform the request
     res = curl_easy_perform(http->curl);
 
-    if(res != CURLE_OK)
-    {
-        // Check if error is proxy-related
-        if ((res == CURLE_COULDNT_RESOLVE_PROXY ||
-             res == CURLE_COULDNT_CONNECT) &&
-            config.proxy_url[0] && !proxy_failed)
-        {
-            LOG("CURL: Proxy connection failed (%s), falling back to direct", curl_easy_strerror(res));
-            proxy_failed = 1;
-
-            // Get the URL before cleanup
-            char *url = NULL;
-            curl_easy_getinfo(http->curl, CURLINFO_EFFECTIVE_URL, &url);
-
-            // Cleanup and retry without proxy
-            curl_easy_cleanup(http->curl);
-            http->curl = romi_curl_init_throughput(1);
-            if (!http->curl)
-            {
-                LOG("curl init error on retry");
-                return 0;
-            }
+    if (!romi_http_check_proxy(http, res))
+        romi_http_update_redirect(http, res);
 
-            // Re-apply request configuration
-            if (url)
-                curl_easy_setopt(http->curl, CURLOPT_URL, url);
-            curl_easy_setopt(http->curl, CURLOPT_NOBODY, 1L);
-            curl_easy_setopt(http->curl, CURLOPT_NOPROGRESS, 1L);
-
-            // Retry request
-            res = curl_easy_perform(http->curl);
-        }
-
-        if(res != CURLE_OK)
-        {
-            LOG("curl_easy_perform() failed: %s", curl_easy_strerror(res));
-            return 0;
-        }
+    if (res != CURLE_OK)
+    {
+        LOG("curl_easy_perform() failed: %s", curl_easy_strerror(res));
+        return 0;
     }
 
     long status = 0;
@@ -1614,10 +1827,26 @@ int romi_http_response_length(romi_http* http, int64_t* length)
     return 1;
 }
 
-int romi_http_read(romi_http* http, void* write_func, void* write_data, void* xferinfo_func)
+void romi_http_set_stall_timeout(romi_http* http, uint32_t min_speed, uint32_t seconds)
+{
+    http->low_speed_limit = min_speed;
+    http->low_speed_time = seconds;
+}
+
+static void romi_http_apply_stall_timeout(romi_http* http)
+{
+    if (http->low_speed_time == 0)
+        return;
+
+    curl_easy_setopt(http->curl, CURLOPT_LOW_SPEED_LIMIT, (long)http->low_speed_limit);
+    curl_easy_setopt(http->curl, CURLOPT_LOW_SPEED_TIME, (long)http->low_speed_time);
+}
+
+int romi_http_read(romi_http* http, void* write_func, void* write_data, void* xferinfo_func, void* xferinfo_data)
 {
     CURLcode res;
 
+    romi_http_apply_stall_timeout(http);
     curl_easy_setopt(http->curl, CURLOPT_NOBODY, 0L);
     // The function that will be used to write the data
     curl_easy_setopt(http->curl, CURLOPT_WRITEFUNCTION, write_func);
@@ -1626,87 +1855,74 @@ int romi_http_read(romi_http* http, void* write_func, void* write_data, void* xf
 
     if (xferinfo_func)
     {
-        /* pass the struct pointer into the xferinfo function */
+        /* pass the transfer context into the xferinfo function */
         curl_easy_setopt(http->curl, CURLOPT_XFERINFOFUNCTION, xferinfo_func);
-        curl_easy_setopt(http->curl, CURLOPT_XFERINFODATA, NULL);
+        curl_easy_setopt(http->curl, CURLOPT_XFERINFODATA, xferinfo_data);
         curl_easy_setopt(http->curl, CURLOPT_NOPROGRESS, 0L);
     }
 
     // Perform the request
     res = curl_easy_perform(http->curl);
 
-    if(res != CURLE_OK)
+    // curl gives up before the body when a 200 comes back for a Range request
+    http->range_ignored = (res == CURLE_RANGE_ERROR);
+
+    if (!romi_http_check_proxy(http, res))
+        romi_http_update_redirect(http, res);
+
+    if (res != CURLE_OK)
     {
-        // Check if error is proxy-related
-        if ((res == CURLE_COULDNT_RESOLVE_PROXY ||
-             res == CURLE_COULDNT_CONNECT) &&
-            config.proxy_url[0] && !proxy_failed)
-        {
-            LOG("CURL: Proxy connection failed (%s), falling back to direct", curl_easy_strerror(res));
-            proxy_failed = 1;
+        LOG("curl_easy_perform() failed: %s", curl_easy_strerror(res));
+        return 0;
+    }
 
-            // Get the URL before cleanup
-            char *url = NULL;
-            curl_easy_getinfo(http->curl, CURLINFO_EFFECTIVE_URL, &url);
+    return 1;
+}
 
-            // Cleanup and retry without proxy
-            curl_easy_cleanup(http->curl);
-            http->curl = romi_curl_init_throughput(1);
-            if (!http->curl)
-            {
-                LOG("curl init error on retry");
-                return 0;
-            }
+int romi_http_range_ignored(romi_http* http)
+{
+    return http->range_ignored;
+}
 
-            // Re-apply request configuration
-            if (url)
-                curl_easy_setopt(http->curl, CURLOPT_URL, url);
-            curl_easy_setopt(http->curl, CURLOPT_NOBODY, 0L);
-            curl_easy_setopt(http->curl, CURLOPT_WRITEFUNCTION, write_func);
-            curl_easy_setopt(http->curl, CURLOPT_WRITEDATA, write_data);
-            if (xferinfo_func)
-            {
-                curl_easy_setopt(http->curl, CURLOPT_XFERINFOFUNCTION, xferinfo_func);
-                curl_easy_setopt(http->curl, CURLOPT_XFERINFODATA, NULL);
-                curl_easy_setopt(http->curl, CURLOPT_NOPROGRESS, 0L);
-            }
+int romi_http_proxy_dropped(romi_http* http)
+{
+    return http->proxy_dropped;
+}
 
-            // Retry request
-            res = curl_easy_perform(http->curl);
-        }
+static uint32_t romi_curl_msec(double seconds)
+{
+    return seconds > 0 ? (uint32_t)(seconds * 1000.0) : 0;
+}
 
-        if(res != CURLE_OK)
-        {
-            LOG("curl_easy_perform() failed: %s", curl_easy_strerror(res));
-            return 0;
-        }
-    }
+void romi_http_get_metrics(romi_http* http, romi_http_metrics* metrics)
+{
+    double dns = 0, connect = 0, tls = 0, pretransfer = 0, starttransfer = 0, total = 0, bytes = 0;
+    long redirects = 0;
+    char* ip = NULL;
 
-    // Diagnostic logging to identify rate limiting vs PS3 hardware issues
-    char *effective_url = NULL;
-    long redirect_count = 0;
-    double total_time = 0;
-    double download_speed = 0;
-    char *primary_ip = NULL;
-
-    curl_easy_getinfo(http->curl, CURLINFO_EFFECTIVE_URL, &effective_url);
-    curl_easy_getinfo(http->curl, CURLINFO_REDIRECT_COUNT, &redirect_count);
-    curl_easy_getinfo(http->curl, CURLINFO_TOTAL_TIME, &total_time);
-    curl_easy_getinfo(http->curl, CURLINFO_SPEED_DOWNLOAD, &download_speed);
-    curl_easy_getinfo(http->curl, CURLINFO_PRIMARY_IP, &primary_ip);
-
-    LOG("=== Download Diagnostics ===");
-    LOG("Effective URL: %s", effective_url ? effective_url : "unknown");
-    LOG("Redirects: %ld", redirect_count);
-    LOG("Server IP: %s", primary_ip ? primary_ip : "unknown");
-    LOG("Total time: %.2f seconds", total_time);
-    LOG("CURL reported speed: %.2f KB/s (%.2f MB/s)",
-        download_speed / 1024.0, download_speed / (1024.0 * 1024.0));
-    LOG("Expected for file size: %.2f KB/s",
-        total_time > 0 ? (http->size / 1024.0) / total_time : 0);
-    LOG("===========================");
+    memset(metrics, 0, sizeof(*metrics));
 
-    return 1;
+    // curl reports every phase as time since the start of the request
+    curl_easy_getinfo(http->curl, CURLINFO_NAMELOOKUP_TIME, &dns);
+    curl_easy_getinfo(http->curl, CURLINFO_CONNECT_TIME, &connect);
+    curl_easy_getinfo(http->curl, CURLINFO_APPCONNECT_TIME, &tls);
+    curl_easy_getinfo(http->curl, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+    curl_easy_getinfo(http->curl, CURLINFO_STARTTRANSFER_TIME, &starttransfer);
+    curl_easy_getinfo(http->curl, CURLINFO_TOTAL_TIME, &total);
+    curl_easy_getinfo(http->curl, CURLINFO_SIZE_DOWNLOAD, &bytes);
+    curl_easy_getinfo(http->curl, CURLINFO_REDIRECT_COUNT, &redirects);
+    curl_easy_getinfo(http->curl, CURLINFO_PRIMARY_IP, &ip);
+
+    metrics->dns_msec = romi_curl_msec(dns);
+    metrics->connect_msec = romi_curl_msec(connect - dns);
+    // zero for plain http and for connections reused from the share handle
+    metrics->tls_msec = tls > connect ? romi_curl_msec(tls - connect) : 0;
+    metrics->ttfb_msec = romi_curl_msec(starttransfer - pretransfer);
+    metrics->total_msec = romi_curl_msec(total);
+    metrics->redirects = (uint32_t)redirects;
+    metrics->bytes = bytes > 0 ? (uint64_t)bytes : 0;
+    metrics->proxy = config.proxy_url[0] && !proxy_failed;
+    romi_strncpy(metrics->ip, sizeof(metrics->ip), ip ? ip : "");
 }
 
 void romi_http_close(romi_http* http)
@@ -1717,6 +1933,58 @@ void romi_http_close(romi_http* http)
     http->used = 0;
 }
 
+typedef struct {
+    uint32_t received;
+    uint32_t max_bytes;
+} romi_probe;
+
+static size_t romi_probe_write(void* buffer, size_t size, size_t nmemb, void* stream)
+{
+    romi_probe* probe = stream;
+    ROMI_UNUSED(buffer);
+
+    probe->received += size * nmemb;
+
+    // servers that ignore the Range header would send the whole file
+    return probe->received >= probe->max_bytes ? 0 : size * nmemb;
+}
+
+int romi_http_probe(const char* url, uint32_t max_bytes, uint32_t timeout_msec, uint32_t* connect_msec, uint32_t* bytes_per_sec)
+{
+    romi_http* http = romi_http_get(url, NULL, 0, 0);
+    if (!http)
+        return 0;
+
+    char range[32];
+    romi_snprintf(range, sizeof(range), "0-%u", max_bytes - 1);
+
+    romi_probe probe = { 0, max_bytes };
+    uint32_t start = romi_time_msec();
+
+    curl_easy_setopt(http->curl, CURLOPT_RANGE, range);
+    curl_easy_setopt(http->curl, CURLOPT_TIMEOUT_MS, (long)timeout_msec);
+    curl_easy_setopt(http->curl, CURLOPT_WRITEFUNCTION, romi_probe_write);
+    curl_easy_setopt(http->curl, CURLOPT_WRITEDATA, &probe);
+
+    CURLcode res = curl_easy_perform(http->curl);
+    uint32_t elapsed = romi_time_msec() - start;
+
+    double connect_time = 0;
+    curl_easy_getinfo(http->curl, CURLINFO_CONNECT_TIME, &connect_time);
+    romi_http_close(http);
+
+    int ok = (res == CURLE_OK || (res == CURLE_WRITE_ERROR && probe.received >= max_bytes)) && probe.received > 0;
+    if (!ok)
+    {
+        LOG("probe of %s failed: %s", url, curl_easy_strerror(res));
+        return 0;
+    }
+
+    *connect_msec = (uint32_t)(connect_time * 1000);
+    *bytes_per_sec = elapsed > 0 ? (uint32_t)((uint64_t)probe.received * 1000 / elapsed) : probe.received;
+    return 1;
+}
+
 int romi_mkdirs(const char* dir)
 {
     char path[256];
@@ -1795,6 +2063,18 @@ void* romi_create(const char* path)
     return (void*)fd;
 }
 
+int romi_truncate(const char* path, uint64_t size)
+{
+    s32 ret = sysLv2FsTruncate(path, size);
+    if (ret != 0)
+    {
+        LOG("cannot truncate %s to %llu bytes (0x%08x)", path, size, ret);
+        return 0;
+    }
+
+    return 1;
+}
+
 void* romi_open(const char* path)
 {
     LOG("fopen open rb on %s", path);
@@ -1839,6 +2119,17 @@ int romi_read(void* f, void* buffer, uint32_t size)
     return read;
 }
 
+int romi_seek(void* f, uint64_t offset)
+{
+    int err = fseeko((FILE*)f, (off_t)offset, SEEK_SET);
+    if (err != 0)
+    {
+        LOG("fseek to %llu failed 0x%08x", offset, err);
+        return 0;
+    }
+    return 1;
+}
+
 int romi_write(void* f, const void* buffer, uint32_t size)
 {
 //    LOG("asking to write %u bytes", size);
@@ -1,46 +1,247 @@
 #include "romi_queue.h"
 #include "romi.h"
 #include "romi_download.h"
+#include "romi_bandwidth.h"
+#include "romi_mirror.h"
+#include "romi_metrics.h"
+#include "romi_journal.h"
+#include "romi_schedule.h"
+#include "romi_space.h"
+#include "romi_devices.h"
+#include "romi_thermal.h"
 #include "romi_dialog.h"
 #include <string.h>
 #include <stdlib.h>
 #include <mini18n.h>
 
 static DownloadQueue g_download_queue = {0};
-static int cancelled = 0;
 
-static void romi_queue_start_next(void);
+// Hand-off between the fetch workers and the single install worker, guarded by the dialog lock
+static DownloadQueueEntry* g_install_queue[ROMI_QUEUE_INSTALL_BACKLOG];
+static uint32_t g_install_head = 0;
+static uint32_t g_install_count = 0;
+static int g_install_busy = 0;
+
+// Scratch lists handed to the scheduler, only used with the dialog lock held
+static RomiScheduleItem g_schedule_pending[ROMI_QUEUE_MAX_ENTRIES];
+static uint32_t g_schedule_index[ROMI_QUEUE_MAX_ENTRIES];
+static RomiScheduleItem g_schedule_active[ROMI_QUEUE_MAX_CONCURRENT_LIMIT];
+// Sorted items of the live entries, for the duplicate checks of a bulk add
+static const DbItem* g_queued_items[ROMI_QUEUE_MAX_ENTRIES];
+
+static uint32_t g_journal_next_id = 0;
+static int g_queue_restored = 0;
+// set once at shutdown, idle workers wake up and exit
+static int g_queue_stopping = 0;
+// every worker posts it on its way out, so shutdown can wait for all of them
+static romi_sema g_workers_exited;
+static int g_workers_joinable = 0;
+static uint32_t g_worker_count = 0;
+
+static void romi_queue_prepare(DownloadQueueEntry* entry);
 static void romi_queue_download_worker(void* arg);
-static void queue_progress_callback(const char* status, uint64_t downloaded, uint64_t total);
+static void romi_queue_install_worker(void* arg);
+static void queue_progress_callback(RomiTransfer* transfer, const char* status, uint64_t downloaded, uint64_t total);
 
 void romi_queue_init(void)
 {
     memset(&g_download_queue, 0, sizeof(g_download_queue));
     g_download_queue.max_concurrent = ROMI_QUEUE_MAX_CONCURRENT_DEFAULT;
-    cancelled = 0;
+    g_install_head = 0;
+    g_install_count = 0;
+    g_install_busy = 0;
+    g_queue_stopping = 0;
+    romi_bandwidth_init();
+    romi_space_init();
+    romi_mirror_init();
+    romi_metrics_init();
+    romi_journal_init();
+
+    g_workers_joinable = romi_sema_create(&g_workers_exited, "queue_workers", 0);
+    if (!g_workers_joinable) {
+        LOG("cannot create the queue semaphore, shutdown won't wait for the workers");
+    }
+
+    // The workers live as long as the app and sleep on the dialog condition
+    // while there is nothing to do, no thread is created per download
+    g_worker_count = 0;
+    for (uint32_t i = 0; i < g_download_queue.max_concurrent; i++)
+        g_worker_count += romi_start_thread_arg("download_worker", romi_queue_download_worker, NULL) ? 1 : 0;
+    g_worker_count += romi_start_thread_arg("install_worker", romi_queue_install_worker, NULL) ? 1 : 0;
+}
+
+static void romi_queue_worker_exit(void)
+{
+    if (g_workers_joinable)
+        romi_sema_post(&g_workers_exited);
+    romi_thread_exit();
 }
 
 void romi_queue_shutdown(void)
 {
     romi_dialog_lock();
 
-    DownloadQueueEntry* entry = g_download_queue.head;
-    while (entry) {
-        if (entry->status == DownloadStatusDownloading) {
-            cancelled = 1;
-            romi_download_cancel();
+    // the journal keeps everything as it was before the cancels below
+    for (uint32_t i = 0; i < g_download_queue.count; i++) {
+        DownloadQueueEntry* entry = g_download_queue.order[i];
+        uint64_t downloaded = romi_progress_downloaded(&entry->progress);
+        if (entry->status == DownloadStatusDownloading && downloaded > entry->journaled) {
+            romi_journal_offset(entry->journal_id, downloaded);
+        }
+    }
+    romi_journal_close();
+
+    // an interrupted extraction keeps its temp file too, the next session installs it again
+    for (uint32_t i = 0; i < g_download_queue.count; i++) {
+        DownloadQueueEntry* entry = g_download_queue.order[i];
+        if (entry->status == DownloadStatusDownloading || entry->status == DownloadStatusExtracting) {
+            entry->transfer.keep_partial = 1;
+            romi_download_cancel(&entry->transfer);
         }
-        DownloadQueueEntry* next = entry->next;
-        romi_free(entry);
-        entry = next;
     }
 
-    g_download_queue.head = NULL;
-    g_download_queue.tail = NULL;
-    g_download_queue.count = 0;
-    g_download_queue.active_count = 0;
+    g_queue_stopping = 1;
+    romi_dialog_wake();
+
+    romi_dialog_unlock();
+
+    // romi_end tears down the curl share, the dialog condition and the mutexes
+    // next, none of the workers may still be using them
+    if (g_workers_joinable) {
+        for (uint32_t i = 0; i < g_worker_count; i++)
+            romi_sema_wait(&g_workers_exited);
+        romi_sema_destroy(&g_workers_exited);
+        g_workers_joinable = 0;
+        LOG("queue workers stopped");
+    }
+
+    // reports only save when the mirror order changes, keep the latest speeds too
+    romi_mirror_save();
+}
+
+// Takes an entry off the free list, carving a new slab when it runs dry; called with the dialog lock held
+static DownloadQueueEntry* romi_queue_alloc_entry(void)
+{
+    if (!g_download_queue.free_list) {
+        if (g_download_queue.slab_count == ROMI_COUNTOF(g_download_queue.slabs))
+            return NULL;
+
+        DownloadQueueEntry* slab = (DownloadQueueEntry*)romi_malloc(ROMI_QUEUE_SLAB_ENTRIES * sizeof(DownloadQueueEntry));
+        if (!slab)
+            return NULL;
+        g_download_queue.slabs[g_download_queue.slab_count++] = slab;
+
+        for (uint32_t i = 0; i < ROMI_QUEUE_SLAB_ENTRIES; i++) {
+            slab[i].next_free = g_download_queue.free_list;
+            g_download_queue.free_list = &slab[i];
+        }
+    }
+
+    DownloadQueueEntry* entry = g_download_queue.free_list;
+    g_download_queue.free_list = entry->next_free;
+    return entry;
+}
+
+// Adds a new pending entry at the end of the queue, called with the dialog lock held
+static DownloadQueueEntry* romi_queue_append(DbItem* item, uint32_t journal_id, uint8_t priority)
+{
+    if (g_download_queue.count == ROMI_QUEUE_MAX_ENTRIES)
+        return NULL;
+
+    DownloadQueueEntry* entry = romi_queue_alloc_entry();
+    if (!entry)
+        return NULL;
+
+    memset(entry, 0, sizeof(DownloadQueueEntry));
+    entry->item = item;
+    entry->status = DownloadStatusPending;
+    entry->priority = priority;
+    entry->journal_id = journal_id;
+    int mirror = romi_mirror_best(item->platform);
+    entry->host = romi_schedule_host(mirror >= 0 ? romi_mirror_base(item->platform, (uint32_t)mirror) : NULL, item->url);
+    romi_progress_reset(&entry->progress, _("Pending..."));
+
+    // the menu reads the count without the lock, the slot must be filled before it counts
+    g_download_queue.order[g_download_queue.count] = entry;
+    __sync_synchronize();
+    g_download_queue.count++;
+
+    return entry;
+}
+
+// Copies the live queue for romi_journal_compact, called with the dialog lock held.
+// NULL if there is nothing to write or another compaction is running
+static RomiJournalEntry* romi_queue_snapshot_journal(uint32_t* count)
+{
+    RomiJournalEntry* entries = romi_malloc(g_download_queue.count * sizeof(RomiJournalEntry) + 1);
+    if (!entries)
+        return NULL;
+
+    if (!romi_journal_begin_compaction()) {
+        romi_free(entries);
+        return NULL;
+    }
+
+    *count = 0;
+    for (uint32_t i = 0; i < g_download_queue.count; i++) {
+        DownloadQueueEntry* entry = g_download_queue.order[i];
+        // finished downloads only stay in the list until the next start
+        if (entry->status == DownloadStatusCompleted)
+            continue;
+
+        RomiJournalEntry* j = &entries[(*count)++];
+        j->id = entry->journal_id;
+        j->platform = entry->item->platform;
+        j->priority = entry->priority;
+        j->status = entry->status;
+        j->offset = entry->journaled;
+        romi_strncpy(j->url, sizeof(j->url), entry->item->url);
+    }
+
+    return entries;
+}
+
+// Writes a snapshot taken by romi_queue_snapshot_journal, without the dialog lock
+static void romi_queue_write_journal(RomiJournalEntry* entries, uint32_t count)
+{
+    if (!entries)
+        return;
+
+    romi_journal_compact(entries, count);
+    romi_free(entries);
+}
+
+// Rewrites the journal once enough records piled up, called by the workers
+// with the dialog lock held. The file is written with the lock released so the
+// UI keeps rendering; returns 1 if it was, the queue may have changed meanwhile
+static int romi_queue_compact_journal(void)
+{
+    if (!romi_journal_needs_compaction())
+        return 0;
+
+    uint32_t count;
+    RomiJournalEntry* entries = romi_queue_snapshot_journal(&count);
+    if (!entries)
+        return 0;
 
     romi_dialog_unlock();
+    romi_queue_write_journal(entries, count);
+    romi_dialog_lock();
+    return 1;
+}
+
+// Every status change goes through here so the journal sees it, called with the dialog lock held
+static void romi_queue_set_status(DownloadQueueEntry* entry, DownloadStatus status)
+{
+    entry->status = status;
+    romi_journal_status(entry->journal_id, status);
+}
+
+// Space freed or used outside the queue shows up when the user queues more
+static void romi_queue_refresh_space(void)
+{
+    romi_space_refresh(romi_get_temp_folder());
+    romi_space_refresh(romi_devices_get_base_path());
 }
 
 int romi_queue_add(DbItem* item)
@@ -48,141 +249,314 @@ int romi_queue_add(DbItem* item)
     if (!item)
         return 0;
 
+    romi_queue_refresh_space();
     romi_dialog_lock();
 
-    DownloadQueueEntry* entry = (DownloadQueueEntry*)romi_malloc(sizeof(DownloadQueueEntry));
+    DownloadQueueEntry* entry = romi_queue_append(item, ++g_journal_next_id, ROMI_PRIORITY_NORMAL);
     if (!entry) {
         romi_dialog_unlock();
         return 0;
     }
+    romi_journal_add(entry->journal_id, item, entry->priority);
+    romi_dialog_wake();
 
-    memset(entry, 0, sizeof(DownloadQueueEntry));
-    entry->item = item;
-    entry->status = DownloadStatusPending;
-    entry->thread_id = 0;
-    entry->next = NULL;
-    romi_strncpy(entry->status_text, sizeof(entry->status_text), _("Pending..."));
+    romi_dialog_unlock();
+    return 1;
+}
 
-    if (g_download_queue.tail) {
-        g_download_queue.tail->next = entry;
-    } else {
-        g_download_queue.head = entry;
+static int romi_queue_compare_items(const void* a, const void* b)
+{
+    const DbItem* x = *(const DbItem* const*)a;
+    const DbItem* y = *(const DbItem* const*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Fills g_queued_items with every item not yet completed, called with the dialog lock held
+static uint32_t romi_queue_sort_items(void)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < g_download_queue.count; i++) {
+        DownloadQueueEntry* entry = g_download_queue.order[i];
+        if (entry->status != DownloadStatusCompleted)
+            g_queued_items[count++] = entry->item;
     }
-    g_download_queue.tail = entry;
-    g_download_queue.count++;
+    qsort(g_queued_items, count, sizeof(g_queued_items[0]), romi_queue_compare_items);
+    return count;
+}
 
-    if (g_download_queue.active_count < g_download_queue.max_concurrent) {
-        entry->status = DownloadStatusDownloading;
-        entry->start_time = romi_time_msec();
-        romi_strncpy(entry->status_text, sizeof(entry->status_text), _("Starting..."));
-        g_download_queue.active_count++;
+static int romi_queue_has_item(const DbItem* item, uint32_t sorted)
+{
+    return bsearch(&item, g_queued_items, sorted, sizeof(g_queued_items[0]), romi_queue_compare_items) != NULL;
+}
 
-        romi_dialog_unlock();
+uint32_t romi_queue_filter_queued(DbItem** items, uint32_t count)
+{
+    romi_dialog_lock();
 
-        romi_start_thread_arg("download_worker", romi_queue_download_worker, entry);
+    uint32_t sorted = romi_queue_sort_items();
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!romi_queue_has_item(items[i], sorted))
+            items[kept++] = items[i];
+    }
 
-        return 1;
+    romi_dialog_unlock();
+    return kept;
+}
+
+uint32_t romi_queue_add_batch(DbItem** items, uint32_t count)
+{
+    romi_queue_refresh_space();
+    romi_dialog_lock();
+
+    uint32_t sorted = romi_queue_sort_items();
+    uint32_t added = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!items[i] || romi_queue_has_item(items[i], sorted))
+            continue;
+        if (!romi_queue_append(items[i], ++g_journal_next_id, ROMI_PRIORITY_NORMAL))
+            break;
+        added++;
+    }
+
+    // one rewrite of the journal instead of a record per item
+    RomiJournalEntry* snapshot = NULL;
+    uint32_t snapshot_count = 0;
+    if (added > 0) {
+        snapshot = romi_queue_snapshot_journal(&snapshot_count);
+        romi_dialog_wake();
     }
 
     romi_dialog_unlock();
-    return 1;
+
+    romi_queue_write_journal(snapshot, snapshot_count);
+
+    LOG("bulk add queued %u of %u items", added, count);
+    return added;
 }
 
-int romi_queue_remove(DownloadQueueEntry* entry)
+uint64_t romi_queue_get_pending_bytes(void)
 {
-    if (!entry)
-        return 0;
+    uint64_t bytes = 0;
 
     romi_dialog_lock();
 
-    DownloadQueueEntry* prev = NULL;
-    DownloadQueueEntry* current = g_download_queue.head;
+    for (uint32_t i = 0; i < g_download_queue.count; i++) {
+        DownloadQueueEntry* entry = g_download_queue.order[i];
+        if (!entry->item || entry->item->size <= 0)
+            continue;
+
+        if (entry->status == DownloadStatusPending) {
+            bytes += (uint64_t)entry->item->size;
+        } else if (entry->status == DownloadStatusDownloading) {
+            uint64_t downloaded = romi_progress_downloaded(&entry->progress);
+            if ((uint64_t)entry->item->size > downloaded)
+                bytes += (uint64_t)entry->item->size - downloaded;
+        }
+    }
 
-    while (current) {
-        if (current == entry) {
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                g_download_queue.head = current->next;
-            }
+    romi_dialog_unlock();
+    return bytes;
+}
 
-            if (current == g_download_queue.tail) {
-                g_download_queue.tail = prev;
-            }
+void romi_queue_restore(void)
+{
+    if (g_queue_restored)
+        return;
+    g_queue_restored = 1;
 
-            g_download_queue.count--;
+    RomiJournalEntry* entries = romi_malloc(ROMI_JOURNAL_MAX_ENTRIES * sizeof(RomiJournalEntry));
+    if (!entries)
+        return;
 
-            if (current->status == DownloadStatusDownloading) {
-                g_download_queue.active_count--;
-            }
+    uint32_t count = romi_journal_load(entries, ROMI_JOURNAL_MAX_ENTRIES);
+
+    romi_dialog_lock();
+
+    for (uint32_t i = 0; i < count; i++) {
+        const RomiJournalEntry* j = &entries[i];
+        g_journal_next_id = j->id > g_journal_next_id ? j->id : g_journal_next_id;
+
+        if (j->status == DownloadStatusCompleted)
+            continue;
+
+        DbItem* item = romi_db_find(j->platform, j->url);
+        if (!item) {
+            LOG("queued %s is no longer in the catalog, dropping it", j->url);
+            continue;
+        }
 
-            romi_free(current);
+        DownloadQueueEntry* entry = romi_queue_append(item, j->id, j->priority);
+        if (!entry)
+            break;
 
-            romi_dialog_unlock();
-            return 1;
+        if (j->status == DownloadStatusFailed || j->status == DownloadStatusCancelled) {
+            // left for the user to retry or remove, as before the restart
+            entry->status = j->status;
+            romi_progress_set_status(&entry->progress, j->status == DownloadStatusFailed ? _("Failed") : _("Cancelled"));
+        } else {
+            entry->resume_offset = j->offset > ROMI_JOURNAL_REWIND ? j->offset - ROMI_JOURNAL_REWIND : 0;
+            romi_progress_set_counters(&entry->progress, entry->resume_offset, 0);
+            entry->journaled = j->offset;
         }
-        prev = current;
-        current = current->next;
     }
 
+    // start the next session from a journal holding only what was restored
+    uint32_t snapshot_count = 0;
+    RomiJournalEntry* snapshot = romi_queue_snapshot_journal(&snapshot_count);
+
+    romi_dialog_wake();
+
     romi_dialog_unlock();
-    return 0;
+
+    romi_queue_write_journal(snapshot, snapshot_count);
+
+    romi_free(entries);
 }
 
-int romi_queue_cancel(DownloadQueueEntry* entry)
+int romi_queue_remove_locked(DownloadQueueEntry* entry)
 {
     if (!entry)
         return 0;
 
-    romi_dialog_lock();
+    for (uint32_t i = 0; i < g_download_queue.count; i++) {
+        if (g_download_queue.order[i] != entry)
+            continue;
 
-    if (entry->status == DownloadStatusDownloading) {
-        cancelled = 1;
-        romi_download_cancel();
-        entry->status = DownloadStatusCancelled;
+        // a running worker still owns the entry, it must be cancelled first
+        if (entry->status == DownloadStatusDownloading || entry->status == DownloadStatusExtracting)
+            return 0;
+
+        // O(n) in the queue length, but only pointers move, a few KB even for a
+        // queue of thousands. The queue dialog reads order[] under the lock
+        memmove(&g_download_queue.order[i], &g_download_queue.order[i + 1],
+            (g_download_queue.count - i - 1) * sizeof(g_download_queue.order[0]));
+        g_download_queue.count--;
+
+        romi_journal_remove(entry->journal_id);
+        entry->next_free = g_download_queue.free_list;
+        g_download_queue.free_list = entry;
+        return 1;
     }
 
-    romi_dialog_unlock();
-    return 1;
+    return 0;
 }
 
-int romi_queue_retry(DownloadQueueEntry* entry)
+int romi_queue_cancel_locked(DownloadQueueEntry* entry)
 {
     if (!entry)
         return 0;
 
-    romi_dialog_lock();
+    // The worker flips the status to Cancelled once it has actually stopped
+    if (entry->status == DownloadStatusDownloading || entry->status == DownloadStatusExtracting) {
+        romi_download_cancel(&entry->transfer);
+        romi_progress_set_status(&entry->progress, _("Cancelling..."));
+    }
+
+    return 1;
+}
+
+int romi_queue_retry_locked(DownloadQueueEntry* entry)
+{
+    if (!entry)
+        return 0;
 
+    // back in line for the next free worker
     if (entry->status == DownloadStatusFailed || entry->status == DownloadStatusCancelled) {
-        entry->status = DownloadStatusDownloading;
-        entry->downloaded = 0;
-        entry->start_time = romi_time_msec();
+        romi_queue_set_status(entry, DownloadStatusPending);
+        entry->journaled = 0;
         entry->error_message[0] = '\0';
-        romi_strncpy(entry->status_text, sizeof(entry->status_text), _("Retrying..."));
-        g_download_queue.active_count++;
+        romi_progress_publish(&entry->progress, 0, 0, _("Retrying..."));
+        romi_dialog_wake();
+        return 1;
+    }
 
-        romi_dialog_unlock();
+    return 0;
+}
 
-        romi_start_thread_arg("download_worker", romi_queue_download_worker, entry);
+int romi_queue_bump_priority_locked(DownloadQueueEntry* entry)
+{
+    if (!entry)
+        return 0;
 
+    if (entry->status == DownloadStatusPending || entry->status == DownloadStatusDownloading) {
+        entry->priority = (entry->priority + 1) % ROMI_PRIORITY_COUNT;
+        romi_journal_priority(entry->journal_id, entry->priority);
+        // a running transfer picks the new weight up at the next rebalance
+        entry->transfer.priority = entry->priority;
         return 1;
     }
 
-    romi_dialog_unlock();
     return 0;
 }
 
-DownloadQueueEntry* romi_queue_get_entry(uint32_t index)
+int romi_queue_move_locked(DownloadQueueEntry* entry, int delta)
 {
-    DownloadQueueEntry* entry = g_download_queue.head;
-    uint32_t i = 0;
-
-    while (entry && i < index) {
-        entry = entry->next;
-        i++;
+    if (!entry || (delta != -1 && delta != 1))
+        return -1;
+
+    for (uint32_t i = 0; i < g_download_queue.count; i++) {
+        if (g_download_queue.order[i] != entry)
+            continue;
+
+        // the fifo policy starts pending entries in this order
+        int target = (int)i + delta;
+        if (target < 0 || target >= (int)g_download_queue.count)
+            return -1;
+
+        DownloadQueueEntry* other = g_download_queue.order[target];
+        g_download_queue.order[target] = entry;
+        g_download_queue.order[i] = other;
+        romi_journal_swap(entry->journal_id, other->journal_id);
+        return target;
     }
 
-    return entry;
+    return -1;
+}
+
+int romi_queue_remove(DownloadQueueEntry* entry)
+{
+    romi_dialog_lock();
+    int removed = romi_queue_remove_locked(entry);
+    romi_dialog_unlock();
+    return removed;
+}
+
+int romi_queue_cancel(DownloadQueueEntry* entry)
+{
+    romi_dialog_lock();
+    int cancelled = romi_queue_cancel_locked(entry);
+    romi_dialog_unlock();
+    return cancelled;
+}
+
+int romi_queue_retry(DownloadQueueEntry* entry)
+{
+    romi_dialog_lock();
+    int retried = romi_queue_retry_locked(entry);
+    romi_dialog_unlock();
+    return retried;
+}
+
+int romi_queue_bump_priority(DownloadQueueEntry* entry)
+{
+    romi_dialog_lock();
+    int bumped = romi_queue_bump_priority_locked(entry);
+    romi_dialog_unlock();
+    return bumped;
+}
+
+int romi_queue_move(DownloadQueueEntry* entry, int delta)
+{
+    romi_dialog_lock();
+    int moved = romi_queue_move_locked(entry, delta);
+    romi_dialog_unlock();
+    return moved;
+}
+
+DownloadQueueEntry* romi_queue_get_entry(uint32_t index)
+{
+    return index < g_download_queue.count ? g_download_queue.order[index] : NULL;
 }
 
 uint32_t romi_queue_get_count(void)
@@ -195,100 +569,296 @@ uint32_t romi_queue_get_active_count(void)
     return g_download_queue.active_count;
 }
 
-static void romi_queue_start_next(void)
+uint32_t romi_queue_get_download_limit(void)
 {
-    DownloadQueueEntry* entry = g_download_queue.head;
+    return romi_thermal_download_limit(g_download_queue.max_concurrent);
+}
 
-    while (entry) {
-        if (entry->status == DownloadStatusPending &&
-            g_download_queue.active_count < g_download_queue.max_concurrent) {
+void romi_queue_wake(void)
+{
+    romi_dialog_lock();
+    romi_dialog_wake();
+    romi_dialog_unlock();
+}
 
-            entry->status = DownloadStatusDownloading;
-            entry->start_time = romi_time_msec();
-            romi_strncpy(entry->status_text, sizeof(entry->status_text), _("Starting..."));
-            g_download_queue.active_count++;
+// Reads the lock-free speed trackers, indexes the queue without the lock like romi_queue_get_entry
+void romi_queue_get_throughput(uint32_t* speed, uint32_t* deviation, uint64_t* remaining)
+{
+    *speed = 0;
+    *deviation = 0;
+    *remaining = 0;
+
+    for (uint32_t i = 0; i < g_download_queue.count; i++) {
+        DownloadQueueEntry* entry = g_download_queue.order[i];
+        if (entry->status != DownloadStatusDownloading || entry->transfer.install_pending)
+            continue;
+
+        RomiProgressSnapshot progress;
+        romi_progress_read(&entry->progress, &progress);
+
+        *speed += romi_throughput_speed(&entry->transfer.throughput);
+        *deviation += entry->transfer.throughput.deviation;
+        if (progress.total > progress.downloaded)
+            *remaining += progress.total - progress.downloaded;
+    }
+}
 
-            romi_start_thread_arg("download_worker", romi_queue_download_worker, entry);
-            return;
-        }
-        entry = entry->next;
+static int romi_queue_is_small(const DownloadQueueEntry* entry)
+{
+    return entry->item && entry->item->size > 0 && entry->item->size < ROMI_DOWNLOAD_SMALL_ITEM;
+}
+
+static void romi_queue_schedule_item(const DownloadQueueEntry* entry, RomiScheduleItem* item)
+{
+    item->size = entry->item ? entry->item->size : 0;
+    item->host = entry->host;
+    item->priority = entry->priority;
+}
+
+// Pending entries too large for what the running transfers leave free wait
+// for them to finish instead of failing on a full disk hours later; with
+// nothing running no space will come back and the entry fails right away.
+// An archive may land in the temp folder and be extracted next to it, when
+// both are on one device it needs room for the two at once.
+// Called with the dialog lock held, returns 0 if the entry can't start now
+static int romi_queue_check_space(DownloadQueueEntry* entry, uint64_t temp_space, uint64_t install_space, int same_device)
+{
+    uint64_t size = entry->item && entry->item->size > 0 ? (uint64_t)entry->item->size : 0;
+    int archive = entry->item && romi_is_zip_file(entry->item->url) && entry->item->platform != PlatformMAME;
+
+    int fits;
+    if (same_device)
+        fits = (archive ? 2 * size : size) <= install_space;
+    else
+        fits = size <= temp_space && size <= install_space;
+    if (fits)
+        return 1;
+
+    if (g_download_queue.active_count > 0 || g_install_count > 0 || g_install_busy) {
+        romi_progress_set_status(&entry->progress, _("Waiting for free space"));
+        return 0;
     }
+
+    LOG("%s needs %llu bytes, the device has %llu", entry->item->name, size, install_space);
+    romi_queue_set_status(entry, DownloadStatusFailed);
+    romi_progress_set_status(&entry->progress, _("Failed"));
+    romi_strncpy(entry->error_message, sizeof(entry->error_message), _("Not enough free space"));
+    return 0;
 }
 
-static void romi_queue_download_worker(void* arg)
+// Lets the configured policy choose among the pending entries, called with the dialog lock held
+static DownloadQueueEntry* romi_queue_pick_pending(int small_only)
 {
-    DownloadQueueEntry* entry = (DownloadQueueEntry*)arg;
+    // the temp file goes to the internal HDD, the installed ROM to the selected
+    // device; both come from the space cache, no syscall under the lock
+    const char* install_path = romi_devices_get_base_path();
+    uint64_t temp_space = romi_space_available(romi_get_temp_folder());
+    uint64_t install_space = romi_space_available(install_path);
+    int same_device = romi_space_same_device(romi_get_temp_folder(), install_path);
+
+    uint32_t pending = 0, active = 0;
+    for (uint32_t i = 0; i < g_download_queue.count; i++) {
+        DownloadQueueEntry* entry = g_download_queue.order[i];
+
+        // archives waiting for the install stage no longer hold a connection
+        if (entry->status == DownloadStatusDownloading && !entry->transfer.install_pending &&
+            active < ROMI_COUNTOF(g_schedule_active)) {
+            romi_queue_schedule_item(entry, &g_schedule_active[active++]);
+            continue;
+        }
 
-    // Set our thread ID so progress callback can find us
-    sys_ppu_thread_t my_thread_id;
-    sysThreadGetId(&my_thread_id);
-    entry->thread_id = my_thread_id;
+        if (entry->status != DownloadStatusPending || (small_only && !romi_queue_is_small(entry)))
+            continue;
+        if (!romi_queue_check_space(entry, temp_space, install_space, same_device))
+            continue;
+        romi_queue_schedule_item(entry, &g_schedule_pending[pending]);
+        g_schedule_index[pending++] = i;
+    }
 
-    cancelled = 0;
-    romi_lock_process();
-    int success = romi_download_rom(entry->item, queue_progress_callback);
-    romi_unlock_process();
+    int pick = romi_schedule_pick(g_schedule_pending, pending, g_schedule_active, active);
+    return pick < 0 ? NULL : g_download_queue.order[g_schedule_index[pick]];
+}
 
-    romi_dialog_lock();
+static void romi_queue_prepare(DownloadQueueEntry* entry)
+{
+    romi_queue_set_status(entry, DownloadStatusDownloading);
+    entry->start_time = romi_time_msec();
+    romi_transfer_init(&entry->transfer, queue_progress_callback, entry);
+    entry->transfer.priority = entry->priority;
+
+    // only the first attempt after a restart picks up the old temp file
+    entry->transfer.resume_offset = entry->resume_offset;
+    entry->journaled = entry->resume_offset;
+    romi_progress_publish(&entry->progress, entry->resume_offset, 0, _("Starting..."));
+    entry->resume_offset = 0;
+}
 
+// Final stage, called with the dialog lock held
+static void romi_queue_finish(DownloadQueueEntry* entry, int success)
+{
     if (success) {
-        entry->status = DownloadStatusCompleted;
-        entry->downloaded = entry->total;
-        romi_strncpy(entry->status_text, sizeof(entry->status_text), _("Completed"));
-    } else if (cancelled) {
-        entry->status = DownloadStatusCancelled;
-        romi_strncpy(entry->status_text, sizeof(entry->status_text), _("Cancelled"));
+        RomiProgressSnapshot progress;
+        romi_progress_read(&entry->progress, &progress);
+
+        romi_queue_set_status(entry, DownloadStatusCompleted);
+        romi_progress_publish(&entry->progress, progress.total, progress.total, _("Completed"));
+    } else if (entry->transfer.cancelled) {
+        romi_queue_set_status(entry, DownloadStatusCancelled);
+        romi_progress_set_status(&entry->progress, _("Cancelled"));
     } else {
-        entry->status = DownloadStatusFailed;
-        romi_strncpy(entry->status_text, sizeof(entry->status_text), _("Failed"));
-        romi_strncpy(entry->error_message, sizeof(entry->error_message), _("Download failed"));
+        romi_queue_set_status(entry, DownloadStatusFailed);
+        romi_progress_set_status(&entry->progress, _("Failed"));
+        romi_strncpy(entry->error_message, sizeof(entry->error_message),
+            entry->transfer.corrupt ? _("Checksum mismatch") :
+            entry->transfer.no_space ? _("Not enough free space") : _("Download failed"));
     }
+}
 
-    g_download_queue.active_count--;
-    entry->thread_id = 0;
+// One of max_concurrent fetch workers: takes the next pending entry, or
+// sleeps on the dialog condition until one is queued.
+static void romi_queue_download_worker(void* arg)
+{
+    ROMI_UNUSED(arg);
+    int small = 0;
 
-    romi_queue_start_next();
+    romi_dialog_lock();
+
+    while (!g_queue_stopping) {
+        if (romi_queue_compact_journal())
+            continue;
+
+        // a hot console runs fewer downloads, the running ones finish first
+        if (g_download_queue.active_count >= romi_queue_get_download_limit()) {
+            small = 0;
+            romi_dialog_wait();
+            continue;
+        }
+
+        // Runs of small ROMs stay on the same worker, back to back on the
+        // connection the previous one left warm
+        DownloadQueueEntry* entry = small ? romi_queue_pick_pending(1) : NULL;
+        if (!entry)
+            entry = romi_queue_pick_pending(0);
+        if (!entry) {
+            small = 0;
+            romi_dialog_wait();
+            continue;
+        }
+
+        romi_queue_prepare(entry);
+        g_download_queue.active_count++;
+
+        romi_dialog_unlock();
+
+        romi_lock_process();
+        int success = romi_download_fetch(entry->item, &entry->transfer);
+        romi_unlock_process();
+
+        romi_dialog_lock();
+
+        if (success && entry->transfer.install_pending) {
+            // Keep the download slot while the install stage is backed up, so
+            // finished archives can't pile up in the temp folder
+            while (g_install_count == ROMI_QUEUE_INSTALL_BACKLOG && !g_queue_stopping) {
+                romi_progress_set_status(&entry->progress, _("Waiting to extract..."));
+                romi_dialog_wait();
+            }
+            if (g_queue_stopping)
+                break;
+
+            romi_queue_set_status(entry, DownloadStatusExtracting);
+            romi_progress_set_status(&entry->progress, _("Queued for install"));
+            g_install_queue[(g_install_head + g_install_count) % ROMI_QUEUE_INSTALL_BACKLOG] = entry;
+            g_install_count++;
+            romi_dialog_wake();
+        } else {
+            romi_queue_finish(entry, success);
+        }
+
+        small = romi_queue_is_small(entry);
+        g_download_queue.active_count--;
+        // a host limit may have held back entries the idle workers can take now
+        romi_dialog_wake();
+    }
 
     romi_dialog_unlock();
 
-    romi_thread_exit();
+    romi_queue_worker_exit();
 }
 
-static void queue_progress_callback(const char* status, uint64_t downloaded, uint64_t total)
+// Extracts or moves downloaded files one at a time while the fetch workers
+// carry on with the next downloads; sleeps while the hand-off queue is empty.
+static void romi_queue_install_worker(void* arg)
 {
-    // Get current thread ID
-    sys_ppu_thread_t current_thread;
-    sysThreadGetId(&current_thread);
+    ROMI_UNUSED(arg);
 
-    // Find our entry (don't lock - we're only reading thread_id which is set once)
-    DownloadQueueEntry* entry = g_download_queue.head;
-    while (entry) {
-        if (entry->thread_id == current_thread) {
-            // Found our entry - update progress fields atomically
-            // These writes are simple assignments, safe without lock
+    romi_dialog_lock();
 
-            // Safety: clamp downloaded to never exceed total
-            if (downloaded > total && total > 0) {
-                downloaded = total;
-            }
+    while (!g_queue_stopping) {
+        if (romi_queue_compact_journal())
+            continue;
 
-            entry->downloaded = downloaded;
-            entry->total = total;
+        // inflating is the hottest work of the queue, it waits out a minimal throttle
+        if (g_install_count == 0 || !romi_thermal_install_allowed()) {
+            romi_dialog_wait();
+            continue;
+        }
 
-            uint32_t elapsed = romi_time_msec() - entry->start_time;
-            if (elapsed > 0 && downloaded > 0) {
-                entry->speed = (uint32_t)((downloaded * 1000ULL) / elapsed);
-            }
+        DownloadQueueEntry* entry = g_install_queue[g_install_head];
+        g_install_head = (g_install_head + 1) % ROMI_QUEUE_INSTALL_BACKLOG;
+        g_install_count--;
+        // a fetch worker may be waiting for room in the hand-off queue
+        romi_dialog_wake();
 
-            // Status text needs brief lock
-            if (status && status[0]) {
-                romi_dialog_lock();
-                romi_strncpy(entry->status_text, sizeof(entry->status_text), status);
-                romi_dialog_unlock();
-            }
+        romi_progress_set_status(&entry->progress, _("Extracting..."));
+        g_install_busy = 1;
+        romi_dialog_unlock();
 
-            break;
+        romi_lock_process();
+        int success = romi_download_install(&entry->transfer);
+        romi_unlock_process();
+
+        romi_dialog_lock();
+        g_install_busy = 0;
+        // the temp file is gone, entries held back for space may fit now
+        romi_dialog_wake();
+
+        // a corrupt archive only shows up here, send it back for a fresh download
+        if (!success && entry->transfer.corrupt && !entry->transfer.cancelled &&
+            entry->verify_retries < ROMI_DOWNLOAD_VERIFY_RETRIES) {
+            entry->verify_retries++;
+            romi_queue_set_status(entry, DownloadStatusPending);
+            entry->journaled = 0;
+            romi_journal_offset(entry->journal_id, 0);
+            romi_progress_publish(&entry->progress, 0, 0, _("Checksum mismatch, retrying..."));
+            romi_dialog_wake();
+            continue;
         }
-        entry = entry->next;
+
+        romi_queue_finish(entry, success);
     }
+
+    romi_dialog_unlock();
+
+    romi_queue_worker_exit();
+}
+
+static void queue_progress_callback(RomiTransfer* transfer, const char* status, uint64_t downloaded, uint64_t total)
+{
+    DownloadQueueEntry* entry = (DownloadQueueEntry*)transfer->user;
+
+    // Safety: clamp downloaded to never exceed total
+    if (downloaded > total && total > 0) {
+        downloaded = total;
+    }
+
+    // install progress counts extracted bytes, only network progress is resumable
+    if (entry->status == DownloadStatusDownloading &&
+        (downloaded < entry->journaled || downloaded >= entry->journaled + ROMI_JOURNAL_OFFSET_STEP)) {
+        entry->journaled = downloaded;
+        romi_journal_offset(entry->journal_id, downloaded);
+    }
+
+    // no lock on the hot path, the UI reads a consistent snapshot of what is published here
+    romi_progress_publish(&entry->progress, downloaded, total, transfer->cancelled ? NULL : status);
 }
@@ -0,0 +1,102 @@
+#include "romi_redirect.h"
+#include "romi.h"
+
+#include <string.h>
+
+#define REDIRECT_URL_LENGTH 1024
+
+typedef struct {
+    char url[REDIRECT_URL_LENGTH];
+    char effective[REDIRECT_URL_LENGTH];
+    uint32_t stored;    // romi_time_msec() when resolved, entry unused if url is empty
+} RomiRedirect;
+
+static RomiRedirect g_redirects[ROMI_REDIRECT_ENTRIES];
+static romi_mutex g_redirect_lock;
+
+void romi_redirect_init(void)
+{
+    romi_mutex_create(&g_redirect_lock, "redirect");
+    memset(g_redirects, 0, sizeof(g_redirects));
+}
+
+static int redirect_expired(const RomiRedirect* entry, uint32_t now)
+{
+    return now - entry->stored >= ROMI_REDIRECT_TTL_MSEC;
+}
+
+static RomiRedirect* redirect_find(const char* url)
+{
+    for (int i = 0; i < ROMI_REDIRECT_ENTRIES; i++)
+    {
+        if (g_redirects[i].url[0] && strcmp(g_redirects[i].url, url) == 0)
+            return &g_redirects[i];
+    }
+    return NULL;
+}
+
+int romi_redirect_lookup(const char* url, char* effective, uint32_t size)
+{
+    int found = 0;
+
+    romi_mutex_lock(&g_redirect_lock);
+    RomiRedirect* entry = redirect_find(url);
+    if (entry && redirect_expired(entry, romi_time_msec()))
+    {
+        entry->url[0] = 0;
+    }
+    else if (entry)
+    {
+        romi_strncpy(effective, size, entry->effective);
+        found = 1;
+    }
+    romi_mutex_unlock(&g_redirect_lock);
+
+    return found;
+}
+
+void romi_redirect_store(const char* url, const char* effective)
+{
+    // a URL that doesn't fit would be cut short, better to keep resolving it
+    if (strlen(url) >= REDIRECT_URL_LENGTH || strlen(effective) >= REDIRECT_URL_LENGTH)
+        return;
+
+    uint32_t now = romi_time_msec();
+
+    romi_mutex_lock(&g_redirect_lock);
+
+    RomiRedirect* entry = redirect_find(url);
+    if (!entry)
+    {
+        // free or expired slot first, otherwise replace the oldest resolution
+        entry = &g_redirects[0];
+        for (int i = 0; i < ROMI_REDIRECT_ENTRIES; i++)
+        {
+            RomiRedirect* slot = &g_redirects[i];
+            if (!slot->url[0] || redirect_expired(slot, now))
+            {
+                entry = slot;
+                break;
+            }
+            if (now - slot->stored > now - entry->stored)
+                entry = slot;
+        }
+    }
+
+    romi_strncpy(entry->url, sizeof(entry->url), url);
+    romi_strncpy(entry->effective, sizeof(entry->effective), effective);
+    entry->stored = now;
+
+    romi_mutex_unlock(&g_redirect_lock);
+
+    LOG("cached redirect %s -> %s", url, effective);
+}
+
+void romi_redirect_forget(const char* url)
+{
+    romi_mutex_lock(&g_redirect_lock);
+    RomiRedirect* entry = redirect_find(url);
+    if (entry)
+        entry->url[0] = 0;
+    romi_mutex_unlock(&g_redirect_lock);
+}
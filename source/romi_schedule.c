@@ -0,0 +1,137 @@
+#include "romi_schedule.h"
+#include "romi.h"
+#include "romi_download.h"
+
+static RomiSchedulePolicy g_policy = ScheduleFifo;
+static uint32_t g_host_limit = ROMI_SCHEDULE_HOST_LIMIT_DEFAULT;
+
+static const char* policy_names[ScheduleCount] = { "fifo", "shortest", "mix" };
+
+void romi_schedule_configure(RomiSchedulePolicy policy, uint32_t host_limit)
+{
+    g_policy = policy < ScheduleCount ? policy : ScheduleFifo;
+    g_host_limit = host_limit;
+    LOG("schedule policy %s, %u transfers per host", policy_names[g_policy], g_host_limit);
+}
+
+RomiSchedulePolicy romi_schedule_policy(void)
+{
+    return g_policy;
+}
+
+RomiSchedulePolicy romi_schedule_parse(const char* name)
+{
+    for (uint32_t i = 0; i < ScheduleCount; i++)
+    {
+        if (romi_stricmp(name, policy_names[i]) == 0)
+            return (RomiSchedulePolicy)i;
+    }
+    return ScheduleFifo;
+}
+
+const char* romi_schedule_name(RomiSchedulePolicy policy)
+{
+    return policy < ScheduleCount ? policy_names[policy] : policy_names[ScheduleFifo];
+}
+
+uint32_t romi_schedule_host(const char* base, const char* url)
+{
+    // sources.txt catalogs list bare file names, the server is in the mirror base
+    if (!romi_validate_url(url))
+        url = base ? base : "";
+
+    const char* host = romi_strstr(url, "://");
+    host = host ? host + 3 : url;
+
+    // FNV-1a of the lowercased host, up to the port or path
+    uint32_t hash = 2166136261u;
+    for (; *host && *host != '/' && *host != ':'; host++)
+    {
+        char ch = *host >= 'A' && *host <= 'Z' ? *host - 'A' + 'a' : *host;
+        hash = (hash ^ (uint8_t)ch) * 16777619u;
+    }
+    return hash;
+}
+
+static int is_small(const RomiScheduleItem* item)
+{
+    return item->size > 0 && item->size < ROMI_DOWNLOAD_SMALL_ITEM;
+}
+
+static int host_full(const RomiScheduleItem* item, const RomiScheduleItem* active, uint32_t active_count)
+{
+    if (g_host_limit == 0)
+        return 0;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < active_count; i++)
+    {
+        if (active[i].host == item->host)
+            count++;
+    }
+    return count >= g_host_limit;
+}
+
+// unknown sizes go last, they are most likely the big ones
+static int64_t sort_size(const RomiScheduleItem* item)
+{
+    return item->size > 0 ? item->size : INT64_MAX;
+}
+
+int romi_schedule_pick(const RomiScheduleItem* pending, uint32_t pending_count,
+    const RomiScheduleItem* active, uint32_t active_count)
+{
+    int have_small = 0, have_large = 0;
+    for (uint32_t i = 0; i < active_count; i++)
+    {
+        if (is_small(&active[i]))
+            have_small = 1;
+        else
+            have_large = 1;
+    }
+
+    // the mix policy wants whichever kind is missing, any kind once both run
+    int want_small = g_policy == ScheduleMix && !have_small;
+    int want_large = g_policy == ScheduleMix && have_small && !have_large;
+
+    int best = -1;
+    int best_wanted = 0;
+    for (uint32_t i = 0; i < pending_count; i++)
+    {
+        const RomiScheduleItem* item = &pending[i];
+        if (host_full(item, active, active_count))
+            continue;
+
+        int wanted = (want_small && is_small(item)) || (want_large && !is_small(item));
+        if (best < 0)
+        {
+            best = (int)i;
+            best_wanted = wanted;
+            continue;
+        }
+
+        const RomiScheduleItem* current = &pending[best];
+        if (item->priority != current->priority)
+        {
+            if (item->priority > current->priority)
+            {
+                best = (int)i;
+                best_wanted = wanted;
+            }
+            continue;
+        }
+
+        // same priority, earlier entries win ties so each policy stays FIFO among equals
+        if (g_policy == ScheduleShortest && sort_size(item) < sort_size(current))
+        {
+            best = (int)i;
+        }
+        else if (g_policy == ScheduleMix && wanted && !best_wanted)
+        {
+            best = (int)i;
+            best_wanted = 1;
+        }
+    }
+
+    return best;
+}
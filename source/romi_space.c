@@ -0,0 +1,249 @@
+#include "romi_space.h"
+#include "romi.h"
+#include "romi_utils.h"
+
+#include <string.h>
+
+static romi_mutex g_space_lock;
+static RomiSpaceReservation* g_space_active = NULL;
+static char g_space_devices[ROMI_SPACE_MAX_DEVICES][ROMI_SPACE_DEVICE_LENGTH];
+static uint32_t g_space_device_count = 0;
+
+// Free space of each device as of the last reservation change, with the
+// bytes the active reservations had landed at that moment. Whatever they
+// land later is taken off the cached value, so checks need no syscall
+typedef struct {
+    int valid;
+    uint64_t free;
+    uint64_t landed;
+} SpaceCache;
+
+static SpaceCache g_space_cache[ROMI_SPACE_MAX_DEVICES];
+
+void romi_space_init(void)
+{
+    romi_mutex_create(&g_space_lock, "space");
+    g_space_active = NULL;
+    g_space_device_count = 0;
+    memset(g_space_cache, 0, sizeof(g_space_cache));
+}
+
+// "/dev_usb000/roms/nes/x.zip" -> "/dev_usb000/"
+static void space_device_root(const char* path, char* root, uint32_t size)
+{
+    const char* end = path[0] == '/' ? strchr(path + 1, '/') : NULL;
+    uint32_t len = end ? (uint32_t)(end - path) + 1 : (uint32_t)strlen(path);
+    if (len >= size)
+        len = size - 1;
+
+    romi_memcpy(root, path, len);
+    root[len] = 0;
+}
+
+// Ledger slot of the device holding path, called with g_space_lock held; -1 once the table is full
+static int space_device(const char* path)
+{
+    char root[ROMI_SPACE_DEVICE_LENGTH];
+    space_device_root(path, root, sizeof(root));
+
+    for (uint32_t i = 0; i < g_space_device_count; i++)
+    {
+        if (strcmp(g_space_devices[i], root) == 0)
+            return (int)i;
+    }
+
+    if (g_space_device_count == ROMI_SPACE_MAX_DEVICES)
+        return -1;
+
+    romi_strncpy(g_space_devices[g_space_device_count], ROMI_SPACE_DEVICE_LENGTH, root);
+    g_space_cache[g_space_device_count].valid = 0;
+    return (int)g_space_device_count++;
+}
+
+// Bytes the active reservations have written to device so far
+static uint64_t space_landed_total(int device)
+{
+    uint64_t bytes = 0;
+
+    for (const RomiSpaceReservation* r = g_space_active; r; r = r->next)
+    {
+        for (int part = 0; part < SpaceCount; part++)
+        {
+            if (r->parts[part].bytes != 0 && r->parts[part].device == device)
+                bytes += r->parts[part].landed;
+        }
+    }
+
+    return bytes;
+}
+
+// Called with g_space_lock held, free is measured by the caller beforehand
+static void space_cache_store(int device, uint64_t free)
+{
+    g_space_cache[device].valid = 1;
+    g_space_cache[device].free = free;
+    g_space_cache[device].landed = space_landed_total(device);
+}
+
+// Free bytes on the file system, without a syscall once the cache is filled
+static uint64_t space_device_free(int device)
+{
+    SpaceCache* cache = &g_space_cache[device];
+    if (!cache->valid)
+        space_cache_store(device, romi_get_device_free_space(g_space_devices[device]));
+
+    uint64_t landed = space_landed_total(device);
+    uint64_t free = cache->free + cache->landed;
+    return free > landed ? free - landed : 0;
+}
+
+// Bytes the reservations have yet to write to device, skipping one part that is about to be replaced
+static uint64_t space_outstanding(int device, const RomiSpaceReservation* skip, RomiSpacePart skip_part)
+{
+    uint64_t bytes = 0;
+
+    for (const RomiSpaceReservation* r = g_space_active; r; r = r->next)
+    {
+        for (int part = 0; part < SpaceCount; part++)
+        {
+            if (r->parts[part].bytes == 0 || r->parts[part].device != device)
+                continue;
+            if (r == skip && part == (int)skip_part)
+                continue;
+
+            uint64_t landed = r->parts[part].landed;
+            if (landed < r->parts[part].bytes)
+                bytes += r->parts[part].bytes - landed;
+        }
+    }
+
+    return bytes;
+}
+
+static uint64_t space_free(int device, const RomiSpaceReservation* skip, RomiSpacePart skip_part)
+{
+    uint64_t free = space_device_free(device);
+    uint64_t outstanding = space_outstanding(device, skip, skip_part) + ROMI_SPACE_MARGIN;
+    return free > outstanding ? free - outstanding : 0;
+}
+
+uint64_t romi_space_available(const char* path)
+{
+    romi_mutex_lock(&g_space_lock);
+
+    int device = space_device(path);
+    uint64_t available = device < 0 ? romi_get_device_free_space(path) : space_free(device, NULL, SpaceCount);
+
+    romi_mutex_unlock(&g_space_lock);
+    return available;
+}
+
+int romi_space_same_device(const char* path, const char* other)
+{
+    char root[ROMI_SPACE_DEVICE_LENGTH], other_root[ROMI_SPACE_DEVICE_LENGTH];
+    space_device_root(path, root, sizeof(root));
+    space_device_root(other, other_root, sizeof(other_root));
+    return strcmp(root, other_root) == 0;
+}
+
+void romi_space_refresh(const char* path)
+{
+    char root[ROMI_SPACE_DEVICE_LENGTH];
+    space_device_root(path, root, sizeof(root));
+    uint64_t free = romi_get_device_free_space(root);
+
+    romi_mutex_lock(&g_space_lock);
+    int device = space_device(root);
+    if (device >= 0)
+        space_cache_store(device, free);
+    romi_mutex_unlock(&g_space_lock);
+}
+
+int romi_space_reserve(RomiSpaceReservation* reservation, RomiSpacePart part, const char* path, uint64_t base, uint64_t bytes)
+{
+    // measured before the lock, a reservation is the moment to bring the cache up to date
+    char root[ROMI_SPACE_DEVICE_LENGTH];
+    space_device_root(path, root, sizeof(root));
+    uint64_t free = romi_get_device_free_space(root);
+
+    romi_mutex_lock(&g_space_lock);
+
+    int device = space_device(path);
+    if (device >= 0)
+        space_cache_store(device, free);
+
+    if (device >= 0 && bytes > space_free(device, reservation, part))
+    {
+        LOG("%llu bytes don't fit on %s, %llu available", bytes, g_space_devices[device], space_free(device, reservation, part));
+        romi_mutex_unlock(&g_space_lock);
+        return 0;
+    }
+
+    // the bytes the part replaces stay on the disk but leave the landed total
+    int previous = reservation->parts[part].bytes ? reservation->parts[part].device : -1;
+    if (previous >= 0 && previous != device)
+        g_space_cache[previous].valid = 0;
+
+    // a device past the table is left unchecked, as before the ledger
+    reservation->parts[part].device = device;
+    reservation->parts[part].bytes = device >= 0 ? bytes : 0;
+    reservation->parts[part].base = base;
+    reservation->parts[part].landed = 0;
+
+    if (!reservation->linked)
+    {
+        reservation->next = g_space_active;
+        g_space_active = reservation;
+        reservation->linked = 1;
+    }
+
+    if (device >= 0)
+        space_cache_store(device, free);
+
+    romi_mutex_unlock(&g_space_lock);
+    return 1;
+}
+
+void romi_space_landed(RomiSpaceReservation* reservation, RomiSpacePart part, uint64_t position)
+{
+    if (reservation->parts[part].bytes && position > reservation->parts[part].base)
+        reservation->parts[part].landed = position - reservation->parts[part].base;
+}
+
+void romi_space_release(RomiSpaceReservation* reservation)
+{
+    // what the reservation wrote stays on the disk, measure it before the
+    // reservation leaves the landed totals
+    int devices[SpaceCount];
+    uint64_t free[SpaceCount];
+    for (int part = 0; part < SpaceCount; part++)
+    {
+        devices[part] = reservation->parts[part].bytes ? reservation->parts[part].device : -1;
+        if (devices[part] >= 0)
+            free[part] = romi_get_device_free_space(g_space_devices[devices[part]]);
+    }
+
+    romi_mutex_lock(&g_space_lock);
+
+    RomiSpaceReservation** link = &g_space_active;
+    while (*link)
+    {
+        if (*link == reservation)
+        {
+            *link = reservation->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+
+    reservation->next = NULL;
+    reservation->linked = 0;
+    for (int part = 0; part < SpaceCount; part++)
+    {
+        reservation->parts[part].bytes = 0;
+        if (devices[part] >= 0)
+            space_cache_store(devices[part], free[part]);
+    }
+
+    romi_mutex_unlock(&g_space_lock);
+}
@@ -11,11 +11,13 @@
 
 #define DOWNLOAD_BUFFER_SIZE (128 * 1024)
 
-static int cancelled = 0;
+static volatile int cancelled = 0;
 static RomiStorageProgress current_progress = NULL;
 
-static void extract_progress(const char* filename, uint64_t extracted, uint64_t total)
+static void extract_progress(void* arg, const char* filename, uint64_t extracted, uint64_t total)
 {
+    ROMI_UNUSED(arg);
+
     if (current_progress)
     {
         float percent = total > 0 ? (float)extracted / (float)total : 0.0f;
@@ -60,25 +62,11 @@ static char* get_filename_from_url(const char* url)
     return (char*)url;
 }
 
-RomiStorageResult romi_storage_download(const DbItem* item, RomiStorageProgress progress)
+// One attempt at downloading item to temp_path. proxy_dropped is set when it
+// failed on a proxy that is bypassed from now on
+static RomiStorageResult fetch_temp(const DbItem* item, const char* temp_folder, const char* temp_path, int* proxy_dropped)
 {
-    if (!item || !item->url)
-        return StorageErrorDownload;
-
-    cancelled = 0;
-    current_progress = progress;
-
-    const char* dest_folder = romi_platform_folder(item->platform);
-    const char* temp_folder = romi_get_temp_folder();
-
-    char* url_filename = get_filename_from_url(item->url);
-    char temp_path[512];
-    romi_snprintf(temp_path, sizeof(temp_path), "%s/%s", temp_folder, url_filename);
-
-    LOG("downloading %s to %s", item->url, temp_path);
-
-    if (progress)
-        progress("Connecting...", 0.0f);
+    *proxy_dropped = 0;
 
     romi_http* http = romi_http_get(item->url, NULL, 0, 0);
     if (!http)
@@ -91,6 +79,7 @@ RomiStorageResult romi_storage_download(const DbItem* item, RomiStorageProgress
     if (!romi_http_response_length(http, &content_length))
     {
         LOG("failed to get content length");
+        *proxy_dropped = romi_http_proxy_dropped(http);
         romi_http_close(http);
         return StorageErrorDownload;
     }
@@ -111,17 +100,52 @@ RomiStorageResult romi_storage_download(const DbItem* item, RomiStorageProgress
         return StorageErrorDisk;
     }
 
-    if (!romi_http_read(http, &write_file_data, fp, &update_download_progress))
+    if (!romi_http_read(http, &write_file_data, fp, &update_download_progress, NULL))
     {
         LOG("download failed");
         romi_close(fp);
         romi_rm(temp_path);
+        *proxy_dropped = romi_http_proxy_dropped(http);
         romi_http_close(http);
         return cancelled ? StorageCancelled : StorageErrorDownload;
     }
 
     romi_close(fp);
     romi_http_close(http);
+    return StorageOK;
+}
+
+RomiStorageResult romi_storage_download(const DbItem* item, RomiStorageProgress progress)
+{
+    if (!item || !item->url)
+        return StorageErrorDownload;
+
+    cancelled = 0;
+    current_progress = progress;
+
+    char dest_folder[512];
+    romi_platform_folder(item->platform, dest_folder, sizeof(dest_folder));
+    const char* temp_folder = romi_get_temp_folder();
+
+    char* url_filename = get_filename_from_url(item->url);
+    char temp_path[512];
+    romi_snprintf(temp_path, sizeof(temp_path), "%s/%s", temp_folder, url_filename);
+
+    LOG("downloading %s to %s", item->url, temp_path);
+
+    if (progress)
+        progress("Connecting...", 0.0f);
+
+    // there is no retry loop here, so a dead proxy gets one direct attempt
+    int proxy_dropped;
+    RomiStorageResult fetched = fetch_temp(item, temp_folder, temp_path, &proxy_dropped);
+    if (fetched != StorageOK && proxy_dropped && !cancelled)
+    {
+        LOG("retrying %s without the proxy", item->url);
+        fetched = fetch_temp(item, temp_folder, temp_path, &proxy_dropped);
+    }
+    if (fetched != StorageOK)
+        return fetched;
 
     if (cancelled)
     {
@@ -140,7 +164,7 @@ RomiStorageResult romi_storage_download(const DbItem* item, RomiStorageProgress
         if (progress)
             progress("Extracting...", 0.5f);
 
-        RomiExtractResult extract_result = romi_extract_zip(temp_path, dest_folder, extract_progress);
+        RomiExtractResult extract_result = romi_extract_zip(temp_path, dest_folder, extract_progress, NULL, &cancelled);
 
         if (extract_result != ExtractOK)
         {
@@ -180,7 +204,8 @@ int romi_storage_check_presence(DbItem* item)
     if (!item)
         return 0;
 
-    const char* folder = romi_platform_folder(item->platform);
+    char folder[512];
+    romi_platform_folder(item->platform, folder, sizeof(folder));
     struct stat sb;
 
     if (stat(folder, &sb) != 0 || !S_ISDIR(sb.st_mode))
@@ -241,7 +266,6 @@ void romi_storage_scan_installed(void)
 void romi_storage_cancel(void)
 {
     cancelled = 1;
-    romi_extract_cancel();
 }
 
 const char* romi_storage_error_string(RomiStorageResult result)
@@ -261,7 +285,8 @@ const char* romi_storage_error_string(RomiStorageResult result)
 const char* romi_storage_get_install_path(RomiPlatform platform, const char* filename)
 {
     static char path[512];
-    const char* folder = romi_platform_folder(platform);
+    char folder[512];
+    romi_platform_folder(platform, folder, sizeof(folder));
     romi_snprintf(path, sizeof(path), "%s/%s", folder, filename);
     return path;
 }
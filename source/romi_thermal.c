@@ -0,0 +1,139 @@
+#include "romi_thermal.h"
+#include "romi.h"
+#include "romi_utils.h"
+
+// a single long frame, like loading a texture, shouldn't count for more than this
+#define THERMAL_FRAME_CAP_MSEC  1000
+
+static uint32_t g_warm = ROMI_THERMAL_WARM_DEFAULT;
+static uint32_t g_hot = ROMI_THERMAL_HOT_DEFAULT;
+static uint32_t g_frame_limit = ROMI_THERMAL_FRAME_DEFAULT;
+
+static RomiThermalSource g_source = NULL;
+static void* g_source_arg = NULL;
+
+// written by the main thread only, the queue workers read it with the dialog lock
+static volatile RomiThrottle g_level = ThrottleNone;
+// EWMA of the frame time in 1/16 msec, each frame weighs 1/8
+static uint32_t g_frame_avg = 0;
+static uint32_t g_last_sample = 0;
+static int g_sampled = 0;
+static uint32_t g_calm_since = 0;
+static int g_calm = 0;
+
+static const char* level_names[ThrottleCount] = { "none", "reduced", "minimal" };
+
+void romi_thermal_configure(uint32_t warm, uint32_t hot, uint32_t frame_msec)
+{
+    g_warm = warm;
+    g_hot = hot;
+    g_frame_limit = frame_msec;
+    g_level = ThrottleNone;
+    g_frame_avg = 0;
+    g_sampled = 0;
+    g_calm = 0;
+    LOG("thermal throttle at %u/%u C, frames over %u ms", warm, hot, frame_msec);
+}
+
+void romi_thermal_set_source(RomiThermalSource source, void* arg)
+{
+    g_source = source;
+    g_source_arg = arg;
+}
+
+// Level the readings call for; slack lowers every threshold, to tell when it is safe to step down
+static RomiThrottle thermal_target(uint32_t temperature, uint32_t frame_msec, uint32_t slack)
+{
+    if (g_hot && temperature + slack >= g_hot)
+        return ThrottleMinimal;
+    if (g_warm && temperature + slack >= g_warm)
+        return ThrottleReduced;
+
+    // a slow UI only costs one download, extraction keeps going
+    uint32_t frame_limit = slack ? g_frame_limit * 3 / 4 : g_frame_limit;
+    if (g_frame_limit && frame_msec > frame_limit)
+        return ThrottleReduced;
+
+    return ThrottleNone;
+}
+
+int romi_thermal_update(uint32_t now, uint32_t frame_msec)
+{
+    frame_msec = min32(frame_msec, THERMAL_FRAME_CAP_MSEC);
+    g_frame_avg = g_frame_avg - g_frame_avg / 8 + frame_msec * 2;
+
+    if (g_sampled && now - g_last_sample < ROMI_THERMAL_SAMPLE_MSEC)
+        return 0;
+    g_sampled = 1;
+    g_last_sample = now;
+
+    uint32_t cpu = 0, rsx = 0;
+    if (!g_source || !g_source(g_source_arg, &cpu, &rsx))
+        cpu = rsx = 0;
+
+    uint32_t temperature = max32(cpu, rsx);
+    uint32_t frame = romi_thermal_frame_msec();
+    RomiThrottle level = g_level;
+
+    RomiThrottle up = thermal_target(temperature, frame, 0);
+    if (up > level)
+    {
+        level = up;
+        g_calm = 0;
+    }
+    else if (thermal_target(temperature, frame, ROMI_THERMAL_HYSTERESIS) < level)
+    {
+        // one step down per cooldown, the next step needs another quiet period
+        if (!g_calm)
+        {
+            g_calm = 1;
+            g_calm_since = now;
+        }
+        else if (now - g_calm_since >= ROMI_THERMAL_COOLDOWN_MSEC)
+        {
+            level = (RomiThrottle)(level - 1);
+            g_calm_since = now;
+        }
+    }
+    else
+    {
+        g_calm = 0;
+    }
+
+    if (level == g_level)
+        return 0;
+
+    LOG("throttle %s -> %s at CPU %u C, RSX %u C, %u ms frames", level_names[g_level], level_names[level], cpu, rsx, frame);
+    g_level = level;
+    return 1;
+}
+
+RomiThrottle romi_thermal_level(void)
+{
+    return g_level;
+}
+
+uint32_t romi_thermal_frame_msec(void)
+{
+    return g_frame_avg / 16;
+}
+
+uint32_t romi_thermal_download_limit(uint32_t max_concurrent)
+{
+    switch (g_level)
+    {
+        case ThrottleReduced: return max_concurrent > 1 ? max_concurrent - 1 : 1;
+        case ThrottleMinimal: return 1;
+        default: return max_concurrent;
+    }
+}
+
+int romi_thermal_install_allowed(void)
+{
+    return g_level != ThrottleMinimal;
+}
+
+const char* romi_thermal_name(RomiThrottle level)
+{
+    return level < ThrottleCount ? level_names[level] : level_names[ThrottleNone];
+}
@@ -0,0 +1,110 @@
+#include "romi_throughput.h"
+#include "romi.h"
+#include "romi_utils.h"
+
+#include <string.h>
+
+// a new bucket weighs 1/8 in the average, about a 4 s time constant
+#define EWMA_SHIFT 3
+#define ETA_MAX_SECONDS (99 * 3600)
+
+void romi_throughput_reset(RomiThroughput* tp)
+{
+    memset(tp->buckets, 0, sizeof(tp->buckets));
+    tp->slot = romi_time_msec() / ROMI_THROUGHPUT_BUCKET_MSEC;
+    tp->closed = 0;
+    tp->ewma = 0;
+    tp->deviation = 0;
+    tp->instant = 0;
+}
+
+static void close_bucket(RomiThroughput* tp)
+{
+    uint32_t index = tp->slot % ROMI_THROUGHPUT_BUCKETS;
+    uint32_t rate = tp->buckets[index] * (1000 / ROMI_THROUGHPUT_BUCKET_MSEC);
+
+    if (tp->closed == 0)
+    {
+        tp->ewma = rate;
+        tp->deviation = rate / 2;
+    }
+    else
+    {
+        // same smoothing as TCP's RTT estimator: deviation first, against the old mean
+        uint32_t ewma = tp->ewma;
+        uint32_t error = rate > ewma ? rate - ewma : ewma - rate;
+        tp->deviation = tp->deviation - (tp->deviation >> EWMA_SHIFT) + (error >> EWMA_SHIFT);
+        tp->ewma = rate > ewma ? ewma + ((rate - ewma) >> EWMA_SHIFT) : ewma - ((ewma - rate) >> EWMA_SHIFT);
+    }
+
+    if (tp->closed < ROMI_THROUGHPUT_BUCKETS)
+        tp->closed++;
+
+    uint32_t count = min32(tp->closed, ROMI_THROUGHPUT_INSTANT);
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < count; i++)
+        sum += tp->buckets[(tp->slot - i) % ROMI_THROUGHPUT_BUCKETS];
+    tp->instant = (uint32_t)(sum * 1000 / (count * ROMI_THROUGHPUT_BUCKET_MSEC));
+
+    tp->slot++;
+    tp->buckets[tp->slot % ROMI_THROUGHPUT_BUCKETS] = 0;
+}
+
+void romi_throughput_tick(RomiThroughput* tp)
+{
+    uint32_t slot = romi_time_msec() / ROMI_THROUGHPUT_BUCKET_MSEC;
+
+    // after a long gap (retry backoff, stalled socket) every missed bucket
+    // counts as zero, a full ring of them is enough to decay the average
+    for (uint32_t i = 0; tp->slot != slot && i < ROMI_THROUGHPUT_BUCKETS; i++)
+        close_bucket(tp);
+
+    // when the gap was longer than the ring every bucket is zero already
+    tp->slot = slot;
+}
+
+void romi_throughput_add(RomiThroughput* tp, uint32_t bytes)
+{
+    romi_throughput_tick(tp);
+    tp->buckets[tp->slot % ROMI_THROUGHPUT_BUCKETS] += bytes;
+}
+
+uint32_t romi_throughput_speed(const RomiThroughput* tp)
+{
+    return tp->ewma;
+}
+
+uint32_t romi_throughput_instant(const RomiThroughput* tp)
+{
+    return tp->instant;
+}
+
+static uint32_t eta_seconds(uint64_t remaining, uint32_t speed)
+{
+    if (speed == 0)
+        return ETA_MAX_SECONDS;
+    return (uint32_t)min64((remaining + speed - 1) / speed, ETA_MAX_SECONDS);
+}
+
+int romi_throughput_eta_for(uint32_t speed, uint32_t deviation, uint64_t remaining, uint32_t* eta, uint32_t* eta_min, uint32_t* eta_max)
+{
+    if (speed == 0)
+        return 0;
+
+    // two mean deviations either side, the slow end never below a tenth of the speed
+    uint32_t band = deviation * 2;
+    uint32_t slow = speed > band ? max32(speed - band, speed / 10) : speed / 10;
+
+    *eta = eta_seconds(remaining, speed);
+    *eta_min = eta_seconds(remaining, speed + band);
+    *eta_max = eta_seconds(remaining, slow);
+    return 1;
+}
+
+int romi_throughput_eta(const RomiThroughput* tp, uint64_t remaining, uint32_t* eta, uint32_t* eta_min, uint32_t* eta_max)
+{
+    // read each published word once, the writer may update them in between
+    uint32_t speed = tp->ewma;
+    uint32_t deviation = tp->deviation;
+    return romi_throughput_eta_for(speed, deviation, remaining, eta, eta_min, eta_max);
+}
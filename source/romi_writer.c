@@ -0,0 +1,180 @@
+#include "romi_writer.h"
+#include "romi.h"
+#include "romi_utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#define WRITER_POLL_MSEC 2
+
+typedef struct {
+    uint8_t* data;
+    uint32_t used;
+} WriterBlock;
+
+// Single producer / single consumer: only the producer advances tail and
+// only the consumer advances head, so the indices need barriers but no lock.
+struct RomiWriter {
+    WriterBlock blocks[ROMI_WRITER_BLOCKS];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile int closing;
+    volatile int finished;
+    volatile int failed;
+
+    RomiWriterSink sink;
+    void* sink_arg;
+
+    RomiWriterStats stats;
+};
+
+static void writer_thread(void* arg)
+{
+    RomiWriter* writer = arg;
+
+    for (;;)
+    {
+        uint32_t head = writer->head;
+
+        if (head == writer->tail)
+        {
+            // closing is set after the last block was published, re-check tail behind the barrier
+            __sync_synchronize();
+            if (writer->closing && head == writer->tail)
+                break;
+
+            writer->stats.consumer_idles++;
+            romi_sleep(WRITER_POLL_MSEC);
+            continue;
+        }
+
+        // pairs with the barrier before the producer publishes tail
+        __sync_synchronize();
+
+        WriterBlock* block = &writer->blocks[head % ROMI_WRITER_BLOCKS];
+        if (!writer->failed)
+        {
+            if (writer->sink(writer->sink_arg, block->data, block->used))
+                writer->stats.bytes_written += block->used;
+            else
+                writer->failed = 1;
+        }
+        block->used = 0;
+
+        __sync_synchronize();
+        writer->head = head + 1;
+    }
+
+    __sync_synchronize();
+    writer->finished = 1;
+    romi_thread_exit();
+}
+
+static void writer_free(RomiWriter* writer)
+{
+    for (int i = 0; i < ROMI_WRITER_BLOCKS; i++)
+        free(writer->blocks[i].data);
+    free(writer);
+}
+
+RomiWriter* romi_writer_open(RomiWriterSink sink, void* sink_arg)
+{
+    RomiWriter* writer = malloc(sizeof(RomiWriter));
+    if (!writer)
+        return NULL;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->sink = sink;
+    writer->sink_arg = sink_arg;
+
+    for (int i = 0; i < ROMI_WRITER_BLOCKS; i++)
+    {
+        writer->blocks[i].data = memalign(ROMI_WRITER_ALIGN, ROMI_WRITER_BLOCK_SIZE);
+        if (!writer->blocks[i].data)
+        {
+            LOG("cannot allocate write-behind buffer");
+            writer_free(writer);
+            return NULL;
+        }
+    }
+
+    // without a consumer the producer would wait for free blocks forever
+    if (!romi_start_thread_arg("writer_thread", writer_thread, writer))
+    {
+        writer_free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+static void writer_publish(RomiWriter* writer)
+{
+    __sync_synchronize();
+    writer->tail = writer->tail + 1;
+}
+
+int romi_writer_write(RomiWriter* writer, const void* data, uint32_t size)
+{
+    const uint8_t* src = data;
+
+    while (size > 0)
+    {
+        if (writer->failed)
+            return 0;
+
+        // the block at tail belongs to the producer until tail moves past it,
+        // the consumer hands blocks back emptied
+        if (writer->tail - writer->head == ROMI_WRITER_BLOCKS)
+        {
+            uint32_t start = romi_time_msec();
+            writer->stats.producer_stalls++;
+
+            while (writer->tail - writer->head == ROMI_WRITER_BLOCKS && !writer->failed)
+                romi_sleep(WRITER_POLL_MSEC);
+
+            writer->stats.producer_stall_msec += romi_time_msec() - start;
+            continue;
+        }
+
+        WriterBlock* block = &writer->blocks[writer->tail % ROMI_WRITER_BLOCKS];
+        uint32_t chunk = min32(size, ROMI_WRITER_BLOCK_SIZE - block->used);
+
+        memcpy(block->data + block->used, src, chunk);
+        block->used += chunk;
+        src += chunk;
+        size -= chunk;
+
+        if (block->used == ROMI_WRITER_BLOCK_SIZE)
+            writer_publish(writer);
+    }
+
+    return !writer->failed;
+}
+
+int romi_writer_close(RomiWriter* writer, RomiWriterStats* stats)
+{
+    // with a full ring every block is already published, otherwise flush the one being filled
+    if (writer->tail - writer->head < ROMI_WRITER_BLOCKS &&
+        writer->blocks[writer->tail % ROMI_WRITER_BLOCKS].used > 0)
+        writer_publish(writer);
+
+    __sync_synchronize();
+    writer->closing = 1;
+
+    while (!writer->finished)
+        romi_sleep(WRITER_POLL_MSEC);
+
+    LOG("write-behind: %llu bytes, %u stalls on storage (%u ms), %u waits on network",
+        writer->stats.bytes_written, writer->stats.producer_stalls,
+        writer->stats.producer_stall_msec, writer->stats.consumer_idles);
+
+    if (stats)
+        *stats = writer->stats;
+
+    int success = !writer->failed;
+    writer_free(writer);
+
+    return success;
+}
@@ -0,0 +1,269 @@
+#include "romi_zip.h"
+#include "romi.h"
+#include "romi_utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ZIP_LOCAL_HEADER_SIG    0x04034b50
+#define ZIP_CENTRAL_DIR_SIG     0x02014b50
+#define ZIP_END_CENTRAL_DIR_SIG 0x06054b50
+#define ZIP64_END_CENTRAL_DIR_SIG 0x06064b50
+#define ZIP64_END_LOCATOR_SIG   0x07064b50
+
+#define ZIP_LOCAL_HEADER_SIZE   30
+#define ZIP_CENTRAL_DIR_SIZE    46
+#define ZIP_END_CENTRAL_DIR_SIZE 22
+#define ZIP64_END_CENTRAL_DIR_SIZE 56
+#define ZIP64_END_LOCATOR_SIZE  20
+// the record ends the file, followed only by a comment of at most 64 KB
+#define ZIP_END_SEARCH_SIZE     (ZIP_END_CENTRAL_DIR_SIZE + 0xffff)
+
+static int read_at(void* f, uint64_t offset, void* buffer, uint32_t size)
+{
+    return romi_seek(f, offset) && romi_read(f, buffer, size) == (int)size;
+}
+
+// Finds the end of central directory record, scanning backwards over the comment
+static RomiExtractResult find_end_record(void* f, uint64_t file_size, uint8_t* record, uint64_t* record_offset)
+{
+    if (file_size < ZIP_END_CENTRAL_DIR_SIZE)
+        return ExtractErrorFormat;
+
+    uint32_t size = (uint32_t)min64(file_size, ZIP_END_SEARCH_SIZE);
+    uint8_t* tail = malloc(size);
+    if (!tail)
+        return ExtractErrorMemory;
+
+    if (!read_at(f, file_size - size, tail, size))
+    {
+        free(tail);
+        return ExtractErrorRead;
+    }
+
+    RomiExtractResult result = ExtractErrorFormat;
+    for (uint32_t pos = size - ZIP_END_CENTRAL_DIR_SIZE + 1; pos-- > 0; )
+    {
+        if (get32le(tail + pos) == ZIP_END_CENTRAL_DIR_SIG)
+        {
+            memcpy(record, tail + pos, ZIP_END_CENTRAL_DIR_SIZE);
+            *record_offset = file_size - size + pos;
+            result = ExtractOK;
+            break;
+        }
+    }
+
+    free(tail);
+    return result;
+}
+
+// Archives over 4 GB or 65535 entries keep the real values in a zip64 end
+// record, found through the locator right in front of the classic one
+static RomiExtractResult read_zip64_end_record(void* f, uint64_t record_offset, uint64_t* count, uint64_t* dir_size, uint64_t* dir_offset)
+{
+    int marked = *count == 0xffff || *dir_size == 0xffffffff || *dir_offset == 0xffffffff;
+
+    uint8_t locator[ZIP64_END_LOCATOR_SIZE];
+    if (record_offset < sizeof(locator) || !read_at(f, record_offset - sizeof(locator), locator, sizeof(locator))
+        || get32le(locator) != ZIP64_END_LOCATOR_SIG)
+    {
+        if (marked)
+        {
+            LOG("zip64 end of central directory locator missing");
+            return ExtractErrorFormat;
+        }
+        return ExtractOK;
+    }
+
+    uint8_t record[ZIP64_END_CENTRAL_DIR_SIZE];
+    if (!read_at(f, get64le(locator + 8), record, sizeof(record)))
+        return ExtractErrorRead;
+
+    if (get32le(record) != ZIP64_END_CENTRAL_DIR_SIG)
+    {
+        LOG("zip64 end of central directory record not found");
+        return ExtractErrorFormat;
+    }
+
+    *count = get64le(record + 32);
+    *dir_size = get64le(record + 40);
+    *dir_offset = get64le(record + 48);
+    return ExtractOK;
+}
+
+static RomiExtractResult parse_directory(const uint8_t* data, uint32_t size, RomiZipDirectory* dir)
+{
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < dir->count; i++)
+    {
+        if (size - pos < ZIP_CENTRAL_DIR_SIZE || get32le(data + pos) != ZIP_CENTRAL_DIR_SIG)
+            return ExtractErrorFormat;
+
+        const uint8_t* record = data + pos;
+        uint32_t name_len = get16le(record + 28);
+        uint32_t extra_len = get16le(record + 30);
+        uint32_t comment_len = get16le(record + 32);
+
+        uint32_t record_size = ZIP_CENTRAL_DIR_SIZE + name_len + extra_len + comment_len;
+        if (size - pos < record_size)
+            return ExtractErrorFormat;
+
+        RomiZipEntry* entry = &dir->entries[i];
+        entry->flags = get16le(record + 8);
+        entry->method = get16le(record + 10);
+        entry->crc32 = get32le(record + 16);
+        entry->comp_size = get32le(record + 20);
+        entry->uncomp_size = get32le(record + 24);
+        entry->header_offset = get32le(record + 42);
+
+        if (!romi_zip64_extra(record + ZIP_CENTRAL_DIR_SIZE + name_len, extra_len, &entry->uncomp_size, &entry->comp_size, &entry->header_offset))
+        {
+            LOG("zip64 extra field missing for entry %u", i);
+            return ExtractErrorFormat;
+        }
+
+        uint32_t copy = min32(name_len, sizeof(entry->name) - 1);
+        memcpy(entry->name, record + ZIP_CENTRAL_DIR_SIZE, copy);
+        entry->name[copy] = 0;
+
+        dir->total += entry->uncomp_size;
+        pos += record_size;
+    }
+
+    return ExtractOK;
+}
+
+RomiExtractResult romi_zip_read_directory(const char* path, RomiZipDirectory* dir)
+{
+    memset(dir, 0, sizeof(*dir));
+
+    int64_t file_size = romi_get_size(path);
+    if (file_size < 0)
+        return ExtractErrorOpen;
+
+    void* f = romi_open(path);
+    if (!f)
+        return ExtractErrorOpen;
+
+    uint8_t record[ZIP_END_CENTRAL_DIR_SIZE];
+    uint64_t record_offset = 0;
+    RomiExtractResult result = find_end_record(f, (uint64_t)file_size, record, &record_offset);
+    if (result != ExtractOK)
+    {
+        romi_close(f);
+        return result;
+    }
+
+    uint64_t count = get16le(record + 10);
+    uint64_t dir_size = get32le(record + 12);
+    uint64_t dir_offset = get32le(record + 16);
+
+    result = read_zip64_end_record(f, record_offset, &count, &dir_size, &dir_offset);
+    if (result != ExtractOK)
+    {
+        romi_close(f);
+        return result;
+    }
+
+    if (dir_size > ROMI_ZIP_MAX_DIRECTORY || count > dir_size / ZIP_CENTRAL_DIR_SIZE
+        || dir_size > (uint64_t)file_size || dir_offset > (uint64_t)file_size - dir_size)
+    {
+        LOG("central directory of %llu entries, %llu bytes at %llu doesn't fit the archive",
+            (unsigned long long)count, (unsigned long long)dir_size, (unsigned long long)dir_offset);
+        romi_close(f);
+        return ExtractErrorFormat;
+    }
+
+    uint8_t* data = malloc(dir_size ? (size_t)dir_size : 1);
+    dir->entries = calloc(count ? (size_t)count : 1, sizeof(RomiZipEntry));
+    dir->count = (uint32_t)count;
+
+    if (!data || !dir->entries)
+        result = ExtractErrorMemory;
+    else if (!read_at(f, dir_offset, data, (uint32_t)dir_size))
+        result = ExtractErrorRead;
+    else
+        result = parse_directory(data, (uint32_t)dir_size, dir);
+
+    free(data);
+    romi_close(f);
+
+    if (result != ExtractOK)
+    {
+        romi_zip_free_directory(dir);
+        return result;
+    }
+
+    LOG("zip directory of %s: %u entries, %llu bytes", path, dir->count, (unsigned long long)dir->total);
+    return ExtractOK;
+}
+
+void romi_zip_free_directory(RomiZipDirectory* dir)
+{
+    free(dir->entries);
+    memset(dir, 0, sizeof(*dir));
+}
+
+RomiExtractResult romi_zip_seek_data(void* f, const RomiZipEntry* entry)
+{
+    // the name and extra field may differ from the central directory's copy
+    uint8_t header[ZIP_LOCAL_HEADER_SIZE];
+    if (!read_at(f, entry->header_offset, header, sizeof(header)))
+        return ExtractErrorRead;
+
+    if (get32le(header) != ZIP_LOCAL_HEADER_SIG)
+        return ExtractErrorFormat;
+
+    uint64_t data_offset = entry->header_offset + sizeof(header) + get16le(header + 26) + get16le(header + 28);
+    return romi_seek(f, data_offset) ? ExtractOK : ExtractErrorRead;
+}
+
+const uint8_t* romi_zip_find_extra(const uint8_t* extra, uint32_t size, uint16_t id, uint32_t* len)
+{
+    for (uint32_t pos = 0; pos + 4 <= size; )
+    {
+        uint32_t record_id = get16le(extra + pos);
+        uint32_t record_len = get16le(extra + pos + 2);
+        pos += 4;
+        if (record_len > size - pos)
+            break;
+
+        if (record_id == id)
+        {
+            *len = record_len;
+            return extra + pos;
+        }
+        pos += record_len;
+    }
+
+    return NULL;
+}
+
+int romi_zip64_extra(const uint8_t* extra, uint32_t size, uint64_t* uncomp_size, uint64_t* comp_size, uint64_t* header_offset)
+{
+    uint64_t* fields[3] = { uncomp_size, comp_size, header_offset };
+
+    int needed = 0;
+    for (int i = 0; i < 3; i++)
+        needed += fields[i] && *fields[i] == 0xffffffff;
+    if (!needed)
+        return 1;
+
+    uint32_t len;
+    const uint8_t* value = romi_zip_find_extra(extra, size, ROMI_ZIP64_EXTRA_ID, &len);
+    if (!value)
+        return 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (!fields[i] || *fields[i] != 0xffffffff)
+            continue;
+        if (len < 8)
+            return 0;
+        *fields[i] = get64le(value);
+        value += 8;
+        len -= 8;
+    }
+
+    return 1;
+}
@@ -168,6 +168,7 @@ class RomEntry:
     name: str
     url: str
     size: int
+    crc32: str = ""
 
 
 def detect_region(filename: str) -> str:
@@ -296,6 +297,7 @@ def parse_archive_files(
         name = f.get("name", "")
         fmt = f.get("format", "").upper()
         size = int(f.get("size", 0))
+        crc32 = f.get("crc32", "").lower()
         private = f.get("private") == "true"
 
         # Skip directories (no format or name ends with /)
@@ -353,6 +355,7 @@ def parse_archive_files(
             name=clean,
             url=download_url,
             size=size,
+            crc32=crc32 if re.fullmatch(r"[0-9a-f]{8}", crc32) else "",
         ))
 
     return entries
@@ -489,8 +492,11 @@ def write_databases(
                     url_field = entry.url
 
                 platform_name = PLATFORM_FILENAME_MAP.get(entry.platform, entry.platform)
-                line = f"{platform_name}\t{entry.region}\t{entry.name}\t{url_field}\t{entry.size}\n"
-                f.write(line)
+                line = f"{platform_name}\t{entry.region}\t{entry.name}\t{url_field}\t{entry.size}"
+                # optional HASH column, ROMi verifies the download against it
+                if entry.crc32:
+                    line += f"\t{entry.crc32}"
+                f.write(line + "\n")
 
         file_size = output_file.stat().st_size
         total_bytes += file_size
@@ -0,0 +1,268 @@
+// Host-side throughput benchmark for the network and download layers.
+//
+// Runs each synthetic file of tools/bench/bench_server.py through the same
+// code the PS3 uses and reports MB/s, CPU time per MB and time to first
+// byte, so changes to buffering, the write-behind ring or the extractor can
+// be compared on a PC before they are tried on hardware.
+//
+// Modes:
+//   read    romi_http_get + romi_http_read into a counting sink, the bare network layer
+//   fetch   romi_download_rom to a file: HEAD, write-behind ring, temp file and install
+//   stream  romi_download_rom of a ZIP, extracted on the fly while it downloads
+
+#include "romi.h"
+#include "romi_bandwidth.h"
+#include "romi_crc32.h"
+#include "romi_download.h"
+#include "romi_host.h"
+#include "romi_metrics.h"
+#include "romi_mirror.h"
+#include "romi_redirect.h"
+#include "romi_space.h"
+#include "romi_utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_RUNS 32
+// the only entry of the server's 10m.zip
+#define BENCH_ZIP_ENTRY "stream.bin"
+
+typedef enum {
+    ModeRead,
+    ModeFetch,
+    ModeStream,
+} BenchMode;
+
+static const char* mode_names[] = { "read", "fetch", "stream" };
+
+typedef struct {
+    const char* path;
+    BenchMode mode;
+    int large;          // only with -l, it needs several GB of disk in fetch mode
+} BenchCase;
+
+static const BenchCase bench_cases[] = {
+    { "20k.bin", ModeRead,   0 },
+    { "20k.bin", ModeFetch,  0 },
+    { "10m.bin", ModeRead,   0 },
+    { "10m.bin", ModeFetch,  0 },
+    { "10m.zip", ModeStream, 0 },
+    { "4g.bin",  ModeRead,   0 },
+    { "4g.bin",  ModeFetch,  1 },
+};
+
+typedef struct {
+    uint64_t bytes;
+    uint32_t wall_msec;
+    uint32_t cpu_msec;
+    uint32_t ttfb_msec;
+    uint32_t redirects;
+} BenchRun;
+
+static uint64_t cpu_msec(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+static uint64_t wall_msec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static size_t null_sink(void* buffer, size_t size, size_t nmemb, void* stream)
+{
+    ROMI_UNUSED(buffer);
+    *(uint64_t*)stream += size * nmemb;
+    return size * nmemb;
+}
+
+static int run_read(const char* url, BenchRun* run)
+{
+    romi_http* http = romi_http_get(url, NULL, 0, 1);
+    if (!http)
+        return 0;
+
+    uint64_t received = 0;
+    int ok = romi_http_read(http, null_sink, &received, NULL, NULL);
+
+    romi_http_metrics metrics;
+    romi_http_get_metrics(http, &metrics);
+    romi_http_close(http);
+
+    run->bytes = received;
+    run->ttfb_msec = metrics.ttfb_msec;
+    run->redirects = metrics.redirects;
+    return ok;
+}
+
+static int run_download(const char* url, const char* name, int stream, BenchRun* run)
+{
+    DbItem item;
+    memset(&item, 0, sizeof(item));
+    item.platform = PlatformNES;
+    item.name = name;
+    item.url = url;
+
+    RomiTransfer transfer;
+    romi_transfer_init(&transfer, NULL, NULL);
+
+    int ok = romi_download_rom(&item, &transfer);
+
+    run->bytes = transfer.metrics.bytes;
+    run->ttfb_msec = transfer.metrics.ttfb_msec;
+    run->redirects = transfer.metrics.redirects;
+
+    // keep the disk usage of the 4 GB case down to a single copy
+    if (ok && stream)
+    {
+        char folder[512], path[768];
+        romi_platform_folder(item.platform, folder, sizeof(folder));
+        romi_snprintf(path, sizeof(path), "%s/%s", folder, BENCH_ZIP_ENTRY);
+        romi_rm(path);
+    }
+    else if (ok)
+    {
+        romi_rm(transfer.install_path);
+    }
+
+    return ok;
+}
+
+static int run_case(const char* base_url, const BenchCase* bench, BenchRun* run)
+{
+    char url[1024];
+    romi_snprintf(url, sizeof(url), "%s/%s", base_url, bench->path);
+
+    uint64_t cpu_start = cpu_msec();
+    uint64_t wall_start = wall_msec();
+
+    int ok = bench->mode == ModeRead ? run_read(url, run) : run_download(url, bench->path, bench->mode == ModeStream, run);
+
+    run->wall_msec = (uint32_t)(wall_msec() - wall_start);
+    run->cpu_msec = (uint32_t)(cpu_msec() - cpu_start);
+    return ok;
+}
+
+static int compare_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const BenchCase* bench, const BenchRun* runs, uint32_t count)
+{
+    uint64_t bytes = 0, wall = 0, cpu = 0;
+    uint32_t ttfb[BENCH_MAX_RUNS];
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        bytes += runs[i].bytes;
+        wall += runs[i].wall_msec;
+        cpu += runs[i].cpu_msec;
+        ttfb[i] = runs[i].ttfb_msec;
+    }
+    qsort(ttfb, count, sizeof(ttfb[0]), compare_u32);
+
+    double mb = bytes / (1024.0 * 1024.0);
+    printf("%-10s %-7s %4u %10.1f %11.2f %9u %5u\n",
+        bench->path, mode_names[bench->mode], count,
+        wall ? mb * 1000.0 / wall : 0.0,
+        mb > 0 ? cpu / mb : 0.0,
+        ttfb[count / 2], runs[0].redirects);
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [-n runs] [-m read|fetch|stream] [-f file] [-l] [-d dir] base_url\n"
+        "  -n runs   repetitions of every case, the report shows means and the median TTFB (default 3)\n"
+        "  -m mode   only run cases of this mode\n"
+        "  -f file   only run cases for this file, e.g. 10m.bin\n"
+        "  -l        include the 4 GB file in fetch mode, needs 4 GB free in dir\n"
+        "  -d dir    work folder for temp files, installs and transfers.csv (default /tmp/romi_bench)\n",
+        name);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t runs = 3;
+    const char* mode = NULL;
+    const char* file = NULL;
+    const char* folder = "/tmp/romi_bench";
+    int large = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:m:f:ld:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': runs = (uint32_t)atoi(optarg); break;
+        case 'm': mode = optarg; break;
+        case 'f': file = optarg; break;
+        case 'l': large = 1; break;
+        case 'd': folder = optarg; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+
+    if (optind != argc - 1 || runs == 0 || runs > BENCH_MAX_RUNS)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    const char* base_url = argv[optind];
+
+    romi_host_set_folder(folder);
+    romi_mkdirs(folder);
+
+    romi_crc32_init();
+    romi_bandwidth_init();
+    romi_mirror_init();
+    romi_metrics_init();
+    romi_redirect_init();
+    romi_space_init();
+
+    printf("%-10s %-7s %4s %10s %11s %9s %5s\n", "file", "mode", "runs", "MB/s", "CPU ms/MB", "TTFB ms", "redir");
+
+    int failed = 0;
+    for (size_t i = 0; i < ROMI_COUNTOF(bench_cases); i++)
+    {
+        const BenchCase* bench = &bench_cases[i];
+        if (bench->large && !large)
+            continue;
+        if (mode && strcmp(mode, mode_names[bench->mode]) != 0)
+            continue;
+        if (file && strcmp(file, bench->path) != 0)
+            continue;
+
+        BenchRun results[BENCH_MAX_RUNS];
+        memset(results, 0, sizeof(results));
+
+        uint32_t done = 0;
+        for (; done < runs; done++)
+        {
+            if (!run_case(base_url, bench, &results[done]))
+            {
+                fprintf(stderr, "%s (%s) failed on run %u\n", bench->path, mode_names[bench->mode], done + 1);
+                failed = 1;
+                break;
+            }
+        }
+
+        if (done > 0)
+            report(bench, results, done);
+    }
+
+    return failed;
+}
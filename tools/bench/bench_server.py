@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""
+Benchmark HTTP Server
+
+Local stand-in for a ROM mirror, used by `make bench-net`. Serves synthetic
+files generated on the fly, so the 4 GB case needs no disk space:
+
+    /20k.bin   20 KB
+    /10m.bin   10 MB
+    /4g.bin    4 GB
+    /10m.zip   ZIP with one deflated 10 MB entry, for streaming extraction
+
+Usage:
+    python3 tools/bench/bench_server.py [--port 8642]
+        [--latency MS]          wait before every response, as a distant mirror would
+        [--rate BYTES_PER_SEC]  throttle every response body
+        [--redirects N]         bounce each request through N redirects first
+
+Range requests are honoured and connections are kept alive like on a real
+mirror.
+"""
+import argparse
+import io
+import random
+import re
+import time
+import zipfile
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+CHUNK = 1024 * 1024
+PATTERN_SIZE = 1024 * 1024
+
+# Incompressible, so deflate does real work, but cheap to serve at any offset
+PATTERN = random.Random(0x524F4D69).randbytes(PATTERN_SIZE)
+
+SIZES = {
+    "/20k.bin": 20 * 1024,
+    "/10m.bin": 10 * 1024 * 1024,
+    "/4g.bin": 4 * 1024 * 1024 * 1024,
+}
+
+
+def pattern_bytes(offset, length):
+    start = offset % PATTERN_SIZE
+    data = PATTERN[start:start + length]
+    while len(data) < length:
+        data += PATTERN[:length - len(data)]
+    return data
+
+
+def build_zip(size):
+    buffer = io.BytesIO()
+    with zipfile.ZipFile(buffer, "w", zipfile.ZIP_DEFLATED, compresslevel=1) as archive:
+        with archive.open("stream.bin", "w") as entry:
+            for offset in range(0, size, CHUNK):
+                entry.write(pattern_bytes(offset, min(CHUNK, size - offset)))
+    return buffer.getvalue()
+
+
+class BenchHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    options = None
+    zip_data = b""
+
+    def log_message(self, format, *args):
+        if self.options.verbose:
+            super().log_message(format, *args)
+
+    def resolve(self):
+        url = urlsplit(self.path)
+        hop = int(parse_qs(url.query).get("hop", ["0"])[0])
+
+        if self.options.latency:
+            time.sleep(self.options.latency / 1000.0)
+
+        if hop < self.options.redirects:
+            self.send_response(302)
+            self.send_header("Location", f"{url.path}?hop={hop + 1}")
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return None
+
+        if url.path == "/10m.zip":
+            return len(self.zip_data), lambda offset, length: self.zip_data[offset:offset + length]
+        if url.path in SIZES:
+            return SIZES[url.path], pattern_bytes
+
+        self.send_error(404)
+        return None
+
+    def send_head_range(self):
+        resolved = self.resolve()
+        if resolved is None:
+            return None
+        size, read = resolved
+
+        start, end = 0, size - 1
+        partial_content = False
+
+        match = re.match(r"bytes=(\d*)-(\d*)", self.headers.get("Range", ""))
+        if match:
+            if match.group(1):
+                start = int(match.group(1))
+                if match.group(2):
+                    end = min(int(match.group(2)), size - 1)
+            elif match.group(2):
+                start = max(size - int(match.group(2)), 0)
+            if start >= size:
+                self.send_response(416)
+                self.send_header("Content-Range", f"bytes */{size}")
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return None
+            partial_content = True
+
+        self.send_response(206 if partial_content else 200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(end - start + 1))
+        self.send_header("Accept-Ranges", "bytes")
+        if partial_content:
+            self.send_header("Content-Range", f"bytes {start}-{end}/{size}")
+        self.end_headers()
+        return read, start, end
+
+    def do_HEAD(self):
+        self.send_head_range()
+
+    def do_GET(self):
+        head = self.send_head_range()
+        if head is None:
+            return
+        read, start, end = head
+
+        chunk = min(CHUNK, self.options.rate) if self.options.rate else CHUNK
+        sent = 0
+        began = time.monotonic()
+        offset = start
+        while offset <= end:
+            data = read(offset, min(chunk, end - offset + 1))
+            try:
+                self.wfile.write(data)
+            except (BrokenPipeError, ConnectionResetError):
+                self.close_connection = True
+                return
+            offset += len(data)
+            sent += len(data)
+
+            if self.options.rate:
+                ahead = sent / self.options.rate - (time.monotonic() - began)
+                if ahead > 0:
+                    time.sleep(ahead)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Synthetic mirror for the network benchmark")
+    parser.add_argument("--port", type=int, default=8642)
+    parser.add_argument("--latency", type=int, default=0)
+    parser.add_argument("--rate", type=int, default=0)
+    parser.add_argument("--redirects", type=int, default=0)
+    parser.add_argument("--verbose", action="store_true")
+    options = parser.parse_args()
+
+    BenchHandler.options = options
+    BenchHandler.zip_data = build_zip(SIZES["/10m.bin"])
+
+    server = ThreadingHTTPServer(("127.0.0.1", options.port), BenchHandler)
+    server.daemon_threads = True
+    print(f"Serving synthetic files on port {options.port}", flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,205 @@
+// Host-side check and benchmark of the ZIP extractors.
+//
+// Runs every archive given on the command line through both ways the PS3
+// unpacks a download and reports the result, MB/s of extracted data and CPU
+// time per MB:
+//
+//   extract  romi_extract_zip on the archive on disk, central directory and worker threads
+//   stream   romi_zip_stream_write fed the archive in download-sized chunks
+//
+// `make bench-extract` runs it on ZIP64 archives over 4 GB written by
+// tools/bench/zip64_gen.py. Extracted files are removed after each run.
+
+#include "romi.h"
+#include "romi_crc32.h"
+#include "romi_extract.h"
+#include "romi_host.h"
+#include "romi_space.h"
+#include "romi_utils.h"
+#include "romi_zip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+// what a curl write callback hands over at a time
+#define BENCH_STREAM_CHUNK (16 * 1024)
+
+typedef enum {
+    ModeExtract,
+    ModeStream,
+    ModeCount,
+} BenchMode;
+
+static const char* mode_names[ModeCount] = { "extract", "stream" };
+
+static uint64_t cpu_msec(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+static uint64_t wall_msec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static const char* archive_name(const char* path)
+{
+    const char* slash = romi_strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static void extract_done(void* arg, const char* filename, uint64_t extracted, uint64_t total)
+{
+    ROMI_UNUSED(total);
+    if (!filename)
+        *(uint64_t*)arg = extracted;
+}
+
+static RomiExtractResult run_stream(const char* path, const char* dest_folder)
+{
+    void* f = romi_open(path);
+    if (!f)
+        return ExtractErrorOpen;
+
+    volatile int cancelled = 0;
+    RomiZipStream* zs = romi_zip_stream_open(dest_folder, &cancelled, NULL);
+    if (!zs)
+    {
+        romi_close(f);
+        return ExtractErrorMemory;
+    }
+
+    static uint8_t buffer[BENCH_STREAM_CHUNK];
+    int read;
+    while ((read = romi_read(f, buffer, sizeof(buffer))) > 0)
+    {
+        if (romi_zip_stream_write(zs, buffer, (uint32_t)read) != ExtractOK)
+            break;
+    }
+
+    romi_close(f);
+    return romi_zip_stream_close(zs);
+}
+
+// Every file listed by the central directory, so both modes clean up the same way
+static void remove_extracted(const RomiZipDirectory* dir, const char* dest_folder)
+{
+    for (uint32_t i = 0; i < dir->count; i++)
+    {
+        char path[512];
+        romi_snprintf(path, sizeof(path), "%s/%s", dest_folder, dir->entries[i].name);
+        romi_rm(path);
+    }
+}
+
+static int run_case(const char* path, BenchMode mode, const char* folder, int keep)
+{
+    RomiZipDirectory dir;
+    RomiExtractResult result = romi_zip_read_directory(path, &dir);
+    if (result != ExtractOK)
+    {
+        printf("%-24s %-8s %s\n", archive_name(path), mode_names[mode], romi_extract_error_string(result));
+        return 0;
+    }
+
+    char dest_folder[256];
+    romi_snprintf(dest_folder, sizeof(dest_folder), "%s/%s", folder, mode_names[mode]);
+    romi_mkdirs(dest_folder);
+
+    uint64_t cpu_start = cpu_msec();
+    uint64_t wall_start = wall_msec();
+
+    uint64_t extracted = dir.total;
+    if (mode == ModeExtract)
+    {
+        volatile int cancelled = 0;
+        result = romi_extract_zip(path, dest_folder, extract_done, &extracted, &cancelled);
+    }
+    else
+    {
+        result = run_stream(path, dest_folder);
+    }
+
+    uint64_t wall = wall_msec() - wall_start;
+    uint64_t cpu = cpu_msec() - cpu_start;
+
+    // extract reports what it wrote, stream is taken at its word once it passed the crc checks
+    double mb = extracted / (1024.0 * 1024.0);
+    printf("%-24s %-8s %5u %12llu %10.1f %11.2f  %s\n",
+        archive_name(path), mode_names[mode], dir.count, (unsigned long long)extracted,
+        wall ? mb * 1000.0 / wall : 0.0, mb > 0 ? cpu / mb : 0.0,
+        romi_extract_error_string(result));
+
+    int ok = result == ExtractOK && extracted == dir.total;
+
+    if (!keep)
+        remove_extracted(&dir, dest_folder);
+    romi_zip_free_directory(&dir);
+
+    return ok;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [-m extract|stream] [-d dir] [-k] archive.zip...\n"
+        "  -m mode   only run this mode\n"
+        "  -d dir    work folder, the files are extracted below it (default /tmp/romi_extract)\n"
+        "  -k        keep the extracted files\n",
+        name);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* mode = NULL;
+    const char* folder = "/tmp/romi_extract";
+    int keep = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:d:k")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm': mode = optarg; break;
+        case 'd': folder = optarg; break;
+        case 'k': keep = 1; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+
+    if (optind == argc)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    romi_host_set_folder(folder);
+    romi_mkdirs(folder);
+    romi_crc32_init();
+    romi_space_init();
+
+    printf("%-24s %-8s %5s %12s %10s %11s  %s\n", "archive", "mode", "files", "bytes", "MB/s", "CPU ms/MB", "result");
+
+    int failed = 0;
+    for (int i = optind; i < argc; i++)
+    {
+        for (int m = 0; m < ModeCount; m++)
+        {
+            if (mode && strcmp(mode, mode_names[m]) != 0)
+                continue;
+            if (!run_case(argv[i], (BenchMode)m, folder, keep))
+                failed = 1;
+        }
+    }
+
+    return failed;
+}
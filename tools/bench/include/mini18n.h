@@ -0,0 +1,4 @@
+#pragma once
+
+// The benchmark has no translations, strings pass through unchanged
+#define _(str) (str)
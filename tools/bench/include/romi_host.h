@@ -0,0 +1,10 @@
+#pragma once
+
+// Host build only: points the config, temp and storage folders of the
+// platform layer at folder instead of the PS3 paths
+void romi_host_set_folder(const char* folder);
+
+// Host build only: allocates the blocks of a just created file up to its
+// final size with posix_fallocate; returns 0 if unsupported. lv2 has no call
+// that allocates without writing, so the PS3 build doesn't preallocate
+int romi_preallocate(const char* path, uint64_t size);
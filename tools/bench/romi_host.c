@@ -0,0 +1,678 @@
+// Linux stand-in for the parts of romi_ps3.c, romi.c and romi_devices.c that
+// the network and download layers use, so they can be benchmarked on a PC.
+// The HTTP code follows romi_ps3.c option for option; proxy support, the
+// share handle and the socket tuning callback are left out.
+
+#include "romi.h"
+#include "romi_devices.h"
+#include "romi_host.h"
+#include "romi_redirect.h"
+#include "romi_utils.h"
+
+#include <curl/curl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ROMI_CURL_BUFFER_SIZE   (512 * 1024L)
+#define ROMI_FILE_BUFFER_SIZE   (256 * 1024)
+#define ROMI_HOST_MUTEXES       64
+
+struct romi_http
+{
+    int used;
+    uint64_t size;
+    uint32_t low_speed_limit;
+    uint32_t low_speed_time;
+    int range_ignored;
+    int redirected;
+    char url[1024];
+    CURL *curl;
+};
+
+static romi_http g_http[8];
+static pthread_mutex_t g_http_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// romi_mutex is a plain id on the PS3, hand out slots of a static table
+static pthread_mutex_t g_mutexes[ROMI_HOST_MUTEXES];
+static uint32_t g_mutex_count = 0;
+static pthread_mutex_t g_mutex_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// romi_sema the same way
+static sem_t g_semas[ROMI_HOST_MUTEXES];
+static uint32_t g_sema_count = 0;
+
+static char g_base_path[256] = "/tmp/romi_bench/";
+static char g_config_folder[256] = "/tmp/romi_bench";
+static char g_temp_folder[256] = "/tmp/romi_bench/tmp";
+
+void romi_host_set_folder(const char* folder)
+{
+    romi_snprintf(g_base_path, sizeof(g_base_path), "%s/", folder);
+    romi_strncpy(g_config_folder, sizeof(g_config_folder), folder);
+    romi_snprintf(g_temp_folder, sizeof(g_temp_folder), "%s/tmp", folder);
+}
+
+int romi_snprintf(char* buffer, uint32_t size, const char* msg, ...)
+{
+    va_list args;
+    va_start(args, msg);
+    int len = vsnprintf(buffer, size - 1, msg, args);
+    va_end(args);
+    buffer[size - 1] = 0;
+    return len;
+}
+
+void romi_vsnprintf(char* buffer, uint32_t size, const char* msg, va_list args)
+{
+    vsnprintf(buffer, size - 1, msg, args);
+    buffer[size - 1] = 0;
+}
+
+char* romi_strstr(const char* str, const char* sub)
+{
+    return strstr(str, sub);
+}
+
+int romi_stricontains(const char* str, const char* sub)
+{
+    return strcasestr(str, sub) != NULL;
+}
+
+int romi_stricmp(const char* a, const char* b)
+{
+    return strcasecmp(a, b);
+}
+
+void romi_strncpy(char* dst, uint32_t size, const char* src)
+{
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = 0;
+}
+
+char* romi_strrchr(const char* str, char ch)
+{
+    return strrchr(str, ch);
+}
+
+uint32_t romi_strlen(const char *str)
+{
+    return strlen(str);
+}
+
+int64_t romi_strtoll(const char* str)
+{
+    return strtoll(str, NULL, 10);
+}
+
+void romi_memcpy(void* dst, const void* src, uint32_t size)
+{
+    memcpy(dst, src, size);
+}
+
+void romi_memmove(void* dst, const void* src, uint32_t size)
+{
+    memmove(dst, src, size);
+}
+
+int romi_memequ(const void* a, const void* b, uint32_t size)
+{
+    return memcmp(a, b, size) == 0;
+}
+
+void* romi_malloc(uint32_t size)
+{
+    return malloc(size);
+}
+
+void romi_free(void* ptr)
+{
+    free(ptr);
+}
+
+const char* romi_get_config_folder(void)
+{
+    return g_config_folder;
+}
+
+const char* romi_get_temp_folder(void)
+{
+    return g_temp_folder;
+}
+
+const char* romi_devices_get_base_path(void)
+{
+    return g_base_path;
+}
+
+// the benchmark measures the network, not the free space of the PC
+int romi_check_free_space(uint64_t size)
+{
+    ROMI_UNUSED(size);
+    return 1;
+}
+
+uint64_t romi_get_device_free_space(const char* path)
+{
+    struct statvfs st;
+    if (statvfs(path, &st) != 0)
+        return 0;
+    return (uint64_t)st.f_bavail * st.f_frsize;
+}
+
+uint32_t romi_time_msec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+}
+
+uint64_t romi_time_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+typedef struct
+{
+    romi_thread_entry_arg* start;
+    void* arg;
+} romi_host_thread;
+
+static void* romi_host_thread_main(void* arg)
+{
+    romi_host_thread thread = *(romi_host_thread*)arg;
+    free(arg);
+
+    thread.start(thread.arg);
+    return NULL;
+}
+
+int romi_start_thread_arg(const char* name, romi_thread_entry_arg* start, void* arg)
+{
+    romi_host_thread* thread = malloc(sizeof(romi_host_thread));
+    thread->start = start;
+    thread->arg = arg;
+
+    pthread_t id;
+    if (pthread_create(&id, NULL, romi_host_thread_main, thread) != 0)
+    {
+        LOG("failed to start %s thread", name);
+        free(thread);
+        return 0;
+    }
+    pthread_detach(id);
+    return 1;
+}
+
+void romi_thread_exit(void)
+{
+    pthread_exit(NULL);
+}
+
+void romi_sleep(uint32_t msec)
+{
+    usleep(msec * 1000);
+}
+
+int romi_mutex_create(romi_mutex* mutex, const char* name)
+{
+    ROMI_UNUSED(name);
+
+    pthread_mutex_lock(&g_mutex_table_lock);
+    if (g_mutex_count == ROMI_HOST_MUTEXES)
+    {
+        pthread_mutex_unlock(&g_mutex_table_lock);
+        return -1;
+    }
+    *mutex = g_mutex_count++;
+    pthread_mutex_init(&g_mutexes[*mutex], NULL);
+    pthread_mutex_unlock(&g_mutex_table_lock);
+
+    return 0;
+}
+
+void romi_mutex_destroy(romi_mutex* mutex)
+{
+    pthread_mutex_destroy(&g_mutexes[*mutex]);
+}
+
+void romi_mutex_lock(romi_mutex* mutex)
+{
+    pthread_mutex_lock(&g_mutexes[*mutex]);
+}
+
+void romi_mutex_unlock(romi_mutex* mutex)
+{
+    pthread_mutex_unlock(&g_mutexes[*mutex]);
+}
+
+int romi_sema_create(romi_sema* sema, const char* name, uint32_t count)
+{
+    ROMI_UNUSED(name);
+
+    pthread_mutex_lock(&g_mutex_table_lock);
+    if (g_sema_count == ROMI_HOST_MUTEXES)
+    {
+        pthread_mutex_unlock(&g_mutex_table_lock);
+        return 0;
+    }
+    *sema = g_sema_count++;
+    sem_init(&g_semas[*sema], 0, count);
+    pthread_mutex_unlock(&g_mutex_table_lock);
+
+    return 1;
+}
+
+void romi_sema_destroy(romi_sema* sema)
+{
+    sem_destroy(&g_semas[*sema]);
+}
+
+void romi_sema_wait(romi_sema* sema)
+{
+    while (sem_wait(&g_semas[*sema]) != 0 && errno == EINTR)
+        ;
+}
+
+void romi_sema_post(romi_sema* sema)
+{
+    sem_post(&g_semas[*sema]);
+}
+
+int romi_load(const char* name, void* data, uint32_t max)
+{
+    FILE* f = fopen(name, "rb");
+    if (!f)
+        return -1;
+
+    int read = (int)fread(data, 1, max, f);
+    fclose(f);
+    return read;
+}
+
+int romi_save(const char* name, const void* data, uint32_t size)
+{
+    FILE* f = fopen(name, "wb");
+    if (!f)
+        return 0;
+
+    int ok = fwrite(data, 1, size, f) == size;
+    fclose(f);
+    return ok;
+}
+
+int romi_mkdirs(const char* dir)
+{
+    char path[256];
+    romi_strncpy(path, sizeof(path), dir);
+
+    for (char* ptr = path + 1; *ptr; ptr++)
+    {
+        if (*ptr != '/')
+            continue;
+
+        *ptr = 0;
+        if (mkdir(path, 0777) < 0 && errno != EEXIST)
+            return 0;
+        *ptr = '/';
+    }
+
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+void romi_rm(const char* file)
+{
+    unlink(file);
+}
+
+int64_t romi_get_size(const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0)
+        return -1;
+    return st.st_size;
+}
+
+void* romi_create(const char* path)
+{
+    FILE* fd = fopen(path, "wb");
+    if (!fd)
+        return NULL;
+
+    setvbuf(fd, NULL, _IOFBF, ROMI_FILE_BUFFER_SIZE);
+    return fd;
+}
+
+int romi_preallocate(const char* path, uint64_t size)
+{
+    int fd = open(path, O_WRONLY);
+    if (fd < 0)
+        return 0;
+
+    int err = posix_fallocate(fd, 0, (off_t)size);
+    close(fd);
+    return err == 0;
+}
+
+int romi_truncate(const char* path, uint64_t size)
+{
+    return truncate(path, (off_t)size) == 0;
+}
+
+void* romi_open(const char* path)
+{
+    return fopen(path, "rb");
+}
+
+void* romi_append(const char* path)
+{
+    FILE* fd = fopen(path, "ab");
+    if (!fd)
+        return NULL;
+
+    setvbuf(fd, NULL, _IOFBF, ROMI_FILE_BUFFER_SIZE);
+    return fd;
+}
+
+void romi_close(void* f)
+{
+    fclose((FILE*)f);
+}
+
+int romi_read(void* f, void* buffer, uint32_t size)
+{
+    return (int)fread(buffer, 1, size, (FILE*)f);
+}
+
+int romi_seek(void* f, uint64_t offset)
+{
+    return fseeko((FILE*)f, (off_t)offset, SEEK_SET) == 0;
+}
+
+int romi_write(void* f, const void* buffer, uint32_t size)
+{
+    return fwrite(buffer, 1, size, (FILE*)f) == size;
+}
+
+int romi_validate_url(const char* url)
+{
+    if (url[0] == 0)
+    {
+        return 0;
+    }
+    if ((romi_strstr(url, "http://") == url) || (romi_strstr(url, "https://") == url) ||
+        (romi_strstr(url, "ftp://") == url)  || (romi_strstr(url, "ftps://") == url))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+static CURL* romi_curl_init_throughput(int enable_throughput_mode)
+{
+    static struct curl_slist *headers = NULL;
+
+    CURL* curl = curl_easy_init();
+    if (!curl)
+        return NULL;
+
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Wget/1.24");
+
+    if (!headers)
+    {
+        headers = curl_slist_append(headers, "Accept: */*");
+        headers = curl_slist_append(headers, "Accept-Encoding: identity");
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 20L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 20L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_USE_SSL, CURLUSESSL_TRY);
+
+    curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, ROMI_CURL_BUFFER_SIZE);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, enable_throughput_mode ? 0L : 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 60L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 30L);
+
+    return curl;
+}
+
+romi_http* romi_http_get(const char* url, const char* content, uint64_t offset, int use_throughput)
+{
+    ROMI_UNUSED(content);
+
+    if (!romi_validate_url(url))
+        return NULL;
+
+    romi_http* http = NULL;
+    pthread_mutex_lock(&g_http_lock);
+    for (size_t i = 0; i < ROMI_COUNTOF(g_http); i++)
+    {
+        if (g_http[i].used == 0)
+        {
+            http = &g_http[i];
+            http->used = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_http_lock);
+
+    if (!http)
+        return NULL;
+
+    http->low_speed_limit = 0;
+    http->low_speed_time = 0;
+    http->range_ignored = 0;
+
+    http->curl = romi_curl_init_throughput(use_throughput);
+    if (!http->curl)
+    {
+        http->used = 0;
+        return NULL;
+    }
+    romi_strncpy(http->url, sizeof(http->url), url);
+
+    char effective[1024];
+    http->redirected = romi_redirect_lookup(url, effective, sizeof(effective));
+    curl_easy_setopt(http->curl, CURLOPT_URL, http->redirected ? effective : url);
+
+    if (offset != 0)
+        curl_easy_setopt(http->curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t) offset);
+
+    return http;
+}
+
+static void romi_http_update_redirect(romi_http* http, CURLcode res)
+{
+    if (res != CURLE_OK)
+    {
+        if (http->redirected && res != CURLE_ABORTED_BY_CALLBACK && res != CURLE_WRITE_ERROR)
+            romi_redirect_forget(http->url);
+        return;
+    }
+
+    long redirects = 0;
+    char* effective = NULL;
+    curl_easy_getinfo(http->curl, CURLINFO_REDIRECT_COUNT, &redirects);
+    curl_easy_getinfo(http->curl, CURLINFO_EFFECTIVE_URL, &effective);
+    if (redirects <= 0 || !effective)
+        return;
+
+    char target[1024];
+    romi_strncpy(target, sizeof(target), effective);
+    romi_redirect_store(http->url, target);
+
+    curl_easy_setopt(http->curl, CURLOPT_URL, target);
+    http->redirected = 1;
+}
+
+int romi_http_response_length(romi_http* http, int64_t* length)
+{
+    curl_easy_setopt(http->curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(http->curl, CURLOPT_NOPROGRESS, 1L);
+
+    CURLcode res = curl_easy_perform(http->curl);
+    romi_http_update_redirect(http, res);
+    if (res != CURLE_OK)
+    {
+        LOG("curl_easy_perform() failed: %s", curl_easy_strerror(res));
+        return 0;
+    }
+
+    curl_easy_getinfo(http->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, length);
+    http->size = *length;
+
+    return 1;
+}
+
+void romi_http_set_stall_timeout(romi_http* http, uint32_t min_speed, uint32_t seconds)
+{
+    http->low_speed_limit = min_speed;
+    http->low_speed_time = seconds;
+}
+
+int romi_http_read(romi_http* http, void* write_func, void* write_data, void* xferinfo_func, void* xferinfo_data)
+{
+    if (http->low_speed_time)
+    {
+        curl_easy_setopt(http->curl, CURLOPT_LOW_SPEED_LIMIT, (long)http->low_speed_limit);
+        curl_easy_setopt(http->curl, CURLOPT_LOW_SPEED_TIME, (long)http->low_speed_time);
+    }
+
+    curl_easy_setopt(http->curl, CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(http->curl, CURLOPT_WRITEFUNCTION, write_func);
+    curl_easy_setopt(http->curl, CURLOPT_WRITEDATA, write_data);
+
+    if (xferinfo_func)
+    {
+        curl_easy_setopt(http->curl, CURLOPT_XFERINFOFUNCTION, xferinfo_func);
+        curl_easy_setopt(http->curl, CURLOPT_XFERINFODATA, xferinfo_data);
+        curl_easy_setopt(http->curl, CURLOPT_NOPROGRESS, 0L);
+    }
+
+    CURLcode res = curl_easy_perform(http->curl);
+    http->range_ignored = (res == CURLE_RANGE_ERROR);
+    romi_http_update_redirect(http, res);
+    if (res != CURLE_OK)
+    {
+        LOG("curl_easy_perform() failed: %s", curl_easy_strerror(res));
+        return 0;
+    }
+
+    return 1;
+}
+
+int romi_http_range_ignored(romi_http* http)
+{
+    return http->range_ignored;
+}
+
+int romi_http_proxy_dropped(romi_http* http)
+{
+    ROMI_UNUSED(http);
+    return 0;
+}
+
+static uint32_t romi_curl_msec(double seconds)
+{
+    return seconds > 0 ? (uint32_t)(seconds * 1000.0) : 0;
+}
+
+void romi_http_get_metrics(romi_http* http, romi_http_metrics* metrics)
+{
+    double dns = 0, connect = 0, tls = 0, pretransfer = 0, starttransfer = 0, total = 0;
+    curl_off_t bytes = 0;
+    long redirects = 0;
+    char* ip = NULL;
+
+    memset(metrics, 0, sizeof(*metrics));
+
+    curl_easy_getinfo(http->curl, CURLINFO_NAMELOOKUP_TIME, &dns);
+    curl_easy_getinfo(http->curl, CURLINFO_CONNECT_TIME, &connect);
+    curl_easy_getinfo(http->curl, CURLINFO_APPCONNECT_TIME, &tls);
+    curl_easy_getinfo(http->curl, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+    curl_easy_getinfo(http->curl, CURLINFO_STARTTRANSFER_TIME, &starttransfer);
+    curl_easy_getinfo(http->curl, CURLINFO_TOTAL_TIME, &total);
+    curl_easy_getinfo(http->curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    curl_easy_getinfo(http->curl, CURLINFO_REDIRECT_COUNT, &redirects);
+    curl_easy_getinfo(http->curl, CURLINFO_PRIMARY_IP, &ip);
+
+    metrics->dns_msec = romi_curl_msec(dns);
+    metrics->connect_msec = romi_curl_msec(connect - dns);
+    metrics->tls_msec = tls > connect ? romi_curl_msec(tls - connect) : 0;
+    metrics->ttfb_msec = romi_curl_msec(starttransfer - pretransfer);
+    metrics->total_msec = romi_curl_msec(total);
+    metrics->redirects = (uint32_t)redirects;
+    metrics->bytes = bytes > 0 ? (uint64_t)bytes : 0;
+    romi_strncpy(metrics->ip, sizeof(metrics->ip), ip ? ip : "");
+}
+
+void romi_http_close(romi_http* http)
+{
+    curl_easy_cleanup(http->curl);
+    http->used = 0;
+}
+
+typedef struct {
+    uint32_t received;
+    uint32_t max_bytes;
+} romi_probe;
+
+static size_t romi_probe_write(void* buffer, size_t size, size_t nmemb, void* stream)
+{
+    romi_probe* probe = stream;
+    ROMI_UNUSED(buffer);
+
+    probe->received += size * nmemb;
+    return probe->received >= probe->max_bytes ? 0 : size * nmemb;
+}
+
+int romi_http_probe(const char* url, uint32_t max_bytes, uint32_t timeout_msec, uint32_t* connect_msec, uint32_t* bytes_per_sec)
+{
+    romi_http* http = romi_http_get(url, NULL, 0, 0);
+    if (!http)
+        return 0;
+
+    char range[32];
+    romi_snprintf(range, sizeof(range), "0-%u", max_bytes - 1);
+
+    romi_probe probe = { 0, max_bytes };
+    uint32_t start = romi_time_msec();
+
+    curl_easy_setopt(http->curl, CURLOPT_RANGE, range);
+    curl_easy_setopt(http->curl, CURLOPT_TIMEOUT_MS, (long)timeout_msec);
+    curl_easy_setopt(http->curl, CURLOPT_WRITEFUNCTION, romi_probe_write);
+    curl_easy_setopt(http->curl, CURLOPT_WRITEDATA, &probe);
+
+    CURLcode res = curl_easy_perform(http->curl);
+    uint32_t elapsed = romi_time_msec() - start;
+
+    double connect_time = 0;
+    curl_easy_getinfo(http->curl, CURLINFO_CONNECT_TIME, &connect_time);
+    romi_http_close(http);
+
+    int ok = (res == CURLE_OK || (res == CURLE_WRITE_ERROR && probe.received >= max_bytes)) && probe.received > 0;
+    if (!ok)
+        return 0;
+
+    *connect_msec = (uint32_t)(connect_time * 1000);
+    *bytes_per_sec = elapsed > 0 ? (uint32_t)((uint64_t)probe.received * 1000 / elapsed) : probe.received;
+    return 1;
+}
@@ -0,0 +1,278 @@
+// Simulated-clock comparison of the download queue's scheduling policies.
+//
+// Runs a generated queue through romi_schedule_pick, the same code the PS3
+// queue uses to choose the next download, with a model of the network in
+// place of real transfers: a shared link, a setup delay per transfer and
+// mirrors that throttle every connection once a client opens too many. The
+// clock is simulated, a queue of hours runs in well under a second.
+//
+// For every policy and host limit it reports the time the whole queue
+// takes, the mean time an item waits until it is complete and how many
+// items are done after the first minute and the first five, and the most
+// connections one mirror had open at once, which the host limit caps.
+
+#include "romi.h"
+#include "romi_download.h"
+#include "romi_queue.h"
+#include "romi_schedule.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIM_MAX_ITEMS   4096
+#define SIM_MAX_WORKERS ROMI_QUEUE_MAX_CONCURRENT_LIMIT
+#define SIM_TICK_MSEC   50
+#define SIM_HOSTS       3
+
+// request, redirects and time to first byte of every transfer
+#define SIM_SETUP_MSEC  400
+
+typedef struct {
+    const char* url;
+    int relative;               // catalog lists bare file names under url, as with sources.txt
+    uint32_t per_connection;    // bytes/sec a single connection gets at best
+    uint32_t throttle_after;    // connections before the mirror slows everyone down
+    uint32_t throttled;         // bytes/sec per connection once throttled
+} SimHost;
+
+// roughly how archive.org, myrient and a small private mirror behave
+static const SimHost sim_hosts[SIM_HOSTS] = {
+    { "https://archive.org/download/", 1, 1200 * 1024, 2, 200 * 1024 },
+    { "https://myrient.erista.me/files/", 1, 2500 * 1024, 3, 300 * 1024 },
+    { "http://mirror.example.net/roms/", 0, 800 * 1024, 8, 800 * 1024 },
+};
+
+typedef struct {
+    RomiScheduleItem schedule;
+    uint32_t host_index;
+    int64_t size;
+    int64_t received;
+    uint32_t started;           // msec, valid while running
+    uint32_t finished;          // msec, 0 until complete
+    int running;
+} SimItem;
+
+typedef struct {
+    uint32_t makespan;
+    uint64_t completion_sum;
+    uint32_t done_1min;
+    uint32_t done_5min;
+    uint32_t peak_host;         // most connections open to one mirror
+} SimResult;
+
+static uint32_t sim_random(uint32_t* state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+static int64_t sim_size(uint32_t* state)
+{
+    uint32_t kind = sim_random(state) % 100;
+    if (kind < 70)
+        return 32 * 1024 + sim_random(state) % (900 * 1024);                    // cartridge ROMs
+    if (kind < 95)
+        return 4 * 1024 * 1024 + sim_random(state) % (60 * 1024 * 1024);       // CD images, compressed
+    return 300 * 1024 * 1024 + (int64_t)(sim_random(state) % 1700) * 1024 * 1024;  // DVD images
+}
+
+static void sim_generate(SimItem* items, uint32_t count, uint32_t seed)
+{
+    uint32_t state = seed;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        SimItem* item = &items[i];
+        memset(item, 0, sizeof(*item));
+
+        uint32_t host = sim_random(&state) % 10;
+        item->host_index = host < 5 ? 0 : host < 9 ? 1 : 2;
+        item->size = sim_size(&state);
+
+        item->schedule.size = item->size;
+
+        // keyed the way romi_queue_append does, on the mirror base for relative names
+        const SimHost* host_info = &sim_hosts[item->host_index];
+        char url[256];
+        if (host_info->relative)
+        {
+            romi_snprintf(url, sizeof(url), "Game %04u.zip", i);
+            item->schedule.host = romi_schedule_host(host_info->url, url);
+        }
+        else
+        {
+            romi_snprintf(url, sizeof(url), "%sGame %04u.zip", host_info->url, i);
+            item->schedule.host = romi_schedule_host(NULL, url);
+        }
+        item->schedule.priority = 1;
+    }
+}
+
+static void sim_run(SimItem* items, uint32_t count, uint32_t workers, uint32_t link, SimResult* result)
+{
+    static RomiScheduleItem pending[SIM_MAX_ITEMS];
+    static uint32_t pending_index[SIM_MAX_ITEMS];
+    RomiScheduleItem active[SIM_MAX_WORKERS];
+    uint32_t running[SIM_MAX_WORKERS];
+
+    memset(result, 0, sizeof(*result));
+
+    uint32_t done = 0;
+    uint32_t now = 0;
+    uint32_t active_count = 0;
+
+    while (done < count)
+    {
+        // fill the free workers the way the queue does, one pick at a time
+        while (active_count < workers)
+        {
+            uint32_t pending_count = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (!items[i].running && !items[i].finished)
+                {
+                    pending[pending_count] = items[i].schedule;
+                    pending_index[pending_count++] = i;
+                }
+            }
+
+            for (uint32_t i = 0; i < active_count; i++)
+                active[i] = items[running[i]].schedule;
+
+            int pick = romi_schedule_pick(pending, pending_count, active, active_count);
+            if (pick < 0)
+                break;
+
+            SimItem* item = &items[pending_index[pick]];
+            item->running = 1;
+            item->started = now;
+            running[active_count++] = pending_index[pick];
+        }
+
+        now += SIM_TICK_MSEC;
+
+        uint32_t connections[SIM_HOSTS] = { 0 };
+        uint32_t transferring = 0;
+        for (uint32_t i = 0; i < active_count; i++)
+        {
+            const SimItem* item = &items[running[i]];
+            connections[item->host_index]++;
+            if (now - item->started > SIM_SETUP_MSEC)
+                transferring++;
+        }
+
+        for (uint32_t h = 0; h < SIM_HOSTS; h++)
+        {
+            if (connections[h] > result->peak_host)
+                result->peak_host = connections[h];
+        }
+
+        // the link is shared evenly, each connection is also capped by its mirror
+        uint32_t share = transferring ? link / transferring : link;
+
+        for (uint32_t i = 0; i < active_count;)
+        {
+            SimItem* item = &items[running[i]];
+            const SimHost* host = &sim_hosts[item->host_index];
+
+            if (now - item->started > SIM_SETUP_MSEC)
+            {
+                uint32_t rate = connections[item->host_index] > host->throttle_after ? host->throttled : host->per_connection;
+                rate = rate < share ? rate : share;
+                item->received += (int64_t)rate * SIM_TICK_MSEC / 1000;
+            }
+
+            if (item->received < item->size)
+            {
+                i++;
+                continue;
+            }
+
+            item->running = 0;
+            item->finished = now;
+            done++;
+
+            result->completion_sum += now;
+            if (now <= 60 * 1000)
+                result->done_1min++;
+            if (now <= 5 * 60 * 1000)
+                result->done_5min++;
+
+            running[i] = running[--active_count];
+        }
+    }
+
+    result->makespan = now;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [-n items] [-w workers] [-b link_kbps] [-s seed]\n"
+        "  -n items    queue length (default 200)\n"
+        "  -w workers  download workers, max_concurrent of the queue (default %u)\n"
+        "  -b kbps     link speed in KB/s shared by all transfers (default 4096)\n"
+        "  -s seed     seed of the generated queue\n",
+        name, ROMI_QUEUE_MAX_CONCURRENT_DEFAULT);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t count = 200;
+    uint32_t workers = ROMI_QUEUE_MAX_CONCURRENT_DEFAULT;
+    uint32_t link = 4096 * 1024;
+    uint32_t seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:b:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': count = (uint32_t)atoi(optarg); break;
+        case 'w': workers = (uint32_t)atoi(optarg); break;
+        case 'b': link = (uint32_t)atoi(optarg) * 1024; break;
+        case 's': seed = (uint32_t)atoi(optarg); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+
+    if (count == 0 || count > SIM_MAX_ITEMS || workers == 0 || workers > SIM_MAX_WORKERS || link == 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    static SimItem items[SIM_MAX_ITEMS];
+    const uint32_t host_limits[] = { 0, 1, 2, 3 };
+
+    printf("%u items, %u workers, %u KB/s link\n", count, workers, link / 1024);
+    printf("%-9s %10s %12s %14s %9s %9s %9s\n", "policy", "host limit", "all done s", "mean done s", "at 1 min", "at 5 min", "peak/host");
+
+    for (uint32_t policy = 0; policy < ScheduleCount; policy++)
+    {
+        for (size_t l = 0; l < ROMI_COUNTOF(host_limits); l++)
+        {
+            romi_schedule_configure((RomiSchedulePolicy)policy, host_limits[l]);
+
+            // every run starts from the same queue
+            sim_generate(items, count, seed);
+
+            SimResult result;
+            sim_run(items, count, workers, link, &result);
+
+            char limit[16];
+            if (host_limits[l])
+                romi_snprintf(limit, sizeof(limit), "%u", host_limits[l]);
+            else
+                romi_strncpy(limit, sizeof(limit), "none");
+
+            printf("%-9s %10s %12.1f %14.1f %9u %9u %9u\n",
+                romi_schedule_name((RomiSchedulePolicy)policy), limit,
+                result.makespan / 1000.0, result.completion_sum / 1000.0 / count,
+                result.done_1min, result.done_5min, result.peak_host);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,229 @@
+// Replays sensor traces through the thermal throttle of the download queue.
+//
+// romi_thermal_update runs exactly as on the console, with a simulated clock
+// and a RomiThermalSource that returns the trace instead of the lv2 sensors.
+// Traces are text files with one sample per line,
+//
+//   msec cpu_c rsx_c frame_msec
+//
+// or built-in scenarios. The "load" scenario closes the loop: the console
+// heats up with the downloads and extraction the throttle allows, so it
+// shows whether the policy settles or flaps. Every level change is printed,
+// then the time spent at each level.
+
+#include "romi.h"
+#include "romi_thermal.h"
+#include "romi_queue.h"
+#include "romi_utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIM_TICK_MSEC   100
+#define SIM_MAX_SAMPLES 65536
+
+typedef struct {
+    uint32_t msec;
+    uint32_t cpu;
+    uint32_t rsx;
+    uint32_t frame;
+} SimSample;
+
+typedef struct {
+    uint32_t cpu;
+    uint32_t rsx;
+} SimSensors;
+
+static int sim_source(void* arg, uint32_t* cpu, uint32_t* rsx)
+{
+    const SimSensors* sensors = arg;
+    *cpu = sensors->cpu;
+    *rsx = sensors->rsx;
+    return 1;
+}
+
+typedef struct {
+    uint32_t time_at[ThrottleCount];
+    uint32_t changes;
+    uint32_t peak;
+} SimResult;
+
+static void sim_step(SimSensors* sensors, uint32_t now, uint32_t cpu, uint32_t rsx, uint32_t frame, SimResult* result)
+{
+    sensors->cpu = cpu;
+    sensors->rsx = rsx;
+    result->peak = max32(result->peak, max32(cpu, rsx));
+
+    if (romi_thermal_update(now, frame))
+    {
+        result->changes++;
+        printf("%8.1f s  CPU %3u C  RSX %3u C  frame %4u ms  -> %-8s %u downloads%s\n",
+            now / 1000.0, cpu, rsx, romi_thermal_frame_msec(), romi_thermal_name(romi_thermal_level()),
+            romi_thermal_download_limit(ROMI_QUEUE_MAX_CONCURRENT_DEFAULT),
+            romi_thermal_install_allowed() ? "" : ", extraction paused");
+    }
+
+    result->time_at[romi_thermal_level()] += SIM_TICK_MSEC;
+}
+
+// Samples hold until the next one, as the sensors do between reads
+static void sim_replay(const SimSample* samples, uint32_t count, SimResult* result)
+{
+    SimSensors sensors = { 0, 0 };
+    romi_thermal_set_source(sim_source, &sensors);
+
+    uint32_t index = 0;
+    for (uint32_t now = samples[0].msec; now <= samples[count - 1].msec; now += SIM_TICK_MSEC)
+    {
+        while (index + 1 < count && samples[index + 1].msec <= now)
+            index++;
+        sim_step(&sensors, now, samples[index].cpu, samples[index].rsx, samples[index].frame, result);
+    }
+}
+
+// A first-order model of a fat PS3: every running download and the
+// extraction add heat, the temperature moves towards the steady state with
+// a time constant of a couple of minutes
+static void sim_load(uint32_t seconds, uint32_t ambient, SimResult* result)
+{
+    SimSensors sensors = { 0, 0 };
+    romi_thermal_set_source(sim_source, &sensors);
+
+    double cpu = ambient + 20.0;
+    for (uint32_t now = 0; now <= seconds * 1000; now += SIM_TICK_MSEC)
+    {
+        uint32_t downloads = romi_thermal_download_limit(ROMI_QUEUE_MAX_CONCURRENT_DEFAULT);
+        double target = ambient + 35.0 + 5.0 * downloads + (romi_thermal_install_allowed() ? 8.0 : 0.0);
+        cpu += (target - cpu) * SIM_TICK_MSEC / 120000.0;
+
+        // the UI slows down while extraction runs next to three downloads
+        uint32_t frame = downloads >= 3 && romi_thermal_install_allowed() ? 40 : 17;
+        sim_step(&sensors, now, (uint32_t)cpu, (uint32_t)cpu - 6, frame, result);
+    }
+}
+
+static uint32_t sim_builtin(const char* name, SimSample* samples)
+{
+    uint32_t count = 0;
+
+    if (strcmp(name, "spike") == 0)
+    {
+        // a short burst over the hot threshold, then back to normal for two minutes
+        for (uint32_t t = 0; t <= 180; t++)
+        {
+            uint32_t cpu = t >= 30 && t < 36 ? 83 : 65;
+            samples[count++] = (SimSample){ t * 1000, cpu, cpu - 5, 17 };
+        }
+    }
+    else if (strcmp(name, "slow-ui") == 0)
+    {
+        // cool console, but a minute of 80 ms frames
+        for (uint32_t t = 0; t <= 180; t++)
+            samples[count++] = (SimSample){ t * 1000, 60, 55, t >= 20 && t < 80 ? 80 : 17 };
+    }
+    else if (strcmp(name, "ramp") == 0)
+    {
+        // warms up from 60 to 86 C over ten minutes and cools down again
+        for (uint32_t t = 0; t <= 1200; t++)
+        {
+            uint32_t cpu = t < 600 ? 60 + t * 26 / 600 : 86 - (t - 600) * 26 / 600;
+            samples[count++] = (SimSample){ t * 1000, cpu, cpu - 4, 17 };
+        }
+    }
+
+    return count;
+}
+
+static uint32_t sim_load_trace(const char* path, SimSample* samples)
+{
+    FILE* f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!f)
+        return 0;
+
+    uint32_t count = 0;
+    char line[256];
+    while (count < SIM_MAX_SAMPLES && fgets(line, sizeof(line), f))
+    {
+        SimSample* s = &samples[count];
+        if (line[0] != '#' && sscanf(line, "%u %u %u %u", &s->msec, &s->cpu, &s->rsx, &s->frame) == 4)
+            count++;
+    }
+
+    if (f != stdin)
+        fclose(f);
+    return count;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [-w warm_c] [-t hot_c] [-f frame_msec] [-a ambient_c] [scenario|trace_file|-]\n"
+        "  scenario  load (default), ramp, spike or slow-ui\n"
+        "  trace     lines of \"msec cpu_c rsx_c frame_msec\", - reads stdin\n"
+        "  -w, -t, -f  thresholds as the thermal_warm, thermal_hot and thermal_frame config keys\n"
+        "  -a        room temperature of the load scenario (default 25)\n",
+        name);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t warm = ROMI_THERMAL_WARM_DEFAULT;
+    uint32_t hot = ROMI_THERMAL_HOT_DEFAULT;
+    uint32_t frame = ROMI_THERMAL_FRAME_DEFAULT;
+    uint32_t ambient = 25;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:t:f:a:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w': warm = (uint32_t)atoi(optarg); break;
+        case 't': hot = (uint32_t)atoi(optarg); break;
+        case 'f': frame = (uint32_t)atoi(optarg); break;
+        case 'a': ambient = (uint32_t)atoi(optarg); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind < argc - 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    const char* input = optind < argc ? argv[optind] : "load";
+
+    romi_thermal_configure(warm, hot, frame);
+    printf("thresholds %u/%u C, %u ms frames, %s\n", warm, hot, frame, input);
+
+    SimResult result;
+    memset(&result, 0, sizeof(result));
+
+    if (strcmp(input, "load") == 0)
+    {
+        sim_load(3600, ambient, &result);
+    }
+    else
+    {
+        static SimSample samples[SIM_MAX_SAMPLES];
+        uint32_t count = sim_builtin(input, samples);
+        if (count == 0)
+            count = sim_load_trace(input, samples);
+        if (count == 0)
+        {
+            fprintf(stderr, "%s is neither a scenario nor a readable trace\n", input);
+            return 1;
+        }
+        sim_replay(samples, count, &result);
+    }
+
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < ThrottleCount; i++)
+        total += result.time_at[i];
+
+    printf("%u changes, peak %u C\n", result.changes, result.peak);
+    for (uint32_t i = 0; i < ThrottleCount; i++)
+        printf("  %-8s %7.1f s  %5.1f%%\n", romi_thermal_name((RomiThrottle)i), result.time_at[i] / 1000.0, total ? 100.0 * result.time_at[i] / total : 0.0);
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+// Host-side benchmark of file preallocation for ROM downloads.
+//
+// Writes several files at once, interleaved in write-behind blocks the way
+// parallel downloads reach the disk, into every folder given on the command
+// line and compares how the files are laid out:
+//
+//   plain     romi_create and romi_write, the file grows with every flush
+//   truncate  grown to its final size with truncate() first, what the PS3
+//             could do with sysLv2FsTruncate
+//   allocate  romi_preallocate, posix_fallocate on the host
+//
+// The report gives MB/s including the final fsync, the blocks a file holds
+// right after it was preallocated (0 for a sparse file) and the mean number
+// of extents per file from FIEMAP, where fewer is better.
+//
+// `make bench-write` runs it on loopback ext4 and FAT32 images, like the
+// internal HDD and a USB stick, when the kernel and mkfs tools allow it.
+
+#include "romi.h"
+#include "romi_host.h"
+#include "romi_utils.h"
+#include "romi_writer.h"
+
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_FILES 8
+
+typedef enum {
+    ModePlain,
+    ModeTruncate,
+    ModeAllocate,
+    ModeCount,
+} BenchMode;
+
+static const char* mode_names[ModeCount] = { "plain", "truncate", "allocate" };
+
+typedef struct {
+    uint64_t wall_msec;
+    uint64_t blocks_before;     // 512-byte blocks held right after preallocation
+    uint32_t extents;
+} BenchRun;
+
+static uint64_t wall_msec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 0 if the file system doesn't answer FIEMAP, FAT did not before Linux 5.x
+static uint32_t count_extents(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct fiemap map;
+    memset(&map, 0, sizeof(map));
+    map.fm_length = FIEMAP_MAX_OFFSET;
+    map.fm_flags = FIEMAP_FLAG_SYNC;
+
+    // with no room for extents the kernel only counts them
+    uint32_t extents = ioctl(fd, FS_IOC_FIEMAP, &map) == 0 ? map.fm_mapped_extents : 0;
+    close(fd);
+    return extents;
+}
+
+static int prepare(const char* path, BenchMode mode, uint64_t size)
+{
+    if (mode == ModeTruncate)
+        return truncate(path, (off_t)size) == 0;
+    if (mode == ModeAllocate)
+        return romi_preallocate(path, size);
+    return 1;
+}
+
+static int run_case(const char* folder, BenchMode mode, uint32_t files, uint64_t size, const uint8_t* block, BenchRun* run)
+{
+    char paths[BENCH_MAX_FILES][512];
+    void* handles[BENCH_MAX_FILES];
+    int ok = 1;
+
+    memset(run, 0, sizeof(*run));
+    uint64_t start = wall_msec();
+
+    for (uint32_t i = 0; i < files; i++)
+    {
+        romi_snprintf(paths[i], sizeof(paths[i]), "%s/write_%s_%u.bin", folder, mode_names[mode], i);
+        handles[i] = romi_create(paths[i]);
+        if (!handles[i] || !prepare(paths[i], mode, size))
+        {
+            fprintf(stderr, "%s: cannot %s %s\n", folder, handles[i] ? "preallocate" : "create", paths[i]);
+            files = handles[i] ? i + 1 : i;
+            ok = 0;
+            break;
+        }
+
+        struct stat st;
+        if (stat(paths[i], &st) == 0)
+            run->blocks_before += (uint64_t)st.st_blocks;
+    }
+
+    for (uint64_t written = 0; ok && written < size; written += ROMI_WRITER_BLOCK_SIZE)
+    {
+        uint32_t chunk = (uint32_t)min64(size - written, ROMI_WRITER_BLOCK_SIZE);
+        for (uint32_t i = 0; ok && i < files; i++)
+            ok = romi_write(handles[i], block, chunk);
+    }
+
+    for (uint32_t i = 0; i < files; i++)
+    {
+        FILE* f = handles[i];
+        if (ok && (fflush(f) != 0 || fsync(fileno(f)) != 0))
+            ok = 0;
+        romi_close(f);
+    }
+
+    run->wall_msec = wall_msec() - start;
+
+    for (uint32_t i = 0; i < files; i++)
+    {
+        run->extents += count_extents(paths[i]);
+        romi_rm(paths[i]);
+    }
+
+    run->blocks_before /= files ? files : 1;
+    run->extents /= files ? files : 1;
+    return ok;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [-j files] [-s size_mb] [-m mode] dir...\n"
+        "  -j files  written at the same time, like parallel downloads (default 3, max %u)\n"
+        "  -s mb     size of every file (default 64)\n"
+        "  -m mode   only run plain, truncate or allocate\n",
+        name, BENCH_MAX_FILES);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t files = 3;
+    uint64_t size = 64ULL * 1024 * 1024;
+    const char* mode = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:s:m:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': files = (uint32_t)atoi(optarg); break;
+        case 's': size = (uint64_t)atoi(optarg) * 1024 * 1024; break;
+        case 'm': mode = optarg; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+
+    if (optind == argc || files == 0 || files > BENCH_MAX_FILES || size == 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // incompressible, so no file system can shortcut it
+    static uint8_t block[ROMI_WRITER_BLOCK_SIZE];
+    uint32_t state = 0x524F4D69;
+    for (uint32_t i = 0; i < sizeof(block); i++)
+    {
+        state = state * 1103515245u + 12345u;
+        block[i] = (uint8_t)(state >> 16);
+    }
+
+    printf("%u files of %llu MB at once\n", files, (unsigned long long)(size >> 20));
+    printf("%-24s %-9s %10s %14s %13s\n", "folder", "mode", "MB/s", "blocks before", "extents/file");
+
+    int failed = 0;
+    for (int i = optind; i < argc; i++)
+    {
+        romi_mkdirs(argv[i]);
+
+        for (int m = 0; m < ModeCount; m++)
+        {
+            if (mode && strcmp(mode, mode_names[m]) != 0)
+                continue;
+
+            BenchRun run;
+            if (!run_case(argv[i], (BenchMode)m, files, size, block, &run))
+            {
+                printf("%-24s %-9s %10s\n", argv[i], mode_names[m], "failed");
+                failed = 1;
+                continue;
+            }
+
+            double mb = (double)size * files / (1024.0 * 1024.0);
+            printf("%-24s %-9s %10.1f %14llu %13u\n", argv[i], mode_names[m],
+                run.wall_msec ? mb * 1000.0 / run.wall_msec : 0.0,
+                (unsigned long long)run.blocks_before, run.extents);
+        }
+    }
+
+    return failed;
+}
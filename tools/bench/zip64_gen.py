@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""
+ZIP64 Test Archive Generator
+
+Writes ZIP64 archives over 4 GB for `make bench-extract`, the way PS2 DVD9
+and PS3 disc images get packed, without needing that much disk:
+
+    stored   a stored disc.iso of zeros, left as a hole in a sparse file,
+             then a small disc.cue past the 4 GB mark
+    deflate  the same entries deflated and written with data descriptors,
+             as a zip tool writing to a pipe does; the archive is a few MB
+
+Every size and offset over 32 bits goes through the zip64 extra field, and
+the central directory is found through the zip64 end record and locator.
+
+Usage:
+    python3 tools/bench/zip64_gen.py [--size BYTES] [--deflate] archive.zip
+"""
+import argparse
+import struct
+import zlib
+
+LOCAL_HEADER_SIG = 0x04034B50
+CENTRAL_DIR_SIG = 0x02014B50
+END_CENTRAL_DIR_SIG = 0x06054B50
+ZIP64_END_CENTRAL_DIR_SIG = 0x06064B50
+ZIP64_END_LOCATOR_SIG = 0x07064B50
+DATA_DESCRIPTOR_SIG = 0x08074B50
+
+FLAG_DATA_DESCRIPTOR = 0x0008
+METHOD_STORED = 0
+METHOD_DEFLATE = 8
+VERSION_ZIP64 = 45
+MAX32 = 0xFFFFFFFF
+
+CHUNK = 16 * 1024 * 1024
+ZEROS = bytes(CHUNK)
+CUE = b'FILE "disc.iso" BINARY\n  TRACK 01 MODE1/2048\n    INDEX 01 00:00:00\n'
+
+
+def zeros_crc(size):
+    crc = 0
+    for offset in range(0, size, CHUNK):
+        crc = zlib.crc32(ZEROS[:min(CHUNK, size - offset)], crc)
+    return crc
+
+
+def zip64_extra(*values):
+    return struct.pack("<HH", 0x0001, 8 * len(values)) + b"".join(struct.pack("<Q", v) for v in values)
+
+
+class Zip64Writer:
+    def __init__(self, f, descriptors):
+        self.f = f
+        self.descriptors = descriptors
+        self.entries = []
+
+    def local_header(self, name, method, crc, comp_size, size):
+        flags = FLAG_DATA_DESCRIPTOR if self.descriptors else 0
+        if self.descriptors:
+            # sizes follow the data, the zip64 field only announces 8 byte ones
+            crc, comp_size, size = 0, 0, 0
+        self.f.write(struct.pack("<IHHHHHIIIHH", LOCAL_HEADER_SIG, VERSION_ZIP64, flags, method, 0, 0x21,
+                                 crc, MAX32, MAX32, len(name), 20))
+        self.f.write(name)
+        self.f.write(zip64_extra(size, comp_size))
+
+    def finish_entry(self, name, method, crc, comp_size, size, offset):
+        if self.descriptors:
+            self.f.write(struct.pack("<IIQQ", DATA_DESCRIPTOR_SIG, crc, comp_size, size))
+        self.entries.append((name, method, crc, comp_size, size, offset))
+
+    def add_zeros(self, name, size):
+        offset = self.f.tell()
+        crc = zeros_crc(size)
+        if self.descriptors:
+            self.local_header(name, METHOD_DEFLATE, crc, 0, size)
+            deflate = zlib.compressobj(1, zlib.DEFLATED, -zlib.MAX_WBITS)
+            comp_size = 0
+            for done in range(0, size, CHUNK):
+                comp_size += self.f.write(deflate.compress(ZEROS[:min(CHUNK, size - done)]))
+            comp_size += self.f.write(deflate.flush())
+            self.finish_entry(name, METHOD_DEFLATE, crc, comp_size, size, offset)
+        else:
+            self.local_header(name, METHOD_STORED, crc, size, size)
+            # a hole, the file system reads it back as zeros
+            self.f.seek(size, 1)
+            self.finish_entry(name, METHOD_STORED, crc, size, size, offset)
+
+    def add_bytes(self, name, data):
+        offset = self.f.tell()
+        crc = zlib.crc32(data)
+        deflate = zlib.compressobj(9, zlib.DEFLATED, -zlib.MAX_WBITS)
+        packed = deflate.compress(data) + deflate.flush()
+        self.local_header(name, METHOD_DEFLATE, crc, len(packed), len(data))
+        self.f.write(packed)
+        self.finish_entry(name, METHOD_DEFLATE, crc, len(packed), len(data), offset)
+
+    def close(self):
+        dir_offset = self.f.tell()
+        for name, method, crc, comp_size, size, offset in self.entries:
+            # the zip64 field holds just the values too large for their 32-bit slot
+            wide = [v for v in (size, comp_size, offset) if v >= MAX32]
+            extra = zip64_extra(*wide) if wide else b""
+            self.f.write(struct.pack("<IHHHHHHIIIHHHHHII", CENTRAL_DIR_SIG, VERSION_ZIP64, VERSION_ZIP64,
+                                     FLAG_DATA_DESCRIPTOR if self.descriptors else 0, method, 0, 0x21, crc,
+                                     min(comp_size, MAX32), min(size, MAX32), len(name), len(extra), 0, 0, 0, 0,
+                                     min(offset, MAX32)))
+            self.f.write(name)
+            self.f.write(extra)
+        dir_size = self.f.tell() - dir_offset
+
+        end64_offset = self.f.tell()
+        count = len(self.entries)
+        self.f.write(struct.pack("<IQHHIIQQQQ", ZIP64_END_CENTRAL_DIR_SIG, 44, VERSION_ZIP64, VERSION_ZIP64, 0, 0,
+                                 count, count, dir_size, dir_offset))
+        self.f.write(struct.pack("<IIQI", ZIP64_END_LOCATOR_SIG, 0, end64_offset, 1))
+        self.f.write(struct.pack("<IHHHHIIH", END_CENTRAL_DIR_SIG, 0, 0, 0xFFFF, 0xFFFF, MAX32, MAX32, 0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Write a ZIP64 test archive over 4 GB")
+    parser.add_argument("archive")
+    parser.add_argument("--size", type=int, default=4608 * 1024 * 1024, help="bytes of disc.iso (default 4.5 GB)")
+    parser.add_argument("--deflate", action="store_true", help="deflate with data descriptors instead of a sparse stored entry")
+    options = parser.parse_args()
+
+    with open(options.archive, "wb") as f:
+        writer = Zip64Writer(f, options.deflate)
+        writer.add_zeros(b"disc.iso", options.size)
+        writer.add_bytes(b"disc.cue", CUE)
+        writer.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""
+Fault-Injecting HTTP Server
+
+Serves a directory over HTTP with Range support and misbehaves on purpose,
+to exercise ROMi's retry, stall detection and resume paths against a PC.
+
+Usage:
+    python3 tools/fault_http_server.py [dir] [--port 8080]
+        [--drop-after BYTES]   close the connection after sending BYTES of a body
+        [--stall-after BYTES]  stop sending after BYTES but keep the socket open
+        [--fail-first N]       answer the first N requests with 503
+        [--no-range]           ignore Range headers and always send 200
+        [--rate BYTES_PER_SEC] throttle every response body
+
+Point a sources.txt mirror at http://<pc-ip>:<port>/ and queue a download.
+"""
+import argparse
+import os
+import re
+import time
+from functools import partial
+from http.server import SimpleHTTPRequestHandler, ThreadingHTTPServer
+
+CHUNK = 16 * 1024
+
+
+class FaultHandler(SimpleHTTPRequestHandler):
+    requests_seen = 0
+
+    def __init__(self, *args, options=None, **kwargs):
+        self.options = options
+        super().__init__(*args, **kwargs)
+
+    def send_head_range(self):
+        path = self.translate_path(self.path)
+        if not os.path.isfile(path):
+            self.send_error(404)
+            return None
+
+        size = os.path.getsize(path)
+        start, end = 0, size - 1
+        partial_content = False
+
+        match = re.match(r"bytes=(\d*)-(\d*)", self.headers.get("Range", ""))
+        if match and not self.options.no_range:
+            if match.group(1):
+                start = int(match.group(1))
+                if match.group(2):
+                    end = min(int(match.group(2)), size - 1)
+            elif match.group(2):
+                start = max(size - int(match.group(2)), 0)
+            if start >= size:
+                self.send_response(416)
+                self.send_header("Content-Range", f"bytes */{size}")
+                self.end_headers()
+                return None
+            partial_content = True
+
+        self.send_response(206 if partial_content else 200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(end - start + 1))
+        self.send_header("Accept-Ranges", "none" if self.options.no_range else "bytes")
+        if partial_content:
+            self.send_header("Content-Range", f"bytes {start}-{end}/{size}")
+        self.end_headers()
+        return path, start, end
+
+    def should_fail(self):
+        FaultHandler.requests_seen += 1
+        if FaultHandler.requests_seen <= self.options.fail_first:
+            self.log_message("injecting 503 (%d/%d)", FaultHandler.requests_seen, self.options.fail_first)
+            self.send_error(503)
+            return True
+        return False
+
+    def do_HEAD(self):
+        if not self.should_fail():
+            self.send_head_range()
+
+    def do_GET(self):
+        if self.should_fail():
+            return
+
+        head = self.send_head_range()
+        if head is None:
+            return
+        path, start, end = head
+
+        sent = 0
+        began = time.monotonic()
+        with open(path, "rb") as f:
+            f.seek(start)
+            remaining = end - start + 1
+            while remaining > 0:
+                if self.options.drop_after and sent >= self.options.drop_after:
+                    self.log_message("dropping connection after %d bytes", sent)
+                    self.close_connection = True
+                    return
+                if self.options.stall_after and sent >= self.options.stall_after:
+                    self.log_message("stalling after %d bytes", sent)
+                    time.sleep(3600)
+                    return
+
+                data = f.read(min(CHUNK, remaining))
+                if not data:
+                    break
+                try:
+                    self.wfile.write(data)
+                except (BrokenPipeError, ConnectionResetError):
+                    return
+                sent += len(data)
+                remaining -= len(data)
+
+                if self.options.rate:
+                    ahead = sent / self.options.rate - (time.monotonic() - began)
+                    if ahead > 0:
+                        time.sleep(ahead)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="HTTP server with injected faults")
+    parser.add_argument("dir", nargs="?", default=".")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--drop-after", type=int, default=0)
+    parser.add_argument("--stall-after", type=int, default=0)
+    parser.add_argument("--fail-first", type=int, default=0)
+    parser.add_argument("--no-range", action="store_true")
+    parser.add_argument("--rate", type=int, default=0)
+    options = parser.parse_args()
+
+    handler = partial(FaultHandler, directory=options.dir, options=options)
+    server = ThreadingHTTPServer(("", options.port), handler)
+    print(f"Serving {options.dir} on port {options.port}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
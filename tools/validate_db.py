@@ -3,11 +3,14 @@
 Database Format Validator
 
 Validates that all TSV database files follow the correct format:
-Platform\tRegion\tName\tURL\tSize
+Platform\tRegion\tName\tURL\tSize[\tHash]
+
+The Hash column is optional; when present it must be a crc32 as 8 hex digits.
 
 Usage:
     python3 tools/validate_db.py [db_dir]
 """
+import re
 import sys
 from pathlib import Path
 
@@ -44,6 +47,7 @@ for db_file in sorted(db_dir.glob("romi_*.tsv")):
 
     field_counts = set()
     issues = []
+    hash_issues = []
     first_data_line = None
     last_data_line = None
 
@@ -53,10 +57,15 @@ for db_file in sorted(db_dir.glob("romi_*.tsv")):
             continue
 
         fields = line.rstrip('\n').split('\t')
-        field_counts.add(len(fields))
-
-        if len(fields) != 5:
-            issues.append(f"Line {i}: {len(fields)} fields (expected 5)")
+        # the optional hash column counts as a 5 field row once checked
+        field_counts.add(5 if len(fields) == 6 else len(fields))
+
+        if len(fields) == 6:
+            if fields[5] and not re.fullmatch(r"[0-9a-fA-F]{8}", fields[5]):
+                hash_issues.append(f"Line {i}: bad hash '{fields[5]}' (expected 8 hex digits)")
+            fields = fields[:5]
+        elif len(fields) != 5:
+            issues.append(f"Line {i}: {len(fields)} fields (expected 5 or 6)")
             if first_data_line is None or i == len(lines):
                 print(f"  ✗ {'First' if first_data_line is None else 'Last'} data row: {len(fields)} fields")
                 print(f"     {line.rstrip()[:100]}...")
@@ -89,7 +98,7 @@ for db_file in sorted(db_dir.glob("romi_*.tsv")):
         print(f"     Size: {size}")
 
     if len(field_counts) == 1 and 5 in field_counts:
-        print(f"  ✓ All {len(data_lines)} data rows have 5 fields")
+        print(f"  ✓ All {len(data_lines)} data rows have 5 fields (+ optional hash)")
     else:
         print(f"  ✗ Inconsistent field counts: {field_counts}")
         for issue in issues[:3]:
@@ -99,6 +108,13 @@ for db_file in sorted(db_dir.glob("romi_*.tsv")):
         valid = False
         file_valid = False
 
+    if hash_issues:
+        print(f"  ✗ {len(hash_issues)} rows with a malformed hash")
+        for issue in hash_issues[:3]:
+            print(f"     {issue}")
+        valid = False
+        file_valid = False
+
     if not file_valid:
         failed_files.append(db_file.name)
 